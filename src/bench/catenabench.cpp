@@ -0,0 +1,453 @@
+#include <set>
+#include <map>
+#include <chrono>
+#include <random>
+#include <vector>
+#include <algorithm>
+#include <unordered_set>
+#include <unordered_map>
+#include <cstdlib>
+#include <malloc.h>
+#include <iostream>
+#include <functional>
+#include <openssl/evp.h>
+#include <libcatena/truststore.h>
+#include <libcatena/ledgermap.h>
+#include <libcatena/jsoncheck.h>
+#include <libcatena/flatmap.h>
+#include <libcatena/utility.h>
+#include <libcatena/builtin.h>
+#include <libcatena/txvalue.h>
+#include <libcatena/block.h>
+#include <libcatena/hotkeys.h>
+#include <libcatena/hash.h>
+
+// Microbenchmarks of ledger processing, run against a ledger file (by default
+// the mock ledger used by the unit tests). Each reports nanoseconds per unit
+// of work, the mean over enough rounds to take a measurable time.
+
+namespace {
+
+constexpr char DEFAULT_LEDGER[] = "test/ledger-test";
+constexpr std::chrono::milliseconds MINTIME(500);
+
+// A transaction as found in the ledger
+struct TXSpan {
+	const unsigned char* data;
+	unsigned len;
+	Catena::CatenaHash blkhash;
+	unsigned idx;
+};
+
+// The loaded ledger, and the location of each of its transactions
+struct Ledger {
+	std::unique_ptr<unsigned char[]> data;
+	size_t len;
+	std::vector<Catena::BlockDetail> blocks;
+	std::vector<TXSpan> txs;
+	Catena::TrustStore tstore; // as of the end of the ledger
+};
+
+// Run round() until MINTIME has passed, and report the time per unit, where
+// each round handles units units. setup() is run before each round, untimed.
+void Bench(const char* name, size_t units, const std::function<void()>& setup,
+		const std::function<void()>& round){
+	using namespace std::chrono;
+	nanoseconds total(0);
+	size_t rounds = 0;
+	while(total < MINTIME){
+		setup();
+		auto start = steady_clock::now();
+		round();
+		total += duration_cast<nanoseconds>(steady_clock::now() - start);
+		++rounds;
+	}
+	std::cout << name << ": " << total.count() / (rounds * units) << "ns ("
+		<< rounds << " rounds of " << units << ")" << std::endl;
+}
+
+Ledger LoadLedger(const char* fname){
+	Ledger l;
+	l.data = Catena::ReadBinaryFile(fname, &l.len);
+	Catena::LedgerMap lmap;
+	Catena::BuiltinKeys bkeys;
+	bkeys.AddToTrustStore(l.tstore);
+	Catena::Blocks blocks;
+	if(blocks.LoadData(l.data.get(), l.len, lmap, l.tstore)){
+		throw Catena::BlockValidationException(std::string("couldn't load ") + fname);
+	}
+	l.blocks = blocks.Inspect(0, -1);
+	// Follow each block's offset table to its transactions
+	for(const auto& b : l.blocks){
+		const auto& h = b.bhdr;
+		auto body = b.bytes.get() + Catena::Block::BLOCKHEADERLEN;
+		auto tab = body;
+		body += 4 * h.txcount;
+		auto bodylen = h.totlen - Catena::Block::BLOCKHEADERLEN - 4 * h.txcount;
+		for(unsigned i = 0 ; i < h.txcount ; ++i){
+			auto off = Catena::nbo_to_ulong(tab + 4 * i, 4);
+			auto end = i + 1 < h.txcount ? Catena::nbo_to_ulong(tab + 4 * (i + 1), 4) : bodylen;
+			l.txs.push_back({body + off, static_cast<unsigned>(end - off), h.hash, i});
+		}
+	}
+	return l;
+}
+
+void BenchLex(const Ledger& l){
+	const auto& txs = l.txs;
+	Bench("lex (heap)", txs.size(), []{}, [&]{
+		std::vector<std::unique_ptr<Catena::Transaction>> lexed;
+		lexed.reserve(txs.size());
+		for(const auto& t : txs){
+			lexed.push_back(Catena::Transaction::LexTX(t.data, t.len, t.blkhash, t.idx));
+		}
+	});
+	Bench("lex (value)", txs.size(), []{}, [&]{
+		std::vector<Catena::TXValue> lexed;
+		lexed.reserve(txs.size());
+		for(const auto& t : txs){
+			Catena::LexTXValue(lexed, t.data, t.len, t.blkhash, t.idx);
+		}
+	});
+}
+
+// catenaHash() as it was, with a digest context created for each call
+void FreshContextHash(const void* in, size_t len, unsigned char* hash){
+	auto mdctx = EVP_MD_CTX_new();
+	if(!mdctx || 1 != EVP_DigestInit_ex(mdctx, EVP_sha256(), NULL) ||
+			1 != EVP_DigestUpdate(mdctx, in, len) ||
+			1 != EVP_DigestFinal_ex(mdctx, hash, NULL)){
+		EVP_MD_CTX_free(mdctx);
+		throw std::runtime_error("error running SHA256");
+	}
+	EVP_MD_CTX_free(mdctx);
+}
+
+void BenchHash(const Ledger& l){
+	const auto& txs = l.txs;
+	std::vector<Catena::CatenaHash> hashes(txs.size());
+	std::vector<Catena::HashInput> spans;
+	for(const auto& t : txs){
+		spans.push_back({t.data, t.len});
+	}
+	Bench("hash (fresh context)", txs.size(), []{}, [&]{
+		for(size_t i = 0 ; i < txs.size() ; ++i){
+			FreshContextHash(txs[i].data, txs[i].len, hashes[i].data());
+		}
+	});
+	Bench("hash (thread context)", txs.size(), []{}, [&]{
+		for(size_t i = 0 ; i < txs.size() ; ++i){
+			Catena::catenaHash(txs[i].data, txs[i].len, hashes[i]);
+		}
+	});
+	Bench("hash (batch)", txs.size(), []{}, [&]{
+		Catena::catenaHashBatch(spans.data(), spans.size(), hashes.data());
+	});
+}
+
+// Signature verification alone, for each transaction whose signer can be
+// determined without the LedgerMap
+void BenchVerify(const Ledger& l){
+	std::vector<std::unique_ptr<Catena::Transaction>> lexed;
+	std::vector<std::pair<Catena::SignatureCheck, std::shared_ptr<const Catena::Keypair>>> checks;
+	for(const auto& t : l.txs){
+		lexed.push_back(Catena::Transaction::LexTX(t.data, t.len, t.blkhash, t.idx));
+		Catena::SignatureCheck sc;
+		if(lexed.back()->SignatureCheckable(&sc)){
+			auto kp = l.tstore.LookupKey(sc.signer);
+			if(kp){
+				checks.emplace_back(sc, kp);
+			}
+		}
+	}
+	auto verify = [&](auto&& fn){
+		for(const auto& c : checks){
+			if(fn(c.first, *c.second)){
+				throw Catena::SigningException("verification failed");
+			}
+		}
+	};
+	Bench("verify (keypair)", checks.size(), []{}, [&]{
+		verify([](const Catena::SignatureCheck& sc, const Catena::Keypair& kp){
+			return kp.Verify(sc.data, sc.len, sc.sig, sc.siglen);
+		});
+	});
+	Catena::HotKeys hot;
+	Bench("verify (hot keys)", checks.size(), []{}, [&]{
+		verify([&](const Catena::SignatureCheck& sc, const Catena::Keypair& kp){
+			return hot.Verify(sc.signer, kp, sc.data, sc.len, sc.sig, sc.siglen);
+		});
+	});
+}
+
+constexpr unsigned KEYCOUNT = 1000;
+
+// Heap bytes in use, including large blocks allocated with mmap()
+size_t HeapInUse(){
+	auto mi = mallinfo2();
+	return mi.uordblks + mi.hblkhd;
+}
+
+// Registering public keys, as done when replaying (decode to validate) and
+// restoring snapshots (no decode), against the old approach of holding every
+// key decoded. Also reports the heap consumed per key held.
+void BenchKeys(){
+	std::vector<std::string> pems;
+	for(unsigned i = 0 ; i < KEYCOUNT ; ++i){
+		Catena::Keypair kp;
+		kp.Generate();
+		pems.push_back(kp.PubkeyPEM());
+	}
+	auto pem = [&](unsigned i){
+		return reinterpret_cast<const unsigned char*>(pems[i].data());
+	};
+	Catena::CatenaHash hash;
+	hash.fill(0);
+	auto fill = [&](size_t cache, auto&& add){
+		auto before = HeapInUse();
+		auto tstore = std::make_unique<Catena::TrustStore>(cache);
+		for(unsigned i = 0 ; i < KEYCOUNT ; ++i){
+			add(*tstore, i, Catena::TXSpec(hash, i));
+		}
+		return (HeapInUse() - before) / KEYCOUNT;
+	};
+	auto decoded = [&](Catena::TrustStore& ts, unsigned i, const Catena::TXSpec& spec){
+		Catena::Keypair kp(pem(i), pems[i].size());
+		ts.AddKey(&kp, spec);
+	};
+	auto encoded = [&](Catena::TrustStore& ts, unsigned i, const Catena::TXSpec& spec){
+		ts.AddKey(pem(i), pems[i].size(), spec);
+	};
+	auto restored = [&](Catena::TrustStore& ts, unsigned i, const Catena::TXSpec& spec){
+		ts.RestoreKey(pem(i), pems[i].size(), spec);
+	};
+	// with a decoded cache a tenth the key count, most are held only encoded
+	std::cout << "key heap (decoded): " << fill(0, decoded) << "b/key" << std::endl;
+	std::cout << "key heap (encoded): " << fill(KEYCOUNT / 10, encoded) << "b/key" << std::endl;
+	std::cout << "key heap (restored): " << fill(0, restored) << "b/key" << std::endl;
+	std::unique_ptr<Catena::TrustStore> tstore;
+	auto setup = [&]{ tstore = std::make_unique<Catena::TrustStore>(); };
+	Bench("add key (decoded)", KEYCOUNT, setup, [&]{
+		for(unsigned i = 0 ; i < KEYCOUNT ; ++i){
+			decoded(*tstore, i, Catena::TXSpec(hash, i));
+		}
+	});
+	Bench("add key (encoded)", KEYCOUNT, setup, [&]{
+		for(unsigned i = 0 ; i < KEYCOUNT ; ++i){
+			encoded(*tstore, i, Catena::TXSpec(hash, i));
+		}
+	});
+	Bench("restore key", KEYCOUNT, setup, [&]{
+		for(unsigned i = 0 ; i < KEYCOUNT ; ++i){
+			restored(*tstore, i, Catena::TXSpec(hash, i));
+		}
+	});
+}
+
+constexpr size_t MAPCOUNT = 10000000;
+
+// Insert specs into a fresh M (a set, or a map to StatusDelegations as in
+// LedgerMap), then look up each of probes, reporting the heap used per entry
+template<typename M>
+void BenchMap(const std::string& name, const std::vector<Catena::TXSpec>& specs,
+		const std::vector<Catena::TXSpec>& probes){
+	std::unique_ptr<M> m;
+	auto fill = [&]{
+		for(const auto& s : specs){
+			if constexpr(std::is_same_v<typename M::key_type, typename M::value_type>){
+				m->insert(s);
+			}else{
+				m->emplace(s, Catena::StatusDelegation(0, s, s));
+			}
+		}
+	};
+	Bench(("insert " + name).c_str(), specs.size(),
+		[&]{ m.reset(); m = std::make_unique<M>(); }, fill);
+	m.reset();
+	auto before = HeapInUse();
+	m = std::make_unique<M>();
+	fill();
+	std::cout << name << " heap: " << (HeapInUse() - before) / specs.size()
+		<< "b/entry" << std::endl;
+	Bench(("find " + name).c_str(), probes.size(), []{}, [&]{
+		size_t found = 0;
+		for(const auto& p : probes){
+			found += m->find(p) != m->end();
+		}
+		if(found != probes.size()){
+			throw std::runtime_error("lost entries in " + name);
+		}
+	});
+}
+
+// LedgerMap's containers at scale. Specs come 64 to a block, as
+// transactions do, and are probed in random order.
+void BenchMaps(){
+	std::mt19937_64 rng(0);
+	std::vector<Catena::TXSpec> specs;
+	specs.reserve(MAPCOUNT);
+	Catena::CatenaHash hash;
+	for(size_t i = 0 ; i < MAPCOUNT ; ++i){
+		if(i % 64 == 0){
+			for(auto& b : hash){
+				b = rng();
+			}
+		}
+		specs.emplace_back(hash, i % 64);
+	}
+	auto probes = specs;
+	std::shuffle(probes.begin(), probes.end(), rng);
+	using SD = Catena::StatusDelegation;
+	BenchMap<std::set<Catena::TXSpec>>("std::set", specs, probes);
+	BenchMap<std::unordered_set<Catena::TXSpec>>("std::unordered_set", specs, probes);
+	BenchMap<Catena::FlatSet<Catena::TXSpec>>("FlatSet", specs, probes);
+	BenchMap<std::map<Catena::TXSpec, SD>>("std::map", specs, probes);
+	BenchMap<std::unordered_map<Catena::TXSpec, SD>>("std::unordered_map", specs, probes);
+	BenchMap<Catena::FlatMap<Catena::TXSpec, SD>>("FlatMap", specs, probes);
+}
+
+constexpr unsigned STATEUSERS = 1000000;
+
+// A LedgerMap holding STATEUSERS users spread over 100 consortium members,
+// each user with a status delegation, a status, an external lookup, and a
+// lookup request. Reports heap per user, and the lookups behind Validate().
+void BenchLedgerState(){
+	std::mt19937_64 rng(0);
+	auto spec = [&](){
+		Catena::CatenaHash hash;
+		for(auto& b : hash){
+			b = rng();
+		}
+		return Catena::TXSpec(hash, rng() % 64);
+	};
+	std::vector<Catena::TXSpec> cms, usds, lars;
+	auto before = HeapInUse();
+	auto lmap = std::make_unique<Catena::LedgerMap>();
+	for(unsigned i = 0 ; i < 100 ; ++i){
+		cms.push_back(spec());
+		lmap->AddConsortiumMember(cms.back(), nlohmann::json({}));
+	}
+	auto status = nlohmann::json(1);
+	for(unsigned i = 0 ; i < STATEUSERS ; ++i){
+		auto u = spec();
+		auto el = spec();
+		const auto& cm = cms[i % cms.size()];
+		lmap->AddUser(u, cm);
+		lmap->AddExtLookup(el);
+		usds.push_back(spec());
+		lmap->AddDelegation(usds.back(), cm, u, 0);
+		lmap->SetUserStatus(u, 0, status);
+		lars.push_back(spec());
+		lmap->AddLookupReq(lars.back(), el, cm);
+	}
+	std::cout << "ledger state heap: " << (HeapInUse() - before) / STATEUSERS
+		<< "b/user" << std::endl;
+	std::shuffle(usds.begin(), usds.end(), rng);
+	std::shuffle(lars.begin(), lars.end(), rng);
+	Bench("ledger state lookups", STATEUSERS, []{}, [&]{
+		for(unsigned i = 0 ; i < STATEUSERS ; ++i){
+			const auto& usd = lmap->LookupDelegation(usds[i]);
+			lmap->LookupUser(usd.USpec());
+			const auto& lar = lmap->LookupReq(lars[i]);
+			if(lar.ELSpec() == usd.CMSpec()){
+				throw std::runtime_error("corrupt ledger state");
+			}
+		}
+	});
+}
+
+constexpr unsigned STATUSCOUNT = 100000;
+
+// Accepting a status payload at replay: parsing it into a DOM (and holding
+// that), against checking its syntax (and holding the text)
+void BenchStatus(){
+	const std::string status = "{ \"greencoins\": \"1729\", \"updated\": "
+		"\"2026-10-17T00:00:00Z\", \"flags\": [1, 2, 3], \"active\": true }";
+	std::vector<nlohmann::json> doms;
+	std::vector<std::string> texts;
+	auto before = HeapInUse();
+	for(unsigned i = 0 ; i < STATUSCOUNT ; ++i){
+		doms.push_back(nlohmann::json::parse(status));
+	}
+	std::cout << "status heap (DOM): " << (HeapInUse() - before) / STATUSCOUNT
+		<< "b/status" << std::endl;
+	before = HeapInUse();
+	for(unsigned i = 0 ; i < STATUSCOUNT ; ++i){
+		texts.push_back(status);
+	}
+	std::cout << "status heap (text): " << (HeapInUse() - before) / STATUSCOUNT
+		<< "b/status" << std::endl;
+	Bench("status parse", STATUSCOUNT, []{}, [&]{
+		for(unsigned i = 0 ; i < STATUSCOUNT ; ++i){
+			doms[i] = nlohmann::json::parse(status);
+		}
+	});
+	Bench("status check", STATUSCOUNT, []{}, [&]{
+		for(unsigned i = 0 ; i < STATUSCOUNT ; ++i){
+			if(Catena::InvalidJSON(status.data(), status.size())){
+				throw std::runtime_error("invalid status");
+			}
+			texts[i] = status;
+		}
+	});
+}
+
+// Validation mutates the ledger state, so each round begins anew
+void BenchValidate(const Ledger& l){
+	const auto& txs = l.txs;
+	Catena::BuiltinKeys bkeys;
+	Catena::LedgerMap lmap;
+	Catena::TrustStore tstore;
+	auto setup = [&]{
+		lmap = Catena::LedgerMap();
+		tstore = Catena::TrustStore();
+		bkeys.AddToTrustStore(tstore);
+	};
+	Bench("lex+validate (heap)", txs.size(), setup, [&]{
+		std::vector<std::unique_ptr<Catena::Transaction>> lexed;
+		lexed.reserve(txs.size());
+		for(const auto& t : txs){
+			lexed.push_back(Catena::Transaction::LexTX(t.data, t.len, t.blkhash, t.idx));
+		}
+		if(Catena::Transaction::ValidateBatch(lexed, tstore, lmap, 1)){
+			throw Catena::TransactionException("validation failed");
+		}
+	});
+	Bench("lex+validate (value)", txs.size(), setup, [&]{
+		std::vector<Catena::TXValue> lexed;
+		lexed.reserve(txs.size());
+		for(const auto& t : txs){
+			Catena::LexTXValue(lexed, t.data, t.len, t.blkhash, t.idx);
+		}
+		if(Catena::Transaction::ValidateBatch(lexed, tstore, lmap, 1)){
+			throw Catena::TransactionException("validation failed");
+		}
+	});
+}
+
+}
+
+int main(int argc, char** argv){
+	const char* fname = argc > 1 ? argv[1] : DEFAULT_LEDGER;
+	if(argc > 2){
+		std::cerr << "usage: " << argv[0] << " [ ledger ]" << std::endl;
+		return EXIT_FAILURE;
+	}
+	try{
+		auto l = LoadLedger(fname);
+		std::cout << fname << ": " << l.blocks.size() << " blocks, "
+			<< l.txs.size() << " transactions" << std::endl;
+		BenchHash(l);
+		BenchLex(l);
+		BenchVerify(l);
+		BenchValidate(l);
+		BenchKeys();
+		BenchMaps();
+		BenchLedgerState();
+		BenchStatus();
+	}catch(const std::exception& e){
+		std::cerr << "error: " << e.what() << std::endl;
+		return EXIT_FAILURE;
+	}
+	return EXIT_SUCCESS;
+}
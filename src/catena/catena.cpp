@@ -19,7 +19,8 @@ static void usage(std::ostream& os, const char* name, int exitcode)
 
 static void usage(std::ostream& os, const char* name, int exitcode){
 	os << "usage: " << name << " -h | options\n";
-	os << " -l ledger: specify ledger file\n";
+	os << " -l ledger: specify ledger file or segment directory\n";
+	os << " -s MiB: segment size for directory ledgers, 0 for unbounded, default: 256\n";
 	os << " -k keyfile,txspec: provide authentication material (may be used multiple times)\n";
 	os << " -p port: HTTP service port, 0 to disable, default: " << DEFAULT_HTTP_PORT << "\n";
 	os << " -r port: RPC service port, 0 to disable, default: " << DEFAULT_RPC_PORT << "\n";
@@ -27,6 +28,10 @@ static void usage(std::ostream& os, const char* name, int exitcode){
 	os << " -P peerfile: file containing initial RPC peers\n";
   os << " -A addrs: comma-delimited list of addresses to advertise\n";
 	os << " -v keyfile: file containing PEM key for RPC authentication\n";
+	os << " -w workers: ledger verification threads, 0 for one per CPU, default: 0\n";
+	os << " -g usecs: delay before syncing, to group more appends per sync, default: 0\n";
+	os << " -n: don't sync appended blocks to disk\n";
+	os << " -z: compress sealed segments of directory ledgers\n";
 	os << " -h: print usage information\n";
 	os << " -d: daemonize\n";
 	os << std::flush;
@@ -42,9 +47,10 @@ int main(int argc, char **argv){
 	const char* peer_file = nullptr;
 	const char* key_file = nullptr;
 	auto rpc_port = DEFAULT_RPC_PORT;
+	Catena::LedgerOptions ledger_opts;
 	bool daemonize = false;
 	int c;
-	while(-1 != (c = getopt(argc, argv, "A:P:C:k:l:p:r:v:hd"))){
+	while(-1 != (c = getopt(argc, argv, "A:P:C:g:k:l:p:r:s:v:w:hdnz"))){
 		switch(c){
 		case 'd':
 			daemonize = true;
@@ -109,7 +115,37 @@ int main(int argc, char **argv){
 				usage(std::cerr, argv[0], EXIT_FAILURE);
 			}
 			break;
-		}case 'l':
+		}case 's':{
+			try{
+				ledger_opts.segment_size = Catena::StrToLong(optarg, 0, 1024 * 1024) * 1024 * 1024;
+			}catch(Catena::ConvertInputException& e){
+				std::cerr << "bad value for segment size: " << e.what() << std::endl;
+				usage(std::cerr, argv[0], EXIT_FAILURE);
+			}
+			break;
+		}case 'w':{
+			try{
+				ledger_opts.workers = Catena::StrToLong(optarg, 0, 1024);
+			}catch(Catena::ConvertInputException& e){
+				std::cerr << "bad value for workers: " << e.what() << std::endl;
+				usage(std::cerr, argv[0], EXIT_FAILURE);
+			}
+			break;
+		}case 'g':{
+			try{
+				ledger_opts.commit_delay_us = Catena::StrToLong(optarg, 0, 1000000);
+			}catch(Catena::ConvertInputException& e){
+				std::cerr << "bad value for sync delay: " << e.what() << std::endl;
+				usage(std::cerr, argv[0], EXIT_FAILURE);
+			}
+			break;
+		}case 'n':
+			ledger_opts.durable = false;
+			break;
+		case 'z':
+			ledger_opts.archive = true;
+			break;
+		case 'l':
 			ledger_file = optarg;
 			break;
 		case 'h':
@@ -140,7 +176,7 @@ int main(int argc, char **argv){
 		std::cout << "Loading ledger from " << ledger_file << std::endl;
 		// FIXME we'll want to provide privkey prior to loading the
 		// chain, since we need it to decode LookupAuth transactions...
-		Catena::Chain chain(ledger_file);
+		Catena::Chain chain(ledger_file, ledger_opts);
 		for(auto& k : keys){
 			try{
 				std::cout << "Loading private key from " << k.first << std::endl;
@@ -1,4 +1,7 @@
+#include <climits>
+#include <cstring>
 #include <sstream>
+#include <algorithm>
 #include <iostream>
 #include <unistd.h>
 #include <microhttpd.h>
@@ -10,6 +13,26 @@
 
 namespace CatenaAgent {
 
+namespace {
+
+// Thrown by GET handlers to reject the request's arguments, whereupon the
+// client gets a 400 carrying what()
+class BadRequest : public std::runtime_error {
+public:
+BadRequest(const std::string& why) : std::runtime_error(why){}
+};
+
+// The named numeric query argument, which must be an integer in [min, max]
+long QueryLong(const char* name, const char* val, long min, long max){
+	try{
+		return Catena::StrToLong(val, min, max);
+	}catch(const Catena::ConvertInputException& e){
+		throw BadRequest(std::string("bad ") + name + " (" + e.what() + ")");
+	}
+}
+
+}
+
 HTTPDServer::~HTTPDServer(){
 	if(mhd){
 		MHD_stop_daemon(mhd);
@@ -43,10 +66,7 @@ std::ostream& HTTPDServer::HTMLHeader(std::ostream& ss) const {
 }
 
 // simple little HTML escaping for '&', '<', and '>'. might want a real one?
-std::ostream& HTTPDServer::JSONtoHTML(std::ostream& ss, const nlohmann::json& json) const {
-	std::stringstream inter;
-	inter << std::setw(1) << json;
-	const std::string& s = inter.str();
+static std::ostream& HTMLEscape(std::ostream& ss, const std::string& s){
 	for(size_t pos = 0 ; pos != s.size() ; ++pos) {
 		switch(s[pos]) {
 			case '&': ss << "&amp;"; break;
@@ -58,6 +78,12 @@ std::ostream& HTTPDServer::JSONtoHTML(std::ostream& ss, const nlohmann::json& js
 	return ss;
 }
 
+std::ostream& HTTPDServer::JSONtoHTML(std::ostream& ss, const nlohmann::json& json) const {
+	std::stringstream inter;
+	inter << std::setw(1) << json;
+	return HTMLEscape(ss, inter.str());
+}
+
 std::ostream& HTTPDServer::HTMLSysinfo(std::ostream& ss) const {
 	ss << "<h3>system</h3><table>";
 	ss << "<tr><td>cxx</td><td>" << Catena::GetCompilerID() << "</td></tr>";
@@ -153,17 +179,33 @@ std::ostream& HTTPDServer::HTMLMembers(std::ostream& ss) const {
 std::ostream& HTTPDServer::HTMLChaininfo(std::ostream& ss) const {
 	ss << "<h3>chain</h3>";
 	ss << "<table>";
-	ss << "<tr><td>chain bytes</td><td>" << chain.Size() << "</td></tr>";
-	ss << "<tr><td>blocks</td><td>" << chain.GetBlockCount() << "</td></tr>";
-	ss << "<tr><td>transactions</td><td>" << chain.TXCount() << "</td></tr>";
+	auto lstats = chain.Stats();
+	ss << "<tr><td>chain bytes</td><td>" << lstats.bytes << "</td></tr>";
+	ss << "<tr><td>blocks</td><td>" << lstats.blocks << "</td></tr>";
+	ss << "<tr><td>transactions</td><td>" << lstats.transactions << "</td></tr>";
+	for(unsigned t = 0 ; t < lstats.txtypes.size() ; ++t){
+		if(lstats.txtypes[t]){
+			ss << "<tr><td>&nbsp;" << Catena::TXTypeName(t) << "</td><td>"
+				<< lstats.txtypes[t] << "</td></tr>";
+		}
+	}
 	ss << "<tr><td>outstanding TXs</td><td>" << chain.OutstandingTXCount() << "</td></tr>";
-	ss << "<tr><td>consortium members</td><td>" << chain.ConsortiumMemberCount() << "</td></tr>";
-	ss << "<tr><td>lookup requests</td><td>" << chain.LookupRequestCount() << "</td></tr>";
-	ss << "<tr><td>lookup authorizations</td><td>" << chain.LookupRequestCount(true) << "</td></tr>";
-	ss << "<tr><td>external IDs</td><td>" << chain.ExternalLookupCount() << "</td></tr>";
-	ss << "<tr><td>public keys</td><td>" << chain.PubkeyCount() << "</td></tr>";
-	ss << "<tr><td>users</td><td>" << chain.UserCount() << "</td></tr>";
-	ss << "<tr><td>status delegations</td><td>" << chain.StatusDelegationCount() << "</td></tr>";
+	ss << "<tr><td>consortium members</td><td>" << lstats.members << "</td></tr>";
+	ss << "<tr><td>lookup requests</td><td>" << lstats.lookupreqs << "</td></tr>";
+	ss << "<tr><td>lookup authorizations</td><td>" << lstats.authorizedlookups << "</td></tr>";
+	ss << "<tr><td>external IDs</td><td>" << lstats.extlookups << "</td></tr>";
+	ss << "<tr><td>public keys</td><td>" << lstats.pubkeys << "</td></tr>";
+	ss << "<tr><td>users</td><td>" << lstats.users << "</td></tr>";
+	ss << "<tr><td>status delegations</td><td>" << lstats.delegations << "</td></tr>";
+	auto cstats = chain.CacheStats();
+	ss << "<tr><td>block cache</td><td>" << cstats.entries << " blocks, "
+		<< cstats.bytes << "/" << cstats.budget << " bytes, " << cstats.hits
+		<< " hits, " << cstats.misses << " misses</td></tr>";
+	auto gstats = chain.CommitStats();
+	ss << "<tr><td>commits</td><td>" << gstats.commits << " blocks, "
+		<< gstats.bytes << " bytes, " << gstats.syncs << " syncs, "
+		<< (gstats.commits ? gstats.total_us / gstats.commits : 0) << "/"
+		<< gstats.max_us << " &micro;s mean/max latency</td></tr>";
 	ss << "</table>";
 	return ss;
 }
@@ -213,22 +255,7 @@ HTTPDServer::Summary(struct MHD_Connection* conn __attribute__ ((unused))) const
 
 struct MHD_Response*
 HTTPDServer::Show(struct MHD_Connection* conn __attribute__ ((unused))) const {
-	std::stringstream ss;
-  HTMLHeader(ss);
-	auto j = InspectJSON(0, -1);
-	ss << "<pre>";
-	JSONtoHTML(ss, InspectJSON(0, -1)) << "</pre>";
-	ss << "</body>";
-	std::string s = ss.str();
-	auto resp = MHD_create_response_from_buffer(s.size(),
-			const_cast<char*>(s.c_str()), MHD_RESPMEM_MUST_COPY);
-	if(resp){
-		if(MHD_NO == MHD_add_response_header(resp, MHD_HTTP_HEADER_CONTENT_TYPE, "text/html; charset=UTF-8")){
-			MHD_destroy_response(resp);
-			return nullptr;
-		}
-	}
-	return resp;
+	return StreamBlocks(0, -1, true);
 }
 
 struct MHD_Response*
@@ -250,26 +277,110 @@ HTTPDServer::TStore(struct MHD_Connection* conn __attribute__ ((unused))) const
 	return resp;
 }
 
-nlohmann::json HTTPDServer::InspectJSON(int start, int end) const {
-	auto blks = chain.Inspect(start, end);
-	std::vector<nlohmann::json> jblks;
-	for(const auto& b : blks){
-		std::vector<nlohmann::json> jtxs;
-		for(const auto& tx : b.transactions){
-			jtxs.emplace_back(tx.get()->JSONify());
+nlohmann::json HTTPDServer::BlockJSON(const Catena::BlockDetail& b){
+	std::vector<nlohmann::json> jtxs;
+	for(const auto& tx : b.transactions){
+		jtxs.emplace_back(tx.get()->JSONify());
+	}
+	nlohmann::json jblk;
+	jblk["transactions"] = jtxs;
+	jblk["version"] = b.bhdr.version;
+	jblk["utc"] = b.bhdr.utc;
+	jblk["bytes"] = b.bhdr.totlen;
+	jblk["hash"] = Catena::hashOString(b.bhdr.hash);
+	jblk["prev"] = Catena::hashOString(b.bhdr.prev);
+	return jblk;
+}
+
+namespace {
+
+// State for a StreamBlocks() response: output not yet taken by MHD, and the
+// next block to render once it has been
+struct BlockStream {
+	BlockStream(Catena::BlockRange range, bool html) :
+	  range(range),
+	  next(range.begin()),
+	  html(html),
+	  done(false),
+	  taken(0) {}
+
+	Catena::BlockRange range;
+	Catena::BlockRange::iterator next;
+	bool html;
+	bool done; // pending holds the last of the output
+	std::string pending;
+	size_t taken; // bytes of pending already handed to MHD
+	std::string trailer;
+};
+
+ssize_t BlockStreamRead(void* cls, uint64_t pos __attribute__ ((unused)),
+			char* buf, size_t max){
+	auto bs = static_cast<BlockStream*>(cls);
+	while(bs->taken == bs->pending.size()){
+		if(bs->done){
+			return MHD_CONTENT_READER_END_OF_STREAM;
 		}
-		nlohmann::json jblk;
-		jblk["transactions"] = jtxs;
-		jblk["version"] = b.bhdr.version;
-		jblk["utc"] = b.bhdr.utc;
-		jblk["bytes"] = b.bhdr.totlen;
-		jblk["hash"] = Catena::hashOString(b.bhdr.hash);
-		jblk["prev"] = Catena::hashOString(b.bhdr.prev);
-		nlohmann::json(b.bhdr.totlen);
-		jblks.emplace_back(jblk);
+		std::stringstream ss;
+		if(bs->next == bs->range.end()){
+			ss << (bs->html ? "\n]" : "]") << bs->trailer;
+			bs->done = true;
+		}else{
+			if(bs->next != bs->range.begin()){
+				ss << ",";
+			}
+			try{
+				auto jblk = HTTPDServer::BlockJSON(*bs->next);
+				if(bs->html){
+					ss << "\n";
+					HTMLEscape(ss, jblk.dump(1));
+				}else{
+					ss << jblk.dump();
+				}
+			}catch(const std::exception& e){
+				std::cerr << "error inspecting block (" << e.what() << ")" << std::endl;
+				return MHD_CONTENT_READER_END_WITH_ERROR;
+			}
+			++bs->next; // releases the block
+		}
+		bs->pending = ss.str();
+		bs->taken = 0;
 	}
-	nlohmann::json ret(jblks);
-	return ret;
+	auto len = std::min(max, bs->pending.size() - bs->taken);
+	memcpy(buf, bs->pending.data() + bs->taken, len);
+	bs->taken += len;
+	return len;
+}
+
+void BlockStreamFree(void* cls){
+	delete static_cast<BlockStream*>(cls);
+}
+
+}
+
+struct MHD_Response*
+HTTPDServer::StreamBlocks(int start, int end, bool html) const {
+	auto bs = new BlockStream(chain.InspectRange(start, end), html);
+	if(html){
+		std::stringstream ss;
+		HTMLHeader(ss);
+		ss << "<pre>[";
+		bs->pending = ss.str();
+		bs->trailer = "</pre></body>";
+	}else{
+		bs->pending = "[";
+	}
+	auto resp = MHD_create_response_from_callback(MHD_SIZE_UNKNOWN, 64 * 1024,
+				BlockStreamRead, bs, BlockStreamFree);
+	if(resp == nullptr){
+		delete bs;
+		return nullptr;
+	}
+	const char* ctype = html ? "text/html; charset=UTF-8" : "application/json";
+	if(MHD_NO == MHD_add_response_header(resp, MHD_HTTP_HEADER_CONTENT_TYPE, ctype)){
+		MHD_destroy_response(resp); // frees bs
+		return nullptr;
+	}
+	return resp;
 }
 
 // FIXME basically duplicates ReadlineUI::DumpTransactions
@@ -404,7 +515,7 @@ HTTPDServer::UstatusHTML(struct MHD_Connection* conn) const {
 	try{
 		auto uspec = Catena::TXSpec::StrToTXSpec(uspecstr);
 		auto stype = Catena::StrToLong(stypestr, 0, LONG_MAX);
-		auto json = chain.UserStatus(uspec, stype).dump();
+		auto json = chain.UserStatusJSON(uspec, stype);
 		std::stringstream ss;
     HTMLHeader(ss);
 		ss << "<h3>User " << uspecstr << "</h3>";
@@ -443,7 +554,7 @@ HTTPDServer::UstatusJSON(struct MHD_Connection* conn) const {
 	try{
 		auto uspec = Catena::TXSpec::StrToTXSpec(uspecstr);
 		auto stype = Catena::StrToLong(stypestr, 0, LONG_MAX);
-		auto json = chain.UserStatus(uspec, stype).dump();
+		auto json = chain.UserStatusJSON(uspec, stype);
 		resp = MHD_create_response_from_buffer(json.size(), const_cast<char*>(json.c_str()), MHD_RESPMEM_MUST_COPY);
 	}catch(Catena::InvalidTXSpecException& e){
 		std::cerr << "bad txspec (" << e.what() << ")" << std::endl;
@@ -465,24 +576,57 @@ struct MHD_Response*
 HTTPDServer::Inspect(struct MHD_Connection* conn) const {
 	auto sstart = MHD_lookup_connection_value(conn, MHD_GET_ARGUMENT_KIND, "begin");
 	auto sstop = MHD_lookup_connection_value(conn, MHD_GET_ARGUMENT_KIND, "end");
-	long start = 0;
-	if(sstart){
-		char* e = const_cast<char*>(sstart);
-		start = strtol(sstart, &e, 10);
-		if(start < 0 || start == LONG_MAX || *e){
-			return nullptr; // FIXME return 400 with explanation
+	auto ssince = MHD_lookup_connection_value(conn, MHD_GET_ARGUMENT_KIND, "since");
+	int start = 0;
+	if(ssince){ // blocks timestamped at or after since (UTC seconds)
+		if(sstart){
+			throw BadRequest("since and begin are mutually exclusive");
 		}
+		start = chain.FirstBlockSince(QueryLong("since", ssince, 0, LONG_MAX));
+	}else if(sstart){
+		start = QueryLong("begin", sstart, 0, INT_MAX);
 	}
-	long end = -1;
+	int end = -1;
 	if(sstop){
-		char* e = const_cast<char*>(sstart);
-		end = strtol(sstop, &e, 10);
-		if(end < -1 || end == LONG_MAX || *e){ // allow explicit -1
-			return nullptr;
+		end = QueryLong("end", sstop, -1, INT_MAX); // allow explicit -1
+	}
+	return StreamBlocks(start, end, false);
+}
+
+// A single transaction, named by either TXSpec (spec) or the hash of its
+// serialized form (hash)
+struct MHD_Response*
+HTTPDServer::InspectTX(struct MHD_Connection* conn) const {
+	auto specstr = MHD_lookup_connection_value(conn, MHD_GET_ARGUMENT_KIND, "spec");
+	auto hashstr = MHD_lookup_connection_value(conn, MHD_GET_ARGUMENT_KIND, "hash");
+	if((specstr == nullptr) == (hashstr == nullptr)){
+		std::cerr << "need exactly one of spec and hash in /tx" << std::endl;
+		return nullptr;
+	}
+	MHD_Response* resp = nullptr;
+	try{
+		Catena::TXSpec spec;
+		if(specstr){
+			spec = Catena::TXSpec::StrToTXSpec(specstr);
+		}else{
+			spec = chain.TXSpecByHash(Catena::StrToCatenaHash(hashstr));
 		}
+		nlohmann::json jtx;
+		jtx["block"] = Catena::hashOString(spec.first);
+		jtx["index"] = spec.second;
+		jtx["transaction"] = chain.InspectTX(spec)->JSONify();
+		auto res = jtx.dump();
+		resp = MHD_create_response_from_buffer(res.size(), const_cast<char*>(res.c_str()), MHD_RESPMEM_MUST_COPY);
+	}catch(Catena::InvalidTXSpecException& e){
+		std::cerr << "bad txspec (" << e.what() << ")" << std::endl;
+		return nullptr;
+	}catch(Catena::ConvertInputException& e){
+		std::cerr << "bad argument (" << e.what() << ")" << std::endl;
+		return nullptr;
+	}catch(Catena::TransactionException& e){
+		std::cerr << "couldn't lex transaction (" << e.what() << ")" << std::endl;
+		return nullptr;
 	}
-	auto res = InspectJSON(start, end).dump();
-	auto resp = MHD_create_response_from_buffer(res.size(), const_cast<char*>(res.c_str()), MHD_RESPMEM_MUST_COPY);
 	if(resp){
 		if(MHD_NO == MHD_add_response_header(resp, MHD_HTTP_HEADER_CONTENT_TYPE, "application/json")){
 			MHD_destroy_response(resp);
@@ -981,6 +1125,7 @@ int HTTPDServer::Handler(void* cls, struct MHD_Connection* conn, const char* url
 		{ "/show", &HTTPDServer::Show, },
 		{ "/tstore", &HTTPDServer::TStore, },
 		{ "/inspect", &HTTPDServer::Inspect, },
+		{ "/tx", &HTTPDServer::InspectTX, },
 		{ "/ustatus", &HTTPDServer::UstatusJSON, },
 		{ "/showustatus", &HTTPDServer::UstatusHTML, },
 		{ "/showmember", &HTTPDServer::ShowMemberHTML, },
@@ -990,7 +1135,18 @@ int HTTPDServer::Handler(void* cls, struct MHD_Connection* conn, const char* url
 	struct MHD_Response* resp = nullptr;
 	for(cmd = cmds ; cmd->uri ; ++cmd){
 		if(strcmp(cmd->uri, url) == 0){
-			resp = (*reinterpret_cast<HTTPDServer*>(cls).*(cmd->fxn))(conn);
+			try{
+				resp = (*reinterpret_cast<HTTPDServer*>(cls).*(cmd->fxn))(conn);
+			}catch(const BadRequest& e){
+				std::string why = std::string(e.what()) + "\n";
+				std::cerr << "bad request for " << url << ", returning 400: " << why;
+				resp = MHD_create_response_from_buffer(why.size(), const_cast<char*>(why.c_str()), MHD_RESPMEM_MUST_COPY);
+				if(resp && MHD_NO == MHD_add_response_header(resp, MHD_HTTP_HEADER_CONTENT_TYPE, "text/plain")){
+					MHD_destroy_response(resp);
+					resp = nullptr;
+				}
+				retcode = MHD_HTTP_BAD_REQUEST;
+			}
 			break;
 		}
 	}
@@ -21,11 +21,17 @@ HTTPDServer(const HTTPDServer&) = delete;
 HTTPDServer& operator=(HTTPDServer const&) = delete;
 virtual ~HTTPDServer();
 
+// The JSON form of a block, as served by /inspect and /show
+static nlohmann::json BlockJSON(const Catena::BlockDetail& b);
+
 private:
 MHD_Daemon* mhd; // has no free function
 Catena::Chain& chain;
 
-nlohmann::json InspectJSON(int start, int end) const;
+// A chunked response of the blocks [start, end] as a JSON array, generated a
+// block at a time. If html is set, the JSON is escaped, pretty-printed, and
+// wrapped in a page.
+struct MHD_Response* StreamBlocks(int start, int end, bool html) const;
 
 std::ostream& HTMLHeader(std::ostream& ss) const;
 std::ostream& HTMLSysinfo(std::ostream& ss) const;
@@ -45,6 +51,7 @@ struct MHD_Response* Favicon(struct MHD_Connection*) const;
 struct MHD_Response* Show(struct MHD_Connection*) const;
 struct MHD_Response* TStore(struct MHD_Connection*) const;
 struct MHD_Response* Inspect(struct MHD_Connection*) const;
+struct MHD_Response* InspectTX(struct MHD_Connection*) const;
 struct MHD_Response* UstatusHTML(struct MHD_Connection* conn) const;
 struct MHD_Response* UstatusJSON(struct MHD_Connection* conn) const;
 struct MHD_Response* ShowMemberHTML(struct MHD_Connection* conn) const;
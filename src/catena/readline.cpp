@@ -114,17 +114,32 @@ int ReadlineUI::Summary(const Iterator start, const Iterator end){
 	std::cout << "crypto: " << SSLeay_version(SSLEAY_VERSION) << "\n";
   std::cout << "capnp: " << Catena::GetCapnProtoID();
 	std::cout << "\n";
-	std::cout << "chain bytes: " << chain.Size() << "\n";
-	std::cout << "blocks: " << chain.GetBlockCount() << "\n";
-	std::cout << "transactions: " << chain.TXCount() << "\n";
+	auto lstats = chain.Stats();
+	std::cout << "chain bytes: " << lstats.bytes << "\n";
+	std::cout << "blocks: " << lstats.blocks << "\n";
+	std::cout << "transactions: " << lstats.transactions << "\n";
+	for(unsigned t = 0 ; t < lstats.txtypes.size() ; ++t){
+		if(lstats.txtypes[t]){
+			std::cout << " " << Catena::TXTypeName(t) << ": " << lstats.txtypes[t] << "\n";
+		}
+	}
 	std::cout << "outstanding TXs: " << chain.OutstandingTXCount() << "\n";
-	std::cout << "consortium members: " << chain.ConsortiumMemberCount() << "\n";
-	std::cout << "lookup requests: " << chain.LookupRequestCount() << "\n";
-	std::cout << "lookup authorizations: " << chain.LookupRequestCount(true) << "\n";
-	std::cout << "external IDs: " << chain.ExternalLookupCount() << "\n";
-	std::cout << "public keys: " << chain.PubkeyCount() << "\n";
-	std::cout << "users: " << chain.UserCount() << "\n";
-	std::cout << "status delegations: " << chain.StatusDelegationCount() << "\n";
+	std::cout << "consortium members: " << lstats.members << "\n";
+	std::cout << "lookup requests: " << lstats.lookupreqs << "\n";
+	std::cout << "lookup authorizations: " << lstats.authorizedlookups << "\n";
+	std::cout << "external IDs: " << lstats.extlookups << "\n";
+	std::cout << "public keys: " << lstats.pubkeys << "\n";
+	std::cout << "users: " << lstats.users << "\n";
+	std::cout << "status delegations: " << lstats.delegations << "\n";
+	auto cstats = chain.CacheStats();
+	std::cout << "block cache: " << cstats.entries << " blocks, " << cstats.bytes
+		<< "/" << cstats.budget << " bytes, " << cstats.hits << " hits, "
+		<< cstats.misses << " misses\n";
+	auto gstats = chain.CommitStats();
+	std::cout << "commits: " << gstats.commits << " blocks, " << gstats.bytes
+		<< " bytes, " << gstats.syncs << " syncs, "
+		<< (gstats.commits ? gstats.total_us / gstats.commits : 0) << "/"
+		<< gstats.max_us << "us mean/max latency\n";
 	std::cout << "\n";
 	auto port = chain.RPCPort();
 	if(port){
@@ -189,12 +204,12 @@ int ReadlineUI::Inspect(const Iterator start, const Iterator end){
 			return -1;
 		}
 	}
-	auto det = chain.Inspect(b1, b2);
-	for(auto it = det.begin() ; it != det.end() ; ++it){
-		std::cout << *it;
-		if(std::next(it) != det.end()){
+	auto range = chain.InspectRange(b1, b2);
+	for(auto it = range.begin() ; it != range.end() ; ++it){
+		if(it != range.begin()){
 			std::cout << "\n";
 		}
+		std::cout << *it;
 	}
 	std::cout << std::flush;
 	return 0;
@@ -427,8 +442,7 @@ int ReadlineUI::GetUserStatus(const Iterator start, const Iterator end){
 	try{
 		auto uspec = Catena::TXSpec::StrToTXSpec(start[0]);
 		auto stype = Catena::StrToLong(start[1], 0, LONG_MAX);
-		auto json = chain.UserStatus(uspec, stype);
-		std::cout << json.dump() << "\n";
+		std::cout << chain.UserStatusJSON(uspec, stype) << "\n";
 		return 0;
 	}catch(Catena::UserStatusException& e){
 		std::cerr << "couldn't get status (" << e.what() << ")" << std::endl;
@@ -0,0 +1,168 @@
+#include <zlib.h>
+#include <cstring>
+#include <fstream>
+#include <algorithm>
+#include <libcatena/exceptions.h>
+#include <libcatena/archive.h>
+#include <libcatena/utility.h>
+#include <libcatena/workers.h>
+#include <libcatena/hash.h>
+#include <libcatena/wire.h>
+
+namespace Catena {
+
+// Archive format (all integers big-endian):
+//  8-byte magic, 4-byte version, 8-byte segment length, 4-byte chunk count
+//  per chunk: 4-byte inflated length, 4-byte compressed length
+//  32-byte hash of everything preceding
+//  compressed chunks, in order
+// Chunk offsets, both inflated and compressed, are implied by the order.
+namespace {
+const unsigned char ARCHIVEMAGIC[8] = { 'C', 'A', 'T', 'E', 'N', 'A', 'A', 'R', };
+constexpr unsigned ARCHIVEVERSION = 0;
+constexpr size_t ARCHIVEHDRLEN = sizeof(ARCHIVEMAGIC) + 4 + 8 + 4;
+constexpr size_t ARCHIVERECLEN = 4 + 4;
+// Segments are archived as the ledger grows; zlib's best compression costs
+// several times the CPU of its default for a few percent
+constexpr int ARCHIVELEVEL = Z_DEFAULT_COMPRESSION;
+}
+
+SegmentArchive::SegmentArchive(const std::string& fname) :
+  map(std::make_shared<MappedFile>(fname)) {
+	const unsigned char* data = map->Data();
+	size_t flen = map->Size();
+	if(flen < ARCHIVEHDRLEN + HASHLEN || memcmp(data, ARCHIVEMAGIC, sizeof(ARCHIVEMAGIC))){
+		throw BlockValidationException("not a ledger archive: " + fname);
+	}
+	WireReader<BlockValidationException> r(data + sizeof(ARCHIVEMAGIC), flen - sizeof(ARCHIVEMAGIC));
+	if(r.Int<4>() != ARCHIVEVERSION){
+		throw BlockValidationException("unknown archive version: " + fname);
+	}
+	len = r.Int<8>();
+	size_t count = r.Int<4>();
+	size_t tablelen = ARCHIVEHDRLEN + count * ARCHIVERECLEN;
+	if(flen < tablelen + HASHLEN){
+		throw BlockValidationException("truncated archive: " + fname);
+	}
+	CatenaHash check;
+	catenaHash(data, tablelen, check);
+	if(memcmp(check.data(), data + tablelen, HASHLEN)){
+		throw BlockValidationException("corrupt archive table: " + fname);
+	}
+	size_t base = 0;
+	size_t fileoff = tablelen + HASHLEN;
+	chunks.reserve(count);
+	for(size_t i = 0 ; i < count ; ++i){
+		ChunkEntry ce;
+		ce.base = base;
+		ce.len = r.Int<4>();
+		ce.fileoff = fileoff;
+		ce.zlen = r.Int<4>();
+		if(ce.len == 0 || fileoff + ce.zlen > flen){
+			throw BlockValidationException("bad archive chunk: " + fname);
+		}
+		base += ce.len;
+		fileoff += ce.zlen;
+		chunks.push_back(ce);
+	}
+	if(base != len || fileoff != flen){
+		throw BlockValidationException("inconsistent archive: " + fname);
+	}
+}
+
+void SegmentArchive::Write(const std::string& fname, const unsigned char* data,
+			size_t len, const std::vector<size_t>& blocks, size_t chunksize,
+			unsigned workers){
+	// chunk boundaries, each at a block boundary
+	std::vector<size_t> bounds{0};
+	for(size_t i = 0 ; i < blocks.size() ; ++i){
+		auto end = i + 1 < blocks.size() ? blocks[i + 1] : len;
+		if(blocks[i] > bounds.back() && end - bounds.back() > chunksize){
+			bounds.push_back(blocks[i]);
+		}
+	}
+	if(len){
+		bounds.push_back(len);
+	}
+	auto count = bounds.size() - 1;
+	std::vector<std::vector<unsigned char>> zchunks(count);
+	std::vector<char> failed(count, 0);
+	ParallelFor(workers, count, [&](size_t c){
+		auto clen = bounds[c + 1] - bounds[c];
+		uLongf zlen = compressBound(clen);
+		zchunks[c].resize(zlen);
+		if(compress2(zchunks[c].data(), &zlen, data + bounds[c], clen, ARCHIVELEVEL) != Z_OK){
+			failed[c] = 1;
+		}
+		zchunks[c].resize(zlen);
+	});
+	if(std::find(failed.begin(), failed.end(), 1) != failed.end()){
+		throw std::ofstream::failure("couldn't compress " + fname);
+	}
+	std::vector<unsigned char> buf(ARCHIVEHDRLEN + (bounds.size() - 1) * ARCHIVERECLEN + HASHLEN);
+	WireWriter w(buf.data(), buf.size());
+	w.Bytes(ARCHIVEMAGIC, sizeof(ARCHIVEMAGIC));
+	w.Int<4>(ARCHIVEVERSION);
+	w.Int<8>(len);
+	w.Int<4>(count);
+	for(size_t c = 0 ; c < count ; ++c){
+		w.Int<4>(bounds[c + 1] - bounds[c]);
+		w.Int<4>(zchunks[c].size());
+	}
+	CatenaHash digest;
+	catenaHash(buf.data(), buf.size() - HASHLEN, digest);
+	w.Hash(digest);
+	for(const auto& z : zchunks){
+		buf.insert(buf.end(), z.begin(), z.end());
+	}
+	ReplaceBinaryFile(fname, buf.data(), buf.size(), true);
+}
+
+void SegmentArchive::Inflate(const ChunkEntry& ce, unsigned char* targ) const {
+	uLongf outlen = ce.len;
+	if(uncompress(targ, &outlen, map->Data() + ce.fileoff, ce.zlen) != Z_OK ||
+			outlen != ce.len){
+		throw BlockValidationException("corrupt archive chunk");
+	}
+}
+
+std::shared_ptr<const unsigned char>
+SegmentArchive::Bytes(size_t off, size_t blen) const {
+	auto ce = std::upper_bound(chunks.begin(), chunks.end(), off,
+			[](size_t o, const ChunkEntry& c){
+				return o < c.base;
+			});
+	if(ce == chunks.begin()){
+		throw BlockValidationException("offset beyond archive");
+	}
+	--ce;
+	if(off + blen > ce->base + ce->len){
+		throw BlockValidationException("bytes span archive chunks");
+	}
+	std::shared_ptr<unsigned char> chunk(new unsigned char[ce->len],
+					std::default_delete<unsigned char[]>());
+	Inflate(*ce, chunk.get());
+	// aliases the chunk, sharing its ownership
+	return std::shared_ptr<const unsigned char>(chunk, chunk.get() + off - ce->base);
+}
+
+std::shared_ptr<const unsigned char> SegmentArchive::Expand(unsigned workers) const {
+	std::shared_ptr<unsigned char> ret(new unsigned char[len ? len : 1],
+					std::default_delete<unsigned char[]>());
+	std::vector<std::exception_ptr> errs(chunks.size());
+	ParallelFor(workers, chunks.size(), [&](size_t c){
+		try{
+			Inflate(chunks[c], ret.get() + chunks[c].base);
+		}catch(...){
+			errs[c] = std::current_exception();
+		}
+	});
+	for(const auto& e : errs){
+		if(e){
+			std::rethrow_exception(e);
+		}
+	}
+	return ret;
+}
+
+}
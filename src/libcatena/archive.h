@@ -0,0 +1,68 @@
+#ifndef CATENA_LIBCATENA_ARCHIVE
+#define CATENA_LIBCATENA_ARCHIVE
+
+#include <memory>
+#include <string>
+#include <vector>
+#include <libcatena/mmap.h>
+
+namespace Catena {
+
+// A sealed ledger segment, compressed as a series of independently-inflatable
+// chunks, each holding one or more whole blocks. A table of chunks precedes
+// them, so any block can be reached by inflating a single chunk. Chunks are
+// zlib streams, and thus carry their own checksums.
+class SegmentArchive {
+public:
+SegmentArchive() = delete;
+SegmentArchive(const SegmentArchive&) = delete;
+SegmentArchive& operator=(const SegmentArchive&) = delete;
+
+// Map and check the structure of an archive. Throws std::ifstream::failure on
+// I/O error, and BlockValidationException if it's not a valid archive.
+SegmentArchive(const std::string& fname);
+
+// Compress a segment of len bytes, whose blocks begin at the (ascending)
+// offsets blocks, to fname. Blocks are packed into chunks of at most
+// chunksize bytes (save blocks which are themselves larger), and compressed
+// across workers threads. Throws std::ofstream::failure on error.
+static void Write(const std::string& fname, const unsigned char* data,
+		size_t len, const std::vector<size_t>& blocks, size_t chunksize,
+		unsigned workers);
+
+// Length of the uncompressed segment
+size_t Size() const {
+	return len;
+}
+
+// Length of the archive file
+size_t CompressedSize() const {
+	return map->Size();
+}
+
+// A view of the len bytes at segment offset off, which must lie within a
+// single chunk, made by inflating that chunk. Throws BlockValidationException
+// if they don't, or if the chunk is corrupt.
+std::shared_ptr<const unsigned char> Bytes(size_t off, size_t len) const;
+
+// Inflate the entire segment, spreading chunks across workers threads
+std::shared_ptr<const unsigned char> Expand(unsigned workers) const;
+
+private:
+struct ChunkEntry {
+	size_t base; // segment offset of the chunk's first byte
+	size_t len; // inflated length
+	size_t fileoff; // offset of the compressed chunk in the archive
+	size_t zlen; // compressed length
+};
+
+std::shared_ptr<MappedFile> map;
+size_t len;
+std::vector<ChunkEntry> chunks;
+
+void Inflate(const ChunkEntry& ce, unsigned char* targ) const;
+};
+
+}
+
+#endif
@@ -1,33 +1,63 @@
 #include <memory>
+#include <chrono>
+#include <cerrno>
 #include <cstring>
+#include <fcntl.h>
+#include <dirent.h>
+#include <map>
+#include <iomanip>
+#include <sstream>
+#include <unistd.h>
 #include <iostream>
+#include <algorithm>
+#include <sys/stat.h>
+#include <iterator>
+#include <exception>
 #include <libcatena/utility.h>
+#include <libcatena/workers.h>
 #include <libcatena/chain.h>
 #include <libcatena/block.h>
 #include <libcatena/hash.h>
+#include <libcatena/txvalue.h>
+#include <libcatena/wire.h>
 #include <libcatena/tx.h>
 
 namespace Catena {
 
 const int Block::BLOCKVERSION;
 const int Block::BLOCKHEADERLEN;
+constexpr unsigned Blocks::SEGMENTDIGITS;
+constexpr char Blocks::SEGMENTSUFFIX[];
+constexpr char Blocks::ARCHIVESUFFIX[];
+constexpr char Blocks::INDEXSUFFIX[];
 
-bool Block::ExtractBody(const BlockHeader* chdr, const unsigned char* data,
-			unsigned len, LedgerMap* lmap, TrustStore* tstore){
+// Transactions lexed ahead of validation during replay. Large enough to keep
+// the workers busy, small enough that we needn't lex all of a large ledger.
+constexpr size_t REPLAYWINDOW = 4096;
+
+// Rough heap cost of a lexed transaction object, less the bytes it views
+constexpr size_t TXOBJECTCOST = 256;
+
+namespace {
+
+// Walk a block body's offset table, calling fn(data, len, idx) for each
+// transaction. Returns true if the table is malformed.
+template<typename F>
+bool ForEachTX(const BlockHeader* chdr, const unsigned char* data, unsigned len, F&& fn){
 	if(len / 4 < chdr->txcount){
 		std::cerr << "no room for " << chdr->txcount << "-offset table in " << len << " bytes" << std::endl;
 		return true;
 	}
-  std::vector<uint32_t> offsets;
-  offsets.reserve(chdr->txcount);
+	std::vector<uint32_t> offsets;
+	offsets.reserve(chdr->txcount);
 	for(unsigned i = 0 ; i < chdr->txcount ; ++i){
-		uint32_t offset = nbo_to_ulong(data, sizeof(offset));
+		uint32_t offset = LoadNBO<sizeof(offset)>(data);
 		data += sizeof(offset);
 		if(offset >= len){
 			std::cerr << "no room for offset " << offset << std::endl;
 			return true;
 		}
-    offsets.push_back(offset);
+		offsets.push_back(offset);
 	}
 	len -= chdr->txcount * 4;
 	for(unsigned i = 0 ; i < chdr->txcount ; ++i){
@@ -38,7 +68,22 @@ bool Block::ExtractBody(const BlockHeader* chdr, const unsigned char* data,
 		}else{
 			txlen = len;
 		}
-		std::unique_ptr<Transaction> tx(Transaction::LexTX(data, txlen, chdr->hash, i));
+		if(fn(data, txlen, i)){
+			return true;
+		}
+		data += txlen;
+		len -= txlen;
+	}
+	return false;
+}
+
+}
+
+bool Block::ExtractBody(const BlockHeader* chdr, const unsigned char* data,
+			unsigned len, LedgerMap* lmap, TrustStore* tstore,
+			std::shared_ptr<const void> keep){
+	return ForEachTX(chdr, data, len, [&](const unsigned char* txdata, unsigned txlen, unsigned i){
+		std::unique_ptr<Transaction> tx(Transaction::LexTX(txdata, txlen, chdr->hash, i, keep));
 		if(tx == nullptr){
 			return true;
 		}
@@ -48,105 +93,348 @@ bool Block::ExtractBody(const BlockHeader* chdr, const unsigned char* data,
 			}
 		}
 		transactions.push_back(std::move(tx));
-		data += txlen;
-		len -= txlen;
-	}
-	return false;
+		return false;
+	});
+}
+
+bool Block::LexBody(const BlockHeader* chdr, const unsigned char* data,
+			unsigned len, std::vector<TXValue>& txs){
+	return ForEachTX(chdr, data, len, [&](const unsigned char* txdata, unsigned txlen, unsigned i){
+		LexTXValue(txs, txdata, txlen, chdr->hash, i);
+		return false;
+	});
 }
 
 void Block::ExtractHeader(BlockHeader* chdr, const unsigned char* data,
 		unsigned len, const CatenaHash& prevhash, uint64_t prevutc){
-	if(len < Block::BLOCKHEADERLEN){
-		throw BlockHeaderException("block was too short");
-	}
-	memcpy(chdr->hash.data(), data, chdr->hash.size());
-	data += chdr->hash.size();
-	unsigned const char* hashstart = data;
-	memcpy(chdr->prev.data(), data, chdr->prev.size());
+	LexHeader(chdr, data, len, prevhash, prevutc);
+	VerifyHash(chdr, data);
+}
+
+void Block::LexHeader(BlockHeader* chdr, const unsigned char* data,
+		size_t len, const CatenaHash& prevhash, uint64_t prevutc){
+	WireReader<BlockHeaderException> r(data, len);
+	r.Need(Block::BLOCKHEADERLEN, "block was too short");
+	chdr->hash = r.Hash();
+	chdr->prev = r.Hash();
 	if(chdr->prev != prevhash){
 		throw BlockHeaderException("invalid prev hash");
 	}
-	data += chdr->prev.size();
-	chdr->version = nbo_to_ulong(data, 2);
-	data += 2; // 16-bit version field
+	chdr->version = r.Int<2>();
 	if(chdr->version != Block::BLOCKVERSION){
 		throw BlockHeaderException("invalid version");
 	}
-	chdr->totlen = nbo_to_ulong(data, 3);
-	data += 3; // 24-bit totlen field
+	chdr->totlen = r.Int<3>();
 	if(chdr->totlen < Block::BLOCKHEADERLEN || chdr->totlen > len){
 		throw BlockHeaderException("invalid advertised length");
 	}
-	chdr->txcount = nbo_to_ulong(data, 3);
-	data += 3; // 24-bit txcount field
-	chdr->utc = nbo_to_ulong(data, 5);
-	data += 5; // 40-bit UTC field
+	chdr->txcount = r.Int<3>();
+	chdr->utc = r.Int<5>(); // 40-bit UTC field
 	// FIXME reject 0 UTC?
 	if(chdr->utc < prevutc){ // allow non-strictly-increasing timestamps?
 		throw BlockHeaderException("utc timestamp was earlier than prior");
 	}
-	for(int i = 0 ; i < 19 ; ++i){ // 19 reserved bytes
-		if(*data){ // FIXME make this a warning?
+	auto reserved = r.Bytes(19); // 19 reserved bytes
+	for(int i = 0 ; i < 19 ; ++i){
+		if(reserved[i]){ // FIXME make this a warning?
 			throw BlockHeaderException("non-zero reserved byte");
 		}
-		++data;
 	}
+}
+
+// data is the start of the block, including the hash being verified
+void Block::VerifyHash(const BlockHeader* chdr, const unsigned char* data){
 	CatenaHash hash;
-	catenaHash(hashstart, chdr->totlen - HASHLEN, hash);
+	catenaHash(data + HASHLEN, chdr->totlen - HASHLEN, hash);
 	if(hash != chdr->hash){
 		throw BlockHeaderException("incorrect block hash");
 	}
 }
 
+namespace {
+
+// Headers lexed from one contiguous region of serialized blocks
+struct LexedRegion {
+	std::vector<BlockHeader> headers;
+	std::vector<size_t> offsets; // relative to the start of the region
+	std::exception_ptr err; // first failure, if any (lexing stops there)
+};
+
+// Begins journaling lmap and tstore, rolling both back when destroyed unless
+// Commit() has been called
+class StateTransaction {
+public:
+StateTransaction(LedgerMap& lmap, TrustStore& tstore) :
+  lmap(lmap),
+  tstore(tstore),
+  committed(false) {
+	lmap.Begin();
+	tstore.Begin();
+}
+
+~StateTransaction() {
+	if(!committed){
+		lmap.Rollback();
+		tstore.Rollback();
+	}
+}
+
+void Commit() {
+	lmap.Commit();
+	tstore.Commit();
+	committed = true;
+}
+
+private:
+LedgerMap& lmap;
+TrustStore& tstore;
+bool committed;
+};
+
+void LexRegion(const unsigned char* data, size_t len, CatenaHash prevhash,
+		uint64_t prevutc, LexedRegion& lr){
+	size_t off = 0;
+	try{
+		while(off < len){
+			BlockHeader chdr;
+			Block::LexHeader(&chdr, data + off, len - off, prevhash, prevutc);
+			prevhash = chdr.hash;
+			prevutc = chdr.utc;
+			lr.offsets.push_back(off);
+			lr.headers.push_back(chdr);
+			off += chdr.totlen;
+		}
+	}catch(const BlockHeaderException&){
+		lr.err = std::current_exception();
+	}
+}
+
+}
+
+namespace {
+
+// Follow a verified block's offset table to its transactions, given the
+// block's ledger offset off. There's always one entry per transaction; should
+// the table be inconsistent (possible only in blocks which were never
+// replayed), the remainder are left zeroed.
+void LocateTXs(const BlockHeader& hdr, size_t off, const unsigned char* data,
+		std::vector<TXLocation>& locs){
+	locs.assign(hdr.txcount, TXLocation{0, 0, 0});
+	const unsigned char* table = data + Block::BLOCKHEADERLEN;
+	size_t pos = Block::BLOCKHEADERLEN + hdr.txcount * 4ul;
+	for(unsigned i = 0 ; i < hdr.txcount && pos <= hdr.totlen ; ++i){
+		size_t txlen = hdr.totlen - pos;
+		if(i + 1 < hdr.txcount){
+			auto cur = LoadNBO<4>(table + i * 4);
+			auto next = LoadNBO<4>(table + (i + 1) * 4);
+			if(next < cur || next - cur > txlen){
+				return;
+			}
+			txlen = next - cur;
+		}
+		uint16_t type = txlen >= 2 ? LoadNBO<2>(data + pos) : 0;
+		if(type >= TXTYPELIMIT){
+			type = 0;
+		}
+		locs[i] = TXLocation{off + pos, static_cast<unsigned>(txlen), type};
+		pos += txlen;
+	}
+}
+
+}
+
+// Bodies are lexed a window at a time, and each window's transactions are
+// validated as a batch. A lexing failure is held back until everything lexed
+// ahead of it has been validated.
+bool Blocks::ReplayBodies(const std::vector<BlockHeader>& hdrs,
+			const std::vector<const unsigned char*>& data, size_t first,
+			size_t last, LedgerMap& lmap, TrustStore& tstore) const {
+	auto workers = Workers();
+	size_t replayed = first;
+	while(replayed < last){
+		std::vector<TXValue> txs;
+		std::exception_ptr bodyerr;
+		bool bodyfail = false;
+		while(replayed < last && txs.size() < REPLAYWINDOW && !(bodyfail || bodyerr)){
+			const auto& chdr = hdrs[replayed];
+			try{
+				bodyfail = Block::LexBody(&chdr, data[replayed] + Block::BLOCKHEADERLEN,
+						chdr.totlen - Block::BLOCKHEADERLEN, txs);
+			}catch(...){
+				bodyerr = std::current_exception();
+			}
+			++replayed;
+		}
+		if(Transaction::ValidateBatch(txs, tstore, lmap, workers) || bodyfail){
+			return true;
+		}
+		if(bodyerr){
+			std::rethrow_exception(bodyerr);
+		}
+	}
+	return false;
+}
+
 // Verify new blocks relative to the loaded blocks (i.e., do not replay already-
-// verified blocks). If any block fails verification, the Blocks structure is
-// unchanged, and -1 is returned.
-int Blocks::VerifyData(const unsigned char *data, unsigned len, LedgerMap& lmap,
-			TrustStore& tstore){
-	unsigned offset = 0;
+// verified blocks). If any block fails verification, the Blocks structure,
+// lmap, and tstore are unchanged, and -1 is returned.
+//
+// Each region is lexed (headers only) independently and in parallel, and the
+// regions are then stitched together by checking the links at their
+// boundaries. All block hashes are then verified in parallel. Only then are
+// the bodies lexed and replayed in order. Errors are reported as they would be
+// were each block handled in its entirety before moving on to the next: blocks
+// preceding the first header failure are replayed before that failure is
+// thrown.
+int Blocks::VerifyData(const std::vector<std::pair<const unsigned char*, size_t>>& regions,
+			LedgerMap& lmap, TrustStore& tstore, const LedgerAnchor* anchor){
+	size_t offset = Size();
 	uint64_t prevutc = 0;
 	auto origblockcount = GetBlockCount();
 	int blocknum = origblockcount;
 	if(blocknum){
 		prevutc = GetLastUTC();
-		offset = offsets.back() + headers.back().totlen;
 	}
-	std::vector<unsigned> new_offsets;
-	std::vector<BlockHeader> new_headers;
 	CatenaHash prevhash;
 	GetLastHash(prevhash);
-	TrustStore new_tstore = tstore; // FIXME expensive copies here :(
-	auto new_lmap = lmap;
-	while(len){
-		Block block;
-		BlockHeader chdr;
-		chdr.txidx = blocknum;
-		Block::ExtractHeader(&chdr, data, len, prevhash, prevutc);
-		data += Block::BLOCKHEADERLEN;
-		prevhash = chdr.hash;
-		prevutc = chdr.utc;
-		if(block.ExtractBody(&chdr, data, chdr.totlen - Block::BLOCKHEADERLEN,
-					&new_lmap, &new_tstore)){
-			return -1;
-		}
-		data += chdr.totlen - Block::BLOCKHEADERLEN;
-		len -= chdr.totlen;
-		new_offsets.push_back(offset);
-		new_headers.push_back(chdr);
-		offset += chdr.totlen;
-		++blocknum;
-	}
-	headers.insert(headers.end(), new_headers.begin(), new_headers.end());
-	offsets.insert(offsets.end(), new_offsets.begin(), new_offsets.end());
-	tstore = new_tstore; // FIXME another set of expensive copies (swap? move?)
-	lmap = new_lmap;
+	auto workers = Workers();
+	std::vector<LexedRegion> lexed(regions.size());
+	ParallelFor(workers, regions.size(), [&](size_t r){
+		const auto& reg = regions[r];
+		if(r == 0){
+			LexRegion(reg.first, reg.second, prevhash, prevutc, lexed[r]);
+			return;
+		}
+		// We don't yet know what precedes this region, so accept whatever the
+		// first block claims, and check it when stitching.
+		CatenaHash claimed;
+		if(reg.second >= Block::BLOCKHEADERLEN){
+			memcpy(claimed.data(), reg.first + HASHLEN, claimed.size());
+		}
+		LexRegion(reg.first, reg.second, claimed, 0, lexed[r]);
+	});
+	std::vector<size_t> new_offsets;
+	std::vector<BlockHeader> new_headers;
+	std::vector<const unsigned char*> new_data;
+	std::exception_ptr lexerr;
+	for(size_t r = 0 ; r < regions.size() && !lexerr ; ++r){
+		const auto& lr = lexed[r];
+		if(!lr.headers.empty()){
+			const auto& first = lr.headers.front();
+			if(first.prev != prevhash){
+				lexerr = std::make_exception_ptr(BlockHeaderException("invalid prev hash"));
+				break;
+			}
+			if(first.utc < prevutc){
+				lexerr = std::make_exception_ptr(BlockHeaderException("utc timestamp was earlier than prior"));
+				break;
+			}
+		}
+		for(size_t i = 0 ; i < lr.headers.size() ; ++i){
+			new_headers.push_back(lr.headers[i]);
+			new_headers.back().txidx = blocknum++;
+			new_offsets.push_back(offset + lr.offsets[i]);
+			new_data.push_back(regions[r].first + lr.offsets[i]);
+			prevhash = lr.headers[i].hash;
+			prevutc = lr.headers[i].utc;
+		}
+		offset += regions[r].second;
+		lexerr = lr.err;
+	}
+	// Record the first failure, if any, rather than just any failure
+	std::vector<char> badhash(new_headers.size(), 0);
+	ParallelFor(workers, new_headers.size(), [&](size_t i){
+		try{
+			Block::VerifyHash(&new_headers[i], new_data[i]);
+		}catch(const BlockHeaderException&){
+			badhash[i] = 1;
+		}
+	});
+	auto firstbad = std::find(badhash.begin(), badhash.end(), 1) - badhash.begin();
+	size_t skip = 0; // already reflected in lmap and tstore
+	if(anchor && anchor->height > origblockcount){
+		skip = std::min<size_t>(anchor->height - origblockcount, new_headers.size());
+		// an anchor beyond these blocks is left to the caller
+		if(skip == anchor->height - origblockcount && new_headers[skip - 1].hash != anchor->hash){
+			throw BlockValidationException("ledger doesn't contain anchor block");
+		}
+	}
+	// Transactions are applied in place, and undone should anything fail
+	StateTransaction txn(lmap, tstore);
+	if(ReplayBodies(new_headers, new_data, std::min<size_t>(skip, firstbad),
+				firstbad, lmap, tstore)){
+		return -1;
+	}
+	if(static_cast<size_t>(firstbad) < new_headers.size()){
+		throw BlockHeaderException("incorrect block hash");
+	}
+	if(lexerr){
+		std::rethrow_exception(lexerr);
+	}
+	AdoptBlocks(new_headers, new_offsets, new_data);
+	txn.Commit();
 	return blocknum - origblockcount;
 }
 
-bool Blocks::LoadData(const void* data, unsigned len, LedgerMap& lmap, TrustStore& tstore){
-	offsets.clear();
-	headers.clear();
+// Transactions are located in parallel, and indexed in order. They're not
+// hashed until somebody looks one up by hash (see IndexTXHashes()).
+void Blocks::AdoptBlocks(const std::vector<BlockHeader>& hdrs, const std::vector<size_t>& offs,
+			const std::vector<const unsigned char*>& data){
+	std::vector<std::vector<TXLocation>> locs(hdrs.size());
+	ParallelFor(Workers(), hdrs.size(), [&](size_t i){
+		LocateTXs(hdrs[i], offs[i], data[i], locs[i]);
+	});
+	std::vector<TXLocation> flat;
+	for(const auto& l : locs){
+		flat.insert(flat.end(), l.begin(), l.end());
+	}
+	AdoptLocated(hdrs, offs, flat);
+}
+
+void Blocks::AdoptLocated(const std::vector<BlockHeader>& hdrs, const std::vector<size_t>& offs,
+			const std::vector<TXLocation>& locs){
+	hashidx.reserve(headers.size() + hdrs.size());
+	txlocs.reserve(txlocs.size() + locs.size());
+	auto loc = locs.begin();
+	for(size_t i = 0 ; i < hdrs.size() ; ++i){
+		hashidx.emplace(hdrs[i].hash, hdrs[i].txidx);
+		txbase.push_back(txlocs.size());
+		for(unsigned t = 0 ; t < hdrs[i].txcount ; ++t, ++loc){
+			txlocs.push_back(*loc);
+			++txtypes[loc->type];
+		}
+	}
+	headers.insert(headers.end(), hdrs.begin(), hdrs.end());
+	offsets.insert(offsets.end(), offs.begin(), offs.end());
+}
+
+void Blocks::Clear(){
+	if(tailfd >= 0){
+		close(tailfd);
+		tailfd = -1;
+	}
+	TruncateBlocks(0);
+	cache.Clear();
 	memledger.clear();
+	filename.clear();
+	segmented = false;
+	segments.clear();
+	indexed = 0;
+}
+
+Blocks::~Blocks(){
+	try{
+		SaveIndex();
+	}catch(const std::exception& e){
+		std::cerr << "error writing ledger index (" << e.what() << ")" << std::endl;
+	}
+	if(tailfd >= 0){
+		close(tailfd);
+	}
+}
+
+bool Blocks::LoadData(const void* data, unsigned len, LedgerMap& lmap, TrustStore& tstore){
+	Clear();
 	auto blocknum = VerifyData(static_cast<const unsigned char*>(data),
 					len, lmap, tstore);
 	if(blocknum < 0){
@@ -156,37 +444,551 @@ bool Blocks::LoadData(const void* data, unsigned len, LedgerMap& lmap, TrustStor
 	return false;
 }
 
-bool Blocks::LoadFile(const std::string& fname, LedgerMap& lmap, TrustStore& tstore){
-	offsets.clear();
-	headers.clear();
-	size_t size;
-	// Returns nullptr on zero-byte file, but LoadData handles that fine
-	const auto& memblock = ReadBinaryFile(fname, &size);
-	bool ret;
-	if(!(ret = LoadData(memblock.get(), size, lmap, tstore))){
-		filename = fname;
+std::string Blocks::SegmentName(const std::string& dir, unsigned seqnum){
+	std::ostringstream ss;
+	ss << dir << '/' << std::setfill('0') << std::setw(SEGMENTDIGITS) << seqnum << SEGMENTSUFFIX;
+	return ss.str();
+}
+
+// Segments must be numbered consecutively from 0, each either plain or
+// archived. Other files are ignored. Should both forms of a segment exist (we
+// died while archiving it), the plain one is used.
+std::vector<std::string> Blocks::ListSegments(const std::string& dir){
+	DIR* d = opendir(dir.c_str());
+	if(d == nullptr){
+		throw std::ifstream::failure("couldn't open directory");
+	}
+	std::map<unsigned, bool> seqnums; // seqnum -> is archived
+	const std::string suffix = SEGMENTSUFFIX;
+	const std::string arcsuffix = ARCHIVESUFFIX;
+	struct dirent* dent;
+	while( (dent = readdir(d)) ){
+		std::string name = dent->d_name;
+		if(name.length() != SEGMENTDIGITS + suffix.length()){
+			continue;
+		}
+		bool archived = !name.compare(SEGMENTDIGITS, arcsuffix.length(), arcsuffix);
+		if(!archived && name.compare(SEGMENTDIGITS, suffix.length(), suffix)){
+			continue;
+		}
+		auto digits = name.substr(0, SEGMENTDIGITS);
+		if(!std::all_of(digits.begin(), digits.end(), ::isdigit)){
+			continue;
+		}
+		auto ins = seqnums.emplace(std::stoul(digits), archived);
+		if(!archived){
+			ins.first->second = false;
+		}
+	}
+	closedir(d);
+	std::vector<std::string> ret;
+	unsigned i = 0;
+	for(const auto& sn : seqnums){
+		if(sn.first != i){
+			throw BlockValidationException("missing ledger segment " + SegmentName(dir, i));
+		}
+		auto sname = SegmentName(dir, i++);
+		if(sn.second){
+			sname.replace(sname.size() - suffix.length(), suffix.length(), arcsuffix);
+		}
+		ret.push_back(sname);
 	}
 	return ret;
 }
 
-bool Blocks::AppendBlock(const unsigned char* block, size_t blen, LedgerMap& lmap, TrustStore& tstore){
-	if(VerifyData(block, blen, lmap, tstore) <= 0){
+bool Blocks::LoadFile(const std::string& fname, LedgerMap& lmap, TrustStore& tstore,
+			const LedgerAnchor* anchor){
+	Clear();
+	struct stat st;
+	bool dir = stat(fname.c_str(), &st) == 0 && S_ISDIR(st.st_mode);
+	std::vector<LedgerSegment> segs;
+	if(dir){
+		for(const auto& sname : ListSegments(fname)){
+			segs.push_back({sname, 0, nullptr, nullptr});
+		}
+	}else{
+		segs.push_back({fname, 0, nullptr, nullptr});
+	}
+	size_t base = 0;
+	const std::string arcsuffix = ARCHIVESUFFIX;
+	for(auto& seg : segs){
+		if(dir && !seg.fname.compare(seg.fname.size() - arcsuffix.size(), arcsuffix.size(), arcsuffix)){
+			seg.archive = std::make_shared<SegmentArchive>(seg.fname);
+		}else{
+			seg.map = std::make_shared<MappedFile>(seg.fname);
+		}
+		seg.base = base;
+		base += seg.Size();
+	}
+	segments = std::move(segs);
+	filename = fname;
+	segmented = dir;
+	auto new_lmap = lmap;
+	auto new_tstore = tstore;
+	int verified;
+	try{
+		// Whatever the index covered, the remainder is verified as usual
+		auto trusted = LoadIndex(new_lmap, new_tstore, anchor);
+		if(trusted == 0){
+			new_lmap = lmap;
+			new_tstore = tstore;
+		}
+		// Runs of mapped segments are verified together, but each archived
+		// segment is verified alone, and released before we inflate the next.
+		// Should a run fail, we're abandoning the load (or starting over), so
+		// those adopted before it needn't be backed out.
+		auto verify = [&](){
+			std::vector<std::pair<const unsigned char*, size_t>> regions;
+			int verified = 0;
+			auto flush = [&](){
+				auto v = VerifyData(regions, new_lmap, new_tstore, anchor);
+				regions.clear();
+				if(v < 0){
+					return true;
+				}
+				verified += v;
+				return false;
+			};
+			auto covered = Size();
+			for(const auto& seg : segments){
+				auto segend = seg.base + seg.Size();
+				if(segend <= covered){
+					continue;
+				}
+				auto start = std::max(covered, seg.base);
+				if(!seg.archive){
+					regions.emplace_back(seg.map->Data() + start - seg.base, segend - start);
+					continue;
+				}
+				if(!regions.empty() && flush()){
+					return -1;
+				}
+				auto contents = SegmentContents(seg);
+				regions.emplace_back(contents.get() + start - seg.base, segend - start);
+				if(flush()){
+					return -1;
+				}
+			}
+			if(!regions.empty() && flush()){
+				return -1;
+			}
+			if(anchor && GetBlockCount() < anchor->height){
+				throw BlockValidationException("ledger doesn't contain anchor block");
+			}
+			return verified;
+		};
+		try{
+			verified = verify();
+		}catch(const CatenaException&){
+			if(trusted == 0){
+				throw;
+			}
+			verified = -1;
+		}
+		if(verified < 0 && trusted){
+			// perhaps it was the index that was bad; start over without it
+			TruncateBlocks(0);
+			new_lmap = lmap;
+			new_tstore = tstore;
+			verified = verify();
+		}
+	}catch(...){
+		Clear();
+		throw;
+	}
+	if(verified < 0){
+		Clear();
+		return true;
+	}
+	lmap = new_lmap;
+	tstore = new_tstore;
+	if(SaveIndex()){
+		std::cerr << "couldn't write ledger index " << IndexName(filename, segmented) << std::endl;
+	}
+	if(opts.archive){
+		try{
+			ArchiveSegments();
+		}catch(const std::exception& e){
+			std::cerr << "couldn't archive ledger segments: " << e.what() << std::endl;
+		}
+	}
+	return false;
+}
+
+std::string Blocks::IndexName(const std::string& ledger, bool segmented){
+	if(segmented){
+		return ledger + "/index" + INDEXSUFFIX;
+	}
+	return ledger + INDEXSUFFIX;
+}
+
+// Sidecar index format (all integers big-endian):
+//  8-byte magic, 4-byte version, 4-byte block count, 4-byte transaction
+//   count, 8-byte ledger length
+//  per block: 32-byte hash, 4-byte length, 4-byte txcount, 8-byte utc, then
+//   per transaction: 4-byte length (0 if unlocated), 2-byte type
+//  32-byte hash of everything preceding
+// Offsets and previous hashes are implied by the order of the blocks, and
+// transaction offsets by the order of the transactions within each block.
+namespace {
+const unsigned char INDEXMAGIC[8] = { 'C', 'A', 'T', 'E', 'N', 'A', 'I', 'X', };
+constexpr unsigned INDEXVERSION = 1;
+constexpr size_t INDEXHDRLEN = sizeof(INDEXMAGIC) + 4 + 4 + 4 + 8;
+constexpr size_t INDEXRECLEN = HASHLEN + 4 + 4 + 8;
+constexpr size_t INDEXTXLEN = 4 + 2;
+}
+
+bool Blocks::SaveIndex(){
+	if(!opts.sidecar_index || filename.empty() || indexed == headers.size()){
+		return false;
+	}
+	std::vector<unsigned char> buf(INDEXHDRLEN + headers.size() * INDEXRECLEN +
+					txlocs.size() * INDEXTXLEN + HASHLEN);
+	WireWriter w(buf.data(), buf.size());
+	w.Bytes(INDEXMAGIC, sizeof(INDEXMAGIC));
+	w.Int<4>(INDEXVERSION);
+	w.Int<4>(headers.size());
+	w.Int<4>(txlocs.size());
+	w.Int<8>(Size());
+	for(size_t i = 0 ; i < headers.size() ; ++i){
+		const auto& h = headers[i];
+		w.Hash(h.hash);
+		w.Int<4>(h.totlen);
+		w.Int<4>(h.txcount);
+		w.Int<8>(h.utc);
+		for(unsigned t = txbase[i] ; t < txbase[i] + h.txcount ; ++t){
+			w.Int<4>(txlocs[t].len);
+			w.Int<2>(txlocs[t].type);
+		}
+	}
+	CatenaHash digest;
+	catenaHash(buf.data(), buf.size() - HASHLEN, digest);
+	w.Hash(digest);
+	try{
+		ReplaceBinaryFile(IndexName(filename, segmented), buf.data(), buf.size());
+	}catch(const std::ofstream::failure&){
+		return true;
+	}
+	indexed = headers.size();
+	return false;
+}
+
+unsigned Blocks::LoadIndex(LedgerMap& lmap, TrustStore& tstore,
+				const LedgerAnchor* anchor){
+	if(!opts.sidecar_index || segments.empty()){
+		return 0; // disabled, or an empty segmented ledger
+	}
+	size_t len;
+	std::unique_ptr<unsigned char[]> idx;
+	try{
+		idx = ReadBinaryFile(IndexName(filename, segmented), &len);
+	}catch(const std::ifstream::failure&){
+		return 0; // no index, or unreadable; either way, not an error
+	}
+	if(len < INDEXHDRLEN + HASHLEN){
+		return 0;
+	}
+	CatenaHash check;
+	catenaHash(idx.get(), len - HASHLEN, check);
+	if(memcmp(check.data(), idx.get() + len - HASHLEN, HASHLEN)){
+		std::cerr << "ignoring corrupt ledger index" << std::endl;
+		return 0;
+	}
+	// lengths were checked above, so the reader can't run out
+	WireReader<BlockValidationException> r(idx.get(), len - HASHLEN);
+	if(memcmp(r.Bytes(sizeof(INDEXMAGIC)), INDEXMAGIC, sizeof(INDEXMAGIC))){
+		return 0;
+	}
+	if(r.Int<4>() != INDEXVERSION){
+		return 0;
+	}
+	unsigned count = r.Int<4>();
+	unsigned txcount = r.Int<4>();
+	size_t covered = r.Int<8>();
+	if(count == 0 || len != INDEXHDRLEN + count * INDEXRECLEN +
+			static_cast<size_t>(txcount) * INDEXTXLEN + HASHLEN){
+		return 0;
+	}
+	const auto& tail = segments.back();
+	if(covered > tail.base + tail.Size()){
+		return 0; // ledger has been truncated
+	}
+	std::vector<BlockHeader> hdrs(count);
+	std::vector<size_t> offs(count);
+	std::vector<TXLocation> locs;
+	locs.reserve(txcount);
+	CatenaHash prev;
+	prev.fill(0xff);
+	size_t offset = 0;
+	for(unsigned i = 0 ; i < count ; ++i){
+		auto& h = hdrs[i];
+		h.hash = r.Hash();
+		h.totlen = r.Int<4>();
+		h.txcount = r.Int<4>();
+		h.utc = r.Int<8>();
+		h.prev = prev;
+		h.version = Block::BLOCKVERSION;
+		h.txidx = i;
+		if(h.totlen < Block::BLOCKHEADERLEN || offset + h.totlen > covered){
+			return 0;
+		}
+		// no block may span segments
+		const auto& seg = SegmentOf(offset);
+		if(offset - seg.base + h.totlen > seg.Size()){
+			return 0;
+		}
+		// Each block's transactions must fit in it (as it was located, they
+		// exactly fill it, unless the offset table couldn't be followed)
+		if(h.txcount > txcount - locs.size() ||
+				(h.totlen - Block::BLOCKHEADERLEN) / 4 < h.txcount){
+			return 0;
+		}
+		size_t pos = offset + Block::BLOCKHEADERLEN + h.txcount * 4ul;
+		unsigned txlen = 0;
+		for(unsigned t = 0 ; t < h.txcount ; ++t){
+			txlen = r.Int<4>();
+			uint16_t type = r.Int<2>();
+			if(type >= TXTYPELIMIT || txlen > offset + h.totlen - pos){
+				return 0;
+			}
+			if(txlen){
+				locs.push_back(TXLocation{pos, txlen, type});
+				pos += txlen;
+			}else{
+				locs.push_back(TXLocation{0, 0, type});
+			}
+		}
+		if(txlen && pos != offset + h.totlen){
+			return 0;
+		}
+		offs[i] = offset;
+		offset += h.totlen;
+		prev = h.hash;
+	}
+	if(offset != covered || locs.size() != txcount){
+		return 0;
+	}
+	// The index is only trusted if its last block is the ledger's, which (via
+	// the prev hash chain) vouches for everything preceding it.
+	const auto& last = hdrs.back();
+	std::shared_ptr<const unsigned char> lastdata;
+	try{
+		lastdata = SegmentBytes(offs.back(), last.totlen);
+		Block::VerifyHash(&last, lastdata.get());
+	}catch(const std::exception&){
+		return 0;
+	}
+	if(memcmp(lastdata.get(), last.hash.data(), HASHLEN) ||
+			(count > 1 && memcmp(lastdata.get() + HASHLEN, hdrs[count - 2].hash.data(), HASHLEN))){
+		return 0;
+	}
+	size_t skip = 0;
+	if(anchor){
+		// leave a mismatch for VerifyData() to diagnose
+		if(anchor->height && anchor->height <= count &&
+				hdrs[anchor->height - 1].hash != anchor->hash){
+			return 0;
+		}
+		skip = std::min<size_t>(anchor->height, count);
+	}
+	// Blocks through the anchor aren't read at all. The rest are replayed a
+	// segment at a time, so that only one archive is ever inflated.
+	AdoptLocated(hdrs, offs, locs);
+	std::vector<const unsigned char*> blockdata(count);
+	try{
+		for(size_t first = skip ; first < count ; ){
+			const auto& seg = SegmentOf(offs[first]);
+			auto contents = SegmentContents(seg);
+			auto end = first;
+			while(end < count && offs[end] < seg.base + seg.Size()){
+				blockdata[end] = contents.get() + offs[end] - seg.base;
+				++end;
+			}
+			if(ReplayBodies(hdrs, blockdata, first, end, lmap, tstore)){
+				TruncateBlocks(0);
+				return 0;
+			}
+			first = end;
+		}
+	}catch(const std::exception&){
+		TruncateBlocks(0);
+		return 0;
+	}
+	indexed = count;
+	return count;
+}
+
+// Create and map a new, empty tail segment, starting at ledger offset base
+void Blocks::AddSegment(size_t base){
+	auto sname = SegmentName(filename, segments.size());
+	int fd = open(sname.c_str(), O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC, 0644);
+	if(fd < 0){
+		throw std::ifstream::failure("couldn't create segment " + sname);
+	}
+	close(fd);
+	if(opts.durable){ // the new name must survive a crash, too
+		int dfd = open(filename.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+		if(dfd < 0 || fsync(dfd)){
+			if(dfd >= 0){
+				close(dfd);
+			}
+			throw std::ofstream::failure("couldn't sync directory " + filename);
+		}
+		close(dfd);
+	}
+	segments.push_back({sname, base, std::make_shared<MappedFile>(sname), nullptr});
+}
+
+void Blocks::TruncateBlocks(unsigned count){
+	if(count >= headers.size()){
+		return;
+	}
+	for(auto i = count ; i < headers.size() ; ++i){
+		hashidx.erase(headers[i].hash);
+	}
+	auto txcut = txbase[count];
+	for(auto i = txcut ; i < txlocs.size() ; ++i){
+		--txtypes[txlocs[i].type];
+	}
+	// Only blocks through txhashed were ever hashed, and (since appends
+	// exclude lookups) those an AppendBlock() backs out never are, so any
+	// we must unindex are still intact
+	if(count == 0){
+		txhashidx.clear();
+	}else if(count < txhashed){
+		std::vector<CatenaHash> hashes(TXBase(txhashed) - txcut);
+		HashTXs(count, txhashed, hashes.data());
+		for(const auto& h : hashes){
+			auto it = txhashidx.find(h);
+			// a duplicate of an earlier transaction remains indexed
+			if(it != txhashidx.end() && it->second >= txcut){
+				txhashidx.erase(it);
+			}
+		}
+	}
+	txhashed = std::min(txhashed, count);
+	txlocs.resize(txcut);
+	txbase.resize(count);
+	headers.resize(count);
+	offsets.resize(count);
+	cache.EraseFrom(count);
+	indexed = std::min(indexed, count);
+}
+
+// Everything written to the tail must be durable before we move on, lest a
+// crash leave a hole in the ledger
+void Blocks::CloseTail(){
+	if(tailfd < 0){
+		return;
+	}
+	bool failed = opts.durable && gcommit.Drain(tailfd);
+	close(tailfd);
+	tailfd = -1;
+	if(failed){
+		throw std::ofstream::failure("couldn't sync ledger " + filename);
+	}
+}
+
+bool Blocks::WriteBlock(size_t off, const unsigned char* block, size_t blen){
+	if(segmented){
+		// Never leave an empty segment behind a non-empty one, even for
+		// a block larger than the segment size
+		if(segments.empty() || segments.back().archive || (opts.segment_size &&
+				off > segments.back().base &&
+				off - segments.back().base + blen > opts.segment_size)){
+			CloseTail();
+			AddSegment(off);
+		}
+	}
+	auto& tail = segments.back();
+	if(tailfd < 0){
+		tailfd = open(tail.fname.c_str(), O_WRONLY | O_CLOEXEC);
+		if(tailfd < 0){
+			std::cerr << "couldn't open " << tail.fname << " for writing" << std::endl;
+			return true;
+		}
+	}
+	auto segoff = off - tail.base;
+	size_t done = 0;
+	while(done < blen){
+		auto r = pwrite(tailfd, block + done, blen - done, segoff + done);
+		if(r <= 0){
+			if(r < 0 && errno == EINTR){
+				continue;
+			}
+			break;
+		}
+		done += r;
+	}
+	if(done < blen){
+		std::cerr << "error updating file " << tail.fname << std::endl;
+		if(ftruncate(tailfd, segoff)){
+			std::cerr << "couldn't truncate " << tail.fname << std::endl;
+		}
 		return true;
 	}
-	if(!filename.empty()){
-		// FIXME if we have an error writing out, do we need to remove
-		// the new data from internal data structures from VerifyData?
-		// Safest thing might be to copy+append first, then verify, then
-		// atomically move appended file over old...
-		std::ofstream ofs;
-		ofs.open(filename, std::ios::out | std::ios::binary | std::ios_base::app);
-		ofs.write(reinterpret_cast<const char*>(block), blen);
-		if(ofs.rdstate()){
-			std::cerr << "error updating file " << filename << std::endl;
+	// Outstanding views keep any previous mapping alive
+	auto seglen = segoff + blen;
+	if(!tail.map->Extend(seglen)){
+		tail.map = std::make_shared<MappedFile>(tail.fname, seglen * 2);
+	}
+	return false;
+}
+
+bool Blocks::AppendBlock(const unsigned char* block, size_t blen, LedgerMap& lmap, TrustStore& tstore){
+	auto start = std::chrono::steady_clock::now();
+	uint64_t ticket;
+	int fd;
+	bool sealed; // we began a new segment, sealing its predecessor
+	{
+		std::lock_guard<std::mutex> guard(appendlock);
+		std::unique_lock<std::shared_mutex> state(statelock);
+		if(gcommit.Failed()){
+			throw std::ofstream::failure("ledger sync previously failed");
+		}
+		auto oldcount = GetBlockCount();
+		auto oldsize = Size();
+		// Spans the write, so lmap and tstore can be rolled back should it fail
+		StateTransaction txn(lmap, tstore);
+		if(VerifyData(block, blen, lmap, tstore) <= 0){
 			return true;
 		}
-	}else{
-		memledger.insert(memledger.end(), block, block + blen);
+		if(filename.empty()){
+			memledger.insert(memledger.end(), block, block + blen);
+			txn.Commit();
+			gcommit.Committed(start);
+			return false;
+		}
+		auto oldsegs = segments.size();
+		bool failed;
+		try{
+			failed = WriteBlock(oldsize, block, blen);
+		}catch(...){
+			TruncateBlocks(oldcount);
+			throw;
+		}
+		if(failed){
+			TruncateBlocks(oldcount);
+			return true;
+		}
+		txn.Commit();
+		ticket = gcommit.Written(blen);
+		fd = tailfd;
+		sealed = oldsegs && segments.size() > oldsegs;
+	}
+	// Other appends can proceed while we wait, and might share our sync
+	if(opts.durable && gcommit.Wait(fd, ticket)){
+		throw std::ofstream::failure("couldn't sync ledger " + filename);
+	}
+	gcommit.Committed(start);
+	// The block is committed; archiving the sealed segment holds up nobody
+	// but us (it's compressed outside of the ledger's locks)
+	if(sealed && opts.archive){
+		try{
+			ArchiveSegments();
+		}catch(const std::exception& e){
+			std::cerr << "couldn't archive ledger segments: " << e.what() << std::endl;
+		}
 	}
 	return false;
 }
@@ -199,82 +1001,288 @@ void Blocks::GetLastHash(CatenaHash& hash) const {
 	}
 }
 
-// Returns nullptr on a failure to lex the block or verify its hash
+// Throws BlockValidationException if the block fails to lex or its hash fails
+// to verify
 std::vector<std::unique_ptr<Transaction>>
-Block::Inspect(const unsigned char* b, const BlockHeader* chdr){
+Block::Inspect(std::shared_ptr<const unsigned char> b, const BlockHeader* chdr){
 	CatenaHash hash;
-	catenaHash(b + HASHLEN, chdr->totlen - HASHLEN, hash);
+	catenaHash(b.get() + HASHLEN, chdr->totlen - HASHLEN, hash);
 	if(hash != chdr->hash){
 		throw BlockValidationException("bad hash on inspection");
 	}
-	if(ExtractBody(chdr, b + BLOCKHEADERLEN, chdr->totlen - BLOCKHEADERLEN, nullptr, nullptr)){
+	if(ExtractBody(chdr, b.get() + BLOCKHEADERLEN, chdr->totlen - BLOCKHEADERLEN,
+				nullptr, nullptr, b)){
 		throw BlockValidationException();
 	}
 	return std::move(transactions);
 }
 
-std::vector<BlockDetail> Blocks::Inspect(int start, int end) const {
-	std::vector<BlockDetail> ret;
-	if(start < 0){
-		return ret;
+// The last segment starting at or before offset (empty segments share a base
+// with their successor, which is the one we want)
+const LedgerSegment& Blocks::SegmentOf(size_t offset) const {
+	auto seg = std::upper_bound(segments.begin(), segments.end(), offset,
+			[](size_t o, const LedgerSegment& s){
+				return o < s.base;
+			}) - 1;
+	return *seg;
+}
+
+std::shared_ptr<const unsigned char> Blocks::BlockBytes(unsigned idx) const {
+	auto off = offsets.at(idx);
+	auto blen = headers[idx].totlen;
+	if(!segments.empty()){
+		return SegmentBytes(off, blen);
+	}
+	std::shared_ptr<unsigned char> copy(new unsigned char[blen],
+						std::default_delete<unsigned char[]>());
+	memcpy(copy.get(), memledger.data() + off, blen);
+	return copy;
+}
+
+std::shared_ptr<const unsigned char> Blocks::SegmentBytes(size_t off, size_t len) const {
+	const auto& seg = SegmentOf(off);
+	if(off - seg.base + len > seg.Size()){
+		throw BlockValidationException("bytes beyond end of segment");
+	}
+	if(seg.archive){
+		return seg.archive->Bytes(off - seg.base, len);
+	}
+	// aliases the mapping, sharing its ownership
+	const auto& map = seg.map;
+	return std::shared_ptr<const unsigned char>(map, map->Data() + off - seg.base);
+}
+
+std::shared_ptr<const unsigned char> Blocks::SegmentContents(const LedgerSegment& seg) const {
+	if(seg.archive){
+		return seg.archive->Expand(Workers());
 	}
-	if(end < 0 || (size_t)end + 1 > headers.size()){
-		end = headers.size();
+	return std::shared_ptr<const unsigned char>(seg.map, seg.map->Data());
+}
+
+// Sealed segments never change, so each is compressed from a snapshot taken
+// under the shared lock, and only swapped in under the exclusive one
+unsigned Blocks::ArchiveSegments(){
+	std::lock_guard<std::mutex> serial(archivelock);
+	unsigned count = 0;
+	const std::string suffix = SEGMENTSUFFIX;
+	for(size_t i = 0 ; ; ++i){
+		std::string fname;
+		std::shared_ptr<MappedFile> map;
+		std::vector<size_t> starts;
+		{
+			std::shared_lock<std::shared_mutex> guard(statelock);
+			if(i + 1 >= segments.size()){
+				break;
+			}
+			const auto& seg = segments[i];
+			if(seg.archive){
+				continue;
+			}
+			fname = seg.fname;
+			map = seg.map;
+			auto first = std::lower_bound(offsets.begin(), offsets.end(), seg.base);
+			for(auto o = first ; o != offsets.end() && *o < seg.base + seg.Size() ; ++o){
+				starts.push_back(*o - seg.base);
+			}
+		}
+		auto arcname = fname.substr(0, fname.size() - suffix.size()) + ARCHIVESUFFIX;
+		SegmentArchive::Write(arcname, map->Data(), map->Size(), starts,
+					opts.archive_chunk, Workers());
+		std::shared_ptr<SegmentArchive> arc;
+		try{
+			arc = std::make_shared<SegmentArchive>(arcname);
+		}catch(...){
+			unlink(arcname.c_str());
+			throw;
+		}
+		{
+			std::unique_lock<std::shared_mutex> guard(statelock);
+			auto& seg = segments[i];
+			seg.archive = std::move(arc);
+			seg.fname = arcname;
+			seg.map.reset(); // outstanding views keep it alive
+		}
+		if(unlink(fname.c_str())){
+			std::cerr << "couldn't remove archived segment " << fname << std::endl;
+		}
+		++count;
+	}
+	return count;
+}
+
+std::unique_ptr<Transaction> Blocks::InspectTX(const TXSpec& tx) const {
+	std::shared_lock<std::shared_mutex> guard(statelock);
+	auto blk = hashidx.find(tx.first);
+	if(blk == hashidx.end() || tx.second >= headers[blk->second].txcount){
+		throw InvalidTXSpecException("no such transaction");
+	}
+	const auto& loc = txlocs[txbase[blk->second] + tx.second];
+	if(loc.len == 0){
+		throw TransactionException("couldn't locate transaction");
+	}
+	std::shared_ptr<const unsigned char> bytes;
+	if(segments.empty()){
+		// memledger might be reallocated beneath a view
+		std::shared_ptr<unsigned char> copy(new unsigned char[loc.len],
+						std::default_delete<unsigned char[]>());
+		memcpy(copy.get(), memledger.data() + loc.offset, loc.len);
+		bytes = std::move(copy);
 	}else{
-		++end;
+		bytes = SegmentBytes(loc.offset, loc.len);
 	}
-	if(filename == ""){ // FIXME need keep copy of internal buffer
-		throw BlockValidationException();
+	return Transaction::LexTX(bytes.get(), loc.len, tx.first, tx.second, bytes);
+}
+
+// Serialized forms of the transactions of blocks [first, last), hashed in
+// order into out. Unlocated transactions get a zero hash, and aren't indexed.
+void Blocks::HashTXs(unsigned first, unsigned last, CatenaHash* out) const {
+	auto base = txbase[first];
+	std::vector<std::shared_ptr<const unsigned char>> blocks;
+	std::vector<HashInput> in;
+	in.reserve(TXBase(last) - base);
+	for(auto b = first ; b < last ; ++b){
+		blocks.push_back(BlockBytes(b));
+		for(auto i = txbase[b] ; i < TXBase(b + 1) ; ++i){
+			const auto& loc = txlocs[i];
+			in.push_back({blocks.back().get() + (loc.len ? loc.offset - offsets[b] : 0), loc.len});
+		}
 	}
-	int idx = start;
-	while(idx < end){
-		size_t blen = headers[idx].totlen;
-		auto mblock = ReadBinaryBlob(filename, offsets[idx], blen);
-		if(mblock == nullptr){
-			throw BlockValidationException();
+	catenaHashBatch(in.data(), in.size(), out);
+	for(size_t i = 0 ; i < in.size() ; ++i){
+		if(txlocs[base + i].len == 0){
+			out[i].fill(0);
 		}
-		Block b; // FIXME embed these into Blocks
-		auto trans = b.Inspect(mblock.get(), &headers[idx]);
-		ret.emplace_back(headers[idx], offsets[idx], std::move(mblock),
-					std::move(trans));
-		++idx;
+	}
+}
+
+// Runs of blocks are hashed in parallel (a run at a time, so that blocks of
+// few transactions still fill catenaHashBatch()), and indexed in order, so the
+// first of several transactions sharing a hash is the one found
+void Blocks::IndexTXHashes() const {
+	constexpr unsigned RUN = 64;
+	if(txhashed == headers.size()){
+		return;
+	}
+	auto base = txbase[txhashed];
+	std::vector<CatenaHash> hashes(txlocs.size() - base);
+	auto runs = (headers.size() - txhashed + RUN - 1) / RUN;
+	ParallelFor(Workers(), runs, [&](size_t r){
+		unsigned first = txhashed + r * RUN;
+		unsigned last = std::min<size_t>(first + RUN, headers.size());
+		HashTXs(first, last, hashes.data() + txbase[first] - base);
+	});
+	txhashidx.reserve(txlocs.size());
+	for(size_t i = 0 ; i < hashes.size() ; ++i){
+		if(txlocs[base + i].len){
+			txhashidx.emplace(hashes[i], base + i);
+		}
+	}
+	txhashed = headers.size();
+}
+
+TXSpec Blocks::TXSpecByHash(const CatenaHash& txhash) const {
+	std::shared_lock<std::shared_mutex> guard(statelock);
+	unsigned txidx;
+	{
+		std::lock_guard<std::mutex> hguard(txhashlock);
+		IndexTXHashes();
+		auto it = txhashidx.find(txhash);
+		if(it == txhashidx.end()){
+			throw InvalidTXSpecException("no transaction with that hash");
+		}
+		txidx = it->second;
+	}
+	// the block whose first transaction is the last at or before ours
+	auto blk = std::upper_bound(txbase.begin(), txbase.end(), txidx) - txbase.begin() - 1;
+	return TXSpec(headers[blk].hash, txidx - txbase[blk]);
+}
+
+// The lock is held through Put(), lest a concurrent truncation's eviction come
+// between our lookup and our insertion
+std::shared_ptr<const BlockDetail> Blocks::InspectBlock(unsigned idx, bool cacheit) const {
+	std::shared_lock<std::shared_mutex> guard(statelock);
+	if(idx >= headers.size()){
+		throw std::out_of_range("no such block");
+	}
+	auto cached = cache.Get(idx);
+	if(cached){
+		return cached;
+	}
+	auto mblock = BlockBytes(idx);
+	Block b;
+	auto trans = b.Inspect(mblock, &headers[idx]);
+	cached = std::make_shared<const BlockDetail>(headers[idx], offsets[idx],
+				std::move(mblock), std::move(trans));
+	if(cacheit){
+		// Lexed transactions view bytes, so cost only their objects. For
+		// file-backed ledgers, bytes is a view of the mapping.
+		size_t cost = sizeof(BlockDetail) + (segments.empty() ? headers[idx].totlen : 0) +
+			headers[idx].txcount * TXOBJECTCOST;
+		cache.Put(idx, cached, cost);
+	}
+	return cached;
+}
+
+// Half-open [first, last) for Inspect()'s inclusive start and end
+std::pair<unsigned, unsigned> Blocks::ClampRange(int start, int end) const {
+	unsigned count = headers.size();
+	if(start < 0 || static_cast<unsigned>(start) > count){
+		return std::make_pair(count, count);
+	}
+	if(end < 0 || static_cast<unsigned>(end) + 1 > count){
+		end = count;
+	}else{
+		++end;
+	}
+	return std::make_pair(static_cast<unsigned>(start), static_cast<unsigned>(std::max(start, end)));
+}
+
+BlockRange Blocks::InspectRange(int start, int end) const {
+	std::shared_lock<std::shared_mutex> guard(statelock);
+	auto r = ClampRange(start, end);
+	return BlockRange(this, r.first, r.second);
+}
+
+std::vector<BlockDetail> Blocks::Inspect(int start, int end) const {
+	std::vector<BlockDetail> ret;
+	std::pair<unsigned, unsigned> r;
+	{
+		std::shared_lock<std::shared_mutex> guard(statelock);
+		r = ClampRange(start, end);
+	}
+	for(auto idx = r.first ; idx < r.second ; ++idx){
+		ret.push_back(*InspectBlock(idx));
 	}
 	return ret;
 }
 
 std::pair<std::unique_ptr<const unsigned char[]>, size_t>
 Block::SerializeBlock(CatenaHash& prevhash) const {
-	std::vector<std::pair<std::unique_ptr<unsigned char[]>, size_t>> txserials;
-	std::vector<size_t> offsets;
-	size_t txoffset = 0;
-	size_t len = 0;
-	for(const auto& txp : transactions){
-		const auto& tx = txp.get();
-		txserials.push_back(tx->Serialize());
-		offsets.push_back(txoffset);
-		txoffset += txserials.back().second;
-		len += txserials.back().second + 4; // 4 for offset table entry
-	}
-	len += BLOCKHEADERLEN;
+	// Each transaction's serialization was cached by AddTransaction(), so the
+	// block can be sized exactly, and written in a single pass.
+	size_t len = BLOCKHEADERLEN;
+	for(const auto& tx : transactions){
+		len += tx->SerializedSize() + 4; // 4 for offset table entry
+	}
 	auto block = new unsigned char[len]();
 	std::unique_ptr<const unsigned char[]> ret(block);
-	unsigned char *targ = block + HASHLEN; // leave hash aside for now
-	memcpy(targ, prevhash.data(), prevhash.size()); // copy in previous hash
-	targ += HASHLEN;
-	targ = ulong_to_nbo(BLOCKVERSION, targ, 2);
-	targ = ulong_to_nbo(len, targ, 3);
-	targ = ulong_to_nbo(transactions.size(), targ, 3);
+	WireWriter w(block + HASHLEN, len - HASHLEN); // leave hash aside for now
+	w.Hash(prevhash);
+	w.Int<2>(BLOCKVERSION);
+	w.Int<3>(len);
+	w.Int<3>(transactions.size());
 	time_t now = time(NULL); // FIXME throw exception on result < 0?
-	targ = ulong_to_nbo(now, targ, 5); // 40 bits for UTC
-	memset(targ, 0x00, 19); // reserved bytes
-	targ += 19;
-	auto offtable = targ;
-	auto txtable = offtable + 4 * txserials.size();
-	for(auto i = 0u ; i < txserials.size() ; ++i){
-		const auto& txp = txserials[i];
-		offtable = ulong_to_nbo(offsets[i], offtable, 4);
-		memcpy(txtable, txp.first.get(), txp.second);
-		txtable += txp.second;
+	w.Int<5>(now); // 40 bits for UTC
+	const unsigned char reserved[19] = {};
+	w.Bytes(reserved, sizeof(reserved));
+	size_t txoffset = 0;
+	for(const auto& tx : transactions){
+		w.Int<4>(txoffset);
+		txoffset += tx->SerializedSize();
+	}
+	for(const auto& tx : transactions){
+		auto ser = tx->Serialized();
+		w.Bytes(ser.first, ser.second);
 	}
 	catenaHash(block + HASHLEN, len - HASHLEN, block);
 	memcpy(prevhash.data(), block, HASHLEN);
@@ -283,8 +1291,8 @@ Block::SerializeBlock(CatenaHash& prevhash) const {
 
 void Block::AddTransaction(std::unique_ptr<Transaction> tx){
   CatenaHash ch;
-  auto txser = tx->Serialize();
-  catenaHash(txser.first.get(), txser.second, ch);
+  auto txser = tx->Serialized();
+  catenaHash(txser.first, txser.second, ch);
   auto ins = hashes.insert(ch);
   if(ins.second == false){
     throw TransactionException("already have hash");
@@ -1,12 +1,22 @@
 #ifndef CATENA_LIBCATENA_BLOCK
 #define CATENA_LIBCATENA_BLOCK
 
+#include <array>
+#include <mutex>
+#include <shared_mutex>
 #include <memory>
 #include <vector>
 #include <utility>
 #include <ostream>
+#include <iterator>
+#include <unordered_map>
 #include <libcatena/lookupauthreqtx.h>
 #include <libcatena/truststore.h>
+#include <libcatena/groupcommit.h>
+#include <libcatena/blockcache.h>
+#include <libcatena/archive.h>
+#include <libcatena/workers.h>
+#include <libcatena/mmap.h>
 #include <libcatena/hash.h>
 #include <libcatena/tx.h>
 
@@ -23,39 +33,154 @@ struct BlockHeader {
 	unsigned txidx; // transaction index within block, derived on read
 };
 
+// bytes is a view of the serialized block. For file-backed ledgers, it points
+// into the ledger mapping, which it keeps alive; it remains valid even if the
+// ledger is subsequently extended or reloaded. Transactions are immutable and
+// shared, so BlockDetails are cheap to copy (e.g. out of the BlockCache).
 struct BlockDetail {
 public:
-BlockDetail(const BlockHeader& bhdr, unsigned offset,
-		std::unique_ptr<unsigned char[]> bytes,
+BlockDetail(const BlockHeader& bhdr, size_t offset,
+		std::shared_ptr<const unsigned char> bytes,
 		std::vector<std::unique_ptr<Transaction>> trans) :
   bhdr(bhdr),
   offset(offset),
   bytes(std::move(bytes)),
-  transactions(std::move(trans)) {}
+  transactions(std::make_move_iterator(trans.begin()),
+		std::make_move_iterator(trans.end())) {}
 
 BlockHeader bhdr;
-unsigned offset;
-std::unique_ptr<unsigned char[]> bytes;
-std::vector<std::unique_ptr<Transaction>> transactions;
+size_t offset;
+std::shared_ptr<const unsigned char> bytes;
+std::vector<std::shared_ptr<const Transaction>> transactions;
 
 friend std::ostream& operator<<(std::ostream& stream, const BlockDetail& b);
 };
 
+// Where a transaction's serialized form lies within the ledger
+struct TXLocation {
+	size_t offset; // ledger offset of the transaction
+	unsigned len; // 0 if its block's offset table couldn't be followed
+	uint16_t type; // TXTypes value, 0 if unknown or unlocated
+};
+
+// Tunables for loading and extending a ledger
+struct LedgerOptions {
+	unsigned workers; // verification threads, 0 for one per hardware thread
+	size_t segment_size; // roll over to a new segment beyond this, 0 never
+	unsigned snapshot_interval; // blocks between state snapshots, 0 never
+	size_t cache_bytes; // budget for parsed blocks kept by Inspect(), 0 none
+	bool durable; // fdatasync() appended blocks before acknowledging them
+	unsigned commit_delay_us; // hold each sync this long for other appends
+	bool archive; // compress sealed segments of a segmented ledger
+	size_t archive_chunk; // uncompressed bytes per archive chunk
+	bool sidecar_index; // use and maintain a block index beside file-backed ledgers
+
+	LedgerOptions() :
+	  workers(0),
+	  segment_size(256 * 1024 * 1024),
+	  snapshot_interval(1024),
+	  cache_bytes(64 * 1024 * 1024),
+	  durable(true),
+	  commit_delay_us(0),
+	  archive(false),
+	  archive_chunk(256 * 1024),
+	  sidecar_index(true) {}
+};
+
+// A point in the ledger through which some externally-held state (e.g. a
+// Snapshot) is known to reflect the chain: the first height blocks, the last
+// of which has hash hash.
+struct LedgerAnchor {
+	unsigned height;
+	CatenaHash hash;
+};
+
+// One file of a ledger, holding a contiguous run of zero or more blocks. A
+// single-file ledger is a single segment. Sealed segments of a segmented
+// ledger can be archived, in which case they're read through a SegmentArchive
+// rather than mapped.
+struct LedgerSegment {
+	std::string fname;
+	size_t base; // ledger offset of the segment's first byte
+	std::shared_ptr<MappedFile> map; // null if archived
+	std::shared_ptr<SegmentArchive> archive; // null unless archived
+
+	size_t Size() const {
+		return archive ? archive->Size() : map->Size();
+	}
+};
+
+class BlockRange;
+
 // A contiguous chain of zero or more BlockHeaders
 class Blocks {
 public:
-Blocks() = default;
-virtual ~Blocks() = default;
+Blocks() :
+  txtypes(),
+  txhashed(0),
+  segmented(false),
+  indexed(0),
+  cache(opts.cache_bytes),
+  tailfd(-1),
+  gcommit(std::chrono::microseconds(opts.commit_delay_us)) {}
+Blocks(const LedgerOptions& opts) :
+  opts(opts),
+  txtypes(),
+  txhashed(0),
+  segmented(false),
+  indexed(0),
+  cache(opts.cache_bytes),
+  tailfd(-1),
+  gcommit(std::chrono::microseconds(opts.commit_delay_us)) {}
+// Brings the sidecar index up to date, if there is one
+virtual ~Blocks();
 
 // FIXME why aren't these two just constructors? they should only be called once.
 // Load blocks from the specified chunk of memory. Returns true on parsing
 // error. Any present blocks are discarded.
 bool LoadData(const void* data, unsigned len, LedgerMap& lmap, TrustStore& tstore);
-// Load blocks from the specified file. Propagates I/O exceptions. Any present
-// blocks are discarded. Return value is the same as loadData.
-bool LoadFile(const std::string& s, LedgerMap& lmap, TrustStore& tstore);
+// Load blocks from the specified file, which is mapped into memory (and remains
+// so for the lifetime of the Blocks). Propagates I/O exceptions. Any present
+// blocks are discarded. Return value is the same as loadData. If s names a
+// directory, it is loaded as a segmented ledger: files named by SegmentName()
+// are loaded in parallel, and must link together in order. Archived segments
+// are instead inflated one at a time, and released once their blocks have been
+// replayed. An empty directory is an empty ledger. New blocks go to the last segment, and a new segment is
+// begun once the last would exceed segment_size. If anchor is provided, lmap
+// and tstore already reflect the ledger through it, so those blocks are not
+// replayed; BlockValidationException is thrown if the ledger doesn't contain
+// the anchor.
+bool LoadFile(const std::string& s, LedgerMap& lmap, TrustStore& tstore,
+		const LedgerAnchor* anchor = nullptr);
 
-// Parse, validate, and finally add the block to the ledger.
+// File-backed ledgers keep a sidecar index of their block headers and
+// transaction locations (see IndexName()). When loading, blocks covered by the
+// index are not relexed or rehashed, and those through the anchor are not read
+// at all, so long as the index is intact (it carries a hash of its contents)
+// and its last block matches the ledger. Otherwise, the index is
+// ignored, and rewritten following a full load. Returns true on error writing
+// the index. Does nothing for in-memory ledgers, if the index is current, or if
+// opts.sidecar_index is unset (in which case the index is neither read nor
+// written).
+bool SaveIndex();
+// Compress each sealed segment (every segment but the last) not already
+// archived, replacing NNNNNNNN.seg with NNNNNNNN.arc. If opts.archive is set,
+// this is done once a ledger is loaded, and by the AppendBlock() which seals a
+// segment, once it has released the ledger. Segments are compressed without
+// holding any lock, so appends and lookups proceed meanwhile; only one
+// ArchiveSegments() runs at a time. Returns the number of segments archived.
+// Throws std::ofstream::failure on error, in which case the segment is left as
+// it was.
+unsigned ArchiveSegments();
+
+// Parse, validate, and finally add the block to the ledger. Returns true if
+// the block is invalid or couldn't be written, in which case neither the
+// ledger nor lmap and tstore are changed. For file-backed ledgers, the block
+// is written to the tail segment through a descriptor held open for the
+// purpose, and (if opts.durable) synced before we return; appends made from
+// several threads at once share syncs (see GroupCommit). Should a sync fail,
+// std::ofstream::failure is thrown: the block remains in memory, but might
+// not be on disk, and all further appends are refused.
 bool AppendBlock(const unsigned char* block, size_t blen, LedgerMap& lmap, TrustStore& tstore);
 
 unsigned GetBlockCount() const {
@@ -71,10 +196,12 @@ size_t Size() const {
 }
 
 unsigned TXCount() const {
-	return std::accumulate(headers.begin(), headers.end(), 0,
-		[](int total, const BlockHeader& bhdr){
-			return total + bhdr.txcount;
-		});
+	return txlocs.size();
+}
+
+// Transactions by type, indexed by TXTypes value
+const std::array<unsigned, TXTYPELIMIT>& TXTypeCounts() const {
+	return txtypes;
 }
 
 void GetLastHash(CatenaHash& hash) const;
@@ -87,33 +214,274 @@ time_t GetLastUTC() const {
 }
 
 CatenaHash HashByIdx(int idx) const {
+	std::shared_lock<std::shared_mutex> guard(statelock);
 	return headers.at(idx).hash;
 }
 
-// FIXME slow, O(N) on N blocks
+// Throws std::out_of_range if no block has this hash
 int IdxByHash(const CatenaHash& hash) const {
-	auto ret = std::find_if(headers.begin(), headers.end(),
-			[hash](const BlockHeader& b){
-				return b.hash == hash;
-			});
-	if(ret == headers.end()){
+	std::shared_lock<std::shared_mutex> guard(statelock);
+	auto ret = hashidx.find(hash);
+	if(ret == hashidx.end()){
 		throw std::out_of_range("no such block");
 	}
+	return ret->second;
+}
+
+// Index of the first block with a timestamp no earlier than utc, or
+// GetBlockCount() if there is no such block. Timestamps are nondecreasing
+// along the chain (enforced by LexHeader()), so this is a binary search.
+unsigned IdxByUTC(uint64_t utc) const {
+	std::shared_lock<std::shared_mutex> guard(statelock);
+	auto ret = std::lower_bound(headers.begin(), headers.end(), utc,
+			[](const BlockHeader& b, uint64_t u){
+				return b.utc < u;
+			});
 	return ret - headers.begin();
 }
 
 // Pass -1 for end to leave the end unspecified. Start and end are inclusive.
+// Parsed blocks are served from (and added to) the BlockCache.
 std::vector<BlockDetail> Inspect(int start, int end) const;
 
+// As Inspect(), but blocks are parsed one at a time, as the range is walked
+// (see BlockRange). The end of the range is fixed when it is created, and
+// each block is fetched under the lock AppendBlock() takes, so a range can be
+// walked while blocks are being appended.
+BlockRange InspectRange(int start, int end) const;
+
+// The parsed idx'th block, from the BlockCache if present. Unless cacheit is
+// set, a block not already cached isn't added (so that long scans don't
+// displace the working set). Throws std::out_of_range for a bad idx.
+std::shared_ptr<const BlockDetail> InspectBlock(unsigned idx, bool cacheit = true) const;
+
+BlockCacheStats CacheStats() const {
+	return cache.Stats();
+}
+
+// Lex the single transaction named by tx, reading only its own bytes (its
+// block's hash was verified when the block was added). Throws
+// InvalidTXSpecException if there is no such transaction.
+std::unique_ptr<Transaction> InspectTX(const TXSpec& tx) const;
+
+// The transaction whose serialized form hashes to txhash (the first, should
+// several share it). Throws InvalidTXSpecException if there is none. The
+// first lookup hashes every transaction; later ones hash only those added
+// since.
+TXSpec TXSpecByHash(const CatenaHash& txhash) const;
+
+GroupCommitStats CommitStats() const {
+	return gcommit.Stats();
+}
+
 friend std::ostream& operator<<(std::ostream& stream, const Blocks& b);
 
+// Segments are named with a zero-padded sequence number, starting from 0.
+// Archived segments replace the suffix with ARCHIVESUFFIX.
+static constexpr unsigned SEGMENTDIGITS = 8;
+static constexpr char SEGMENTSUFFIX[] = ".seg";
+static constexpr char ARCHIVESUFFIX[] = ".arc";
+static std::string SegmentName(const std::string& dir, unsigned seqnum);
+
+// The sidecar index is ledger.idx for a single file, and dir/index.idx for a
+// segmented ledger (where it's ignored as a segment)
+static constexpr char INDEXSUFFIX[] = ".idx";
+static std::string IndexName(const std::string& ledger, bool segmented);
+
 private:
-std::vector<unsigned> offsets;
+LedgerOptions opts;
+std::vector<size_t> offsets;
 std::vector<BlockHeader> headers;
-int VerifyData(const unsigned char* data, unsigned len,
-		LedgerMap& lmap, TrustStore& tstore);
+std::unordered_map<CatenaHash, unsigned> hashidx; // block hash to index
+std::vector<unsigned> txbase; // txlocs index of each block's first transaction
+std::vector<TXLocation> txlocs; // every transaction, in ledger order
+std::array<unsigned, TXTYPELIMIT> txtypes; // txlocs by type
+// Transaction hash to txlocs index, covering the first txhashed blocks. Built
+// and extended by lookups (under txhashlock, within the shared statelock), so
+// that loads needn't hash every transaction.
+mutable std::unordered_map<CatenaHash, unsigned> txhashidx;
+mutable unsigned txhashed;
+mutable std::mutex txhashlock;
 std::string filename; // for in-memory chains, "", otherwise name from LoadFile
+bool segmented; // filename is a directory of segments
 std::vector<unsigned char> memledger; // non-empty iff filename.empty()
+std::vector<LedgerSegment> segments; // empty iff filename.empty()
+unsigned indexed; // blocks covered by the sidecar index on disk
+mutable BlockCache cache;
+int tailfd; // open for writing segments.back(), or -1
+std::mutex appendlock; // serializes AppendBlock() up through the write
+// Held exclusively by AppendBlock() while it extends (or truncates) the
+// blocks and their backing, and shared by the lookups and inspections which
+// might run concurrently with it. LoadFile() and LoadData() mustn't race
+// anything.
+mutable std::shared_mutex statelock;
+GroupCommit gcommit;
+std::mutex archivelock; // serializes ArchiveSegments()
+
+// Verify new blocks presented as one or more regions, to be read as if they
+// were concatenated. Blocks through anchor, if provided, are not replayed. An
+// anchor beyond the new blocks is left for a later call to reach; the caller
+// must check that it was.
+int VerifyData(const std::vector<std::pair<const unsigned char*, size_t>>& regions,
+		LedgerMap& lmap, TrustStore& tstore, const LedgerAnchor* anchor = nullptr);
+
+int VerifyData(const unsigned char* data, size_t len,
+		LedgerMap& lmap, TrustStore& tstore) {
+	return VerifyData({{data, len}}, lmap, tstore);
+}
+
+// Lex and validate the bodies of blocks [first, last). Returns true if a
+// block fails to lex or a transaction fails to validate; exceptions thrown
+// while lexing propagate, but only once all prior blocks have been replayed.
+bool ReplayBodies(const std::vector<BlockHeader>& hdrs,
+		const std::vector<const unsigned char*>& data, size_t first,
+		size_t last, LedgerMap& lmap, TrustStore& tstore) const;
+
+// Take headers, offsets, and transaction locations from the sidecar index, and
+// replay the blocks they cover. Returns the number of blocks so loaded, 0 if
+// the index couldn't be used (in which case lmap and tstore might have been
+// partially updated). Blocks through anchor, if provided, are neither replayed
+// nor read.
+unsigned LoadIndex(LedgerMap& lmap, TrustStore& tstore, const LedgerAnchor* anchor);
+
+// Add verified blocks to the chain, indexing them and their transactions
+void AdoptBlocks(const std::vector<BlockHeader>& hdrs, const std::vector<size_t>& offs,
+		const std::vector<const unsigned char*>& data);
+// As AdoptBlocks(), given the blocks' transactions already located, in order
+void AdoptLocated(const std::vector<BlockHeader>& hdrs, const std::vector<size_t>& offs,
+		const std::vector<TXLocation>& locs);
+
+// Bring txhashidx up to date with the blocks. Call with txhashlock held.
+void IndexTXHashes() const;
+void HashTXs(unsigned first, unsigned last, CatenaHash* out) const;
+
+// The txlocs index of block idx's first transaction, where idx may be one past
+// the last block
+unsigned TXBase(unsigned idx) const {
+	return idx < txbase.size() ? txbase[idx] : txlocs.size();
+}
+
+void Clear();
+std::pair<unsigned, unsigned> ClampRange(int start, int end) const;
+// Forget all blocks from count onwards
+void TruncateBlocks(unsigned count);
+// Write out a block which will begin at ledger offset off, beginning a new
+// segment if warranted. Returns true (having truncated away any partial
+// write) on error.
+bool WriteBlock(size_t off, const unsigned char* block, size_t blen);
+void CloseTail();
+static std::vector<std::string> ListSegments(const std::string& dir);
+void AddSegment(size_t base);
+const LedgerSegment& SegmentOf(size_t offset) const;
+
+// A view of the idx'th block, which keeps its backing memory alive. In-memory
+// chains copy the block, since memledger might be reallocated.
+std::shared_ptr<const unsigned char> BlockBytes(unsigned idx) const;
+
+// All of seg, inflating it should it be archived
+std::shared_ptr<const unsigned char> SegmentContents(const LedgerSegment& seg) const;
+
+// A view of len bytes at ledger offset off within a file-backed ledger, which
+// must lie within a single segment (and, if it's archived, a single chunk)
+std::shared_ptr<const unsigned char> SegmentBytes(size_t off, size_t len) const;
+
+unsigned Workers() const {
+	return opts.workers ? opts.workers : DefaultWorkerCount();
+}
+};
+
+// A run of blocks from a Blocks, which must outlive it. Each block is parsed
+// when its iterator is first dereferenced, and released once the iterator has
+// moved on (and no copies of it remain), so walking a range takes memory
+// bounded by the largest block, however long the range. Should the range's
+// blocks be truncated away beneath it (as by a failed append), dereferencing
+// throws std::out_of_range.
+class BlockRange {
+public:
+class iterator {
+public:
+using iterator_category = std::forward_iterator_tag;
+using value_type = BlockDetail;
+using difference_type = std::ptrdiff_t;
+using pointer = const BlockDetail*;
+using reference = const BlockDetail&;
+
+iterator() :
+  blocks(nullptr),
+  idx(0) {}
+
+reference operator*() const {
+	Load();
+	return *cur;
+}
+
+pointer operator->() const {
+	Load();
+	return cur.get();
+}
+
+iterator& operator++() {
+	++idx;
+	cur.reset();
+	return *this;
+}
+
+iterator operator++(int) {
+	auto ret = *this;
+	++*this;
+	return ret;
+}
+
+bool operator==(const iterator& it) const {
+	return idx == it.idx;
+}
+
+bool operator!=(const iterator& it) const {
+	return idx != it.idx;
+}
+
+private:
+friend class BlockRange;
+iterator(const Blocks* blocks, unsigned idx) :
+  blocks(blocks),
+  idx(idx) {}
+
+void Load() const {
+	if(!cur){
+		cur = blocks->InspectBlock(idx, false);
+	}
+}
+
+const Blocks* blocks;
+unsigned idx;
+mutable std::shared_ptr<const BlockDetail> cur;
+};
+
+BlockRange(const Blocks* blocks, unsigned first, unsigned last) :
+  blocks(blocks),
+  first(first),
+  last(last) {}
+
+iterator begin() const {
+	return iterator(blocks, first);
+}
+
+iterator end() const {
+	return iterator(blocks, last);
+}
+
+size_t size() const {
+	return last - first;
+}
+
+bool empty() const {
+	return first == last;
+}
+
+private:
+const Blocks* blocks;
+unsigned first;
+unsigned last; // one past the final block
 };
 
 // A descriptor of a single block, and logic to serialize blocks
@@ -134,12 +502,28 @@ std::pair<std::unique_ptr<const unsigned char[]>, size_t>
 static void ExtractHeader(BlockHeader* chdr, const unsigned char* data,
 		unsigned len, const CatenaHash& prevhash, uint64_t prevutc);
 
+// ExtractHeader() is LexHeader() followed by VerifyHash(). The former checks
+// everything save the hash, which depends on the entire block. Both throw
+// BlockHeaderException on errors. VerifyHash() may be called concurrently.
+static void LexHeader(BlockHeader* chdr, const unsigned char* data,
+		size_t len, const CatenaHash& prevhash, uint64_t prevutc);
+static void VerifyHash(const BlockHeader* chdr, const unsigned char* data);
+
+// The transactions view b, and each holds a reference to it
 std::vector<std::unique_ptr<Transaction>>
-  Inspect(const unsigned char* b, const BlockHeader* bhdr);
+  Inspect(std::shared_ptr<const unsigned char> b, const BlockHeader* bhdr);
 
-// Pass nullptr as tstore to not validate transactions / update metadata
+// Pass nullptr as tstore to not validate transactions / update metadata. The
+// transactions view data; if keep is provided, they hold it.
 bool ExtractBody(const BlockHeader* chdr, const unsigned char* data,
-    unsigned len, LedgerMap* lmap, TrustStore* tstore);
+    unsigned len, LedgerMap* lmap, TrustStore* tstore,
+    std::shared_ptr<const void> keep = nullptr);
+
+// Lex (without validating) a block's transactions onto the end of txs, which
+// view data. Returns true on a malformed offset table, and throws as LexTX()
+// does, in either case leaving any transactions lexed before the error.
+static bool LexBody(const BlockHeader* chdr, const unsigned char* data,
+    unsigned len, std::vector<TXValue>& txs);
 
 int TransactionCount() const {
 	return transactions.size();
@@ -0,0 +1,63 @@
+#include <libcatena/blockcache.h>
+
+namespace Catena {
+
+std::shared_ptr<const BlockDetail> BlockCache::Get(unsigned idx){
+	std::lock_guard<std::mutex> guard(lock);
+	auto it = entries.find(idx);
+	if(it == entries.end()){
+		++misses;
+		return nullptr;
+	}
+	++hits;
+	lru.splice(lru.begin(), lru, it->second);
+	return it->second->detail;
+}
+
+void BlockCache::Put(unsigned idx, std::shared_ptr<const BlockDetail> detail, size_t cost){
+	if(cost > budget){
+		return;
+	}
+	std::lock_guard<std::mutex> guard(lock);
+	auto it = entries.find(idx);
+	if(it != entries.end()){ // raced with another thread parsing it
+		lru.splice(lru.begin(), lru, it->second);
+		return;
+	}
+	while(bytes + cost > budget){
+		const auto& victim = lru.back();
+		bytes -= victim.cost;
+		entries.erase(victim.idx);
+		lru.pop_back();
+	}
+	lru.push_front({idx, std::move(detail), cost});
+	entries.emplace(idx, lru.begin());
+	bytes += cost;
+}
+
+void BlockCache::EraseFrom(unsigned idx){
+	std::lock_guard<std::mutex> guard(lock);
+	for(auto it = lru.begin() ; it != lru.end() ; ){
+		if(it->idx >= idx){
+			bytes -= it->cost;
+			entries.erase(it->idx);
+			it = lru.erase(it);
+		}else{
+			++it;
+		}
+	}
+}
+
+void BlockCache::Clear(){
+	std::lock_guard<std::mutex> guard(lock);
+	entries.clear();
+	lru.clear();
+	bytes = 0;
+}
+
+BlockCacheStats BlockCache::Stats() const {
+	std::lock_guard<std::mutex> guard(lock);
+	return BlockCacheStats{hits, misses, entries.size(), bytes, budget};
+}
+
+}
@@ -0,0 +1,71 @@
+#ifndef CATENA_LIBCATENA_BLOCKCACHE
+#define CATENA_LIBCATENA_BLOCKCACHE
+
+#include <list>
+#include <mutex>
+#include <memory>
+#include <cstdint>
+#include <unordered_map>
+
+namespace Catena {
+
+struct BlockDetail;
+
+struct BlockCacheStats {
+	uint64_t hits;
+	uint64_t misses;
+	size_t entries;
+	size_t bytes; // estimated, as charged by Put()
+	size_t budget;
+};
+
+// A least-recently-used cache of parsed blocks, keyed by block index, holding
+// at most budget (estimated) bytes. Blocks are immutable once appended, but
+// an index can be reused should the blocks from it onwards be truncated (say,
+// by a failed append), so their entries must be dropped at that point with
+// EraseFrom(). Safe for use from multiple threads.
+class BlockCache {
+public:
+BlockCache(size_t budget) :
+  budget(budget),
+  bytes(0),
+  hits(0),
+  misses(0) {}
+
+BlockCache(const BlockCache&) = delete;
+BlockCache& operator=(const BlockCache&) = delete;
+
+// Returns nullptr (and counts a miss) if idx isn't cached
+std::shared_ptr<const BlockDetail> Get(unsigned idx);
+
+// Insert idx, charging cost bytes against the budget, and evicting the least
+// recently used entries as necessary. Entries larger than the budget are not
+// cached.
+void Put(unsigned idx, std::shared_ptr<const BlockDetail> detail, size_t cost);
+
+// Drop the entries of idx and all greater indices
+void EraseFrom(unsigned idx);
+
+void Clear();
+
+BlockCacheStats Stats() const;
+
+private:
+struct Entry {
+	unsigned idx;
+	std::shared_ptr<const BlockDetail> detail;
+	size_t cost;
+};
+
+mutable std::mutex lock;
+size_t budget;
+size_t bytes;
+uint64_t hits;
+uint64_t misses;
+std::list<Entry> lru; // most recently used at the front
+std::unordered_map<unsigned, std::list<Entry>::iterator> entries;
+};
+
+}
+
+#endif
@@ -1,12 +1,16 @@
 #include <cstring>
+#include <iostream>
+#include <algorithm>
 #include <libcatena/externallookuptx.h>
 #include <libcatena/lookupauthreqtx.h>
 #include <libcatena/ustatus.h>
+#include <libcatena/snapshot.h>
 #include <libcatena/builtin.h>
 #include <libcatena/utility.h>
 #include <libcatena/usertx.h>
 #include <libcatena/member.h>
 #include <libcatena/chain.h>
+#include <libcatena/wire.h>
 #include <libcatena/block.h>
 #include <libcatena/rpc.h>
 #include <libcatena/tx.h>
@@ -19,19 +23,100 @@ void Chain::LoadBuiltinKeys() {
 	bkeys.AddToTrustStore(tstore);
 }
 
-Chain::Chain(const std::string& fname) {
+Chain::Chain(const std::string& fname, const LedgerOptions& opts) :
+  blocks(opts),
+  ledgerfile(fname),
+  snapinterval(opts.snapshot_interval) {
 	LoadBuiltinKeys();
-	if(blocks.LoadFile(fname, lmap, tstore)){
-		throw BlockValidationException();
+	if(!(snapinterval && RestoreSnapshot())){
+		if(blocks.LoadFile(fname, lmap, tstore)){
+			throw BlockValidationException();
+		}
+	}
+	PublishStats();
+	MaybeSnapshot();
+}
+
+bool Chain::RestoreSnapshot() {
+	struct Candidate {
+		unsigned slot;
+		LedgerAnchor anchor;
+		LedgerMap lmap;
+		TrustStore tstore;
+	};
+	std::vector<Candidate> candidates;
+	for(unsigned slot = 0 ; slot < Snapshot::SLOTS ; ++slot){
+		Candidate c;
+		c.slot = slot;
+		c.tstore = tstore; // builtin keys
+		if(!Snapshot::Read(Snapshot::FileName(ledgerfile, slot), &c.anchor, c.lmap, c.tstore)){
+			candidates.push_back(std::move(c));
+		}
 	}
+	std::sort(candidates.begin(), candidates.end(),
+		[](const Candidate& c1, const Candidate& c2){
+			return c1.anchor.height > c2.anchor.height;
+		});
+	for(auto& c : candidates){
+		try{
+			if(blocks.LoadFile(ledgerfile, c.lmap, c.tstore, &c.anchor)){
+				continue;
+			}
+		}catch(const CatenaException& e){
+			std::cerr << "couldn't use snapshot at height " << c.anchor.height
+				<< " (" << e.what() << ")" << std::endl;
+			continue;
+		}
+		lmap = c.lmap;
+		tstore = c.tstore;
+		snapheight = c.anchor.height;
+		snapslot = (c.slot + 1) % Snapshot::SLOTS;
+		return true;
+	}
+	return false;
+}
+
+void Chain::MaybeSnapshot() {
+	auto height = blocks.GetBlockCount();
+	if(snapinterval == 0 || height < snapheight + snapinterval){
+		return;
+	}
+	LedgerAnchor anchor{height, blocks.HashByIdx(height - 1)};
+	try{
+		Snapshot::Write(Snapshot::FileName(ledgerfile, snapslot), anchor, lmap, tstore);
+	}catch(const std::ofstream::failure& e){
+		std::cerr << "couldn't write snapshot (" << e.what() << ")" << std::endl;
+		return;
+	}
+	snapheight = height;
+	snapslot = (snapslot + 1) % Snapshot::SLOTS;
+}
+
+void Chain::PublishStats() {
+	LedgerStats s;
+	s.blocks = blocks.GetBlockCount();
+	s.bytes = blocks.Size();
+	s.transactions = blocks.TXCount();
+	const auto& types = blocks.TXTypeCounts();
+	std::copy(types.begin(), types.end(), s.txtypes.begin());
+	s.pubkeys = tstore.PubkeyCount();
+	s.members = lmap.ConsortiumMemberCount();
+	s.users = lmap.UserCount();
+	s.extlookups = lmap.ExternalLookupCount();
+	s.lookupreqs = lmap.LookupRequestCount();
+	s.authorizedlookups = lmap.LookupRequestCount(true);
+	s.delegations = lmap.StatusDelegationCount();
+	stats.Store(s);
 }
 
 // A Chain instantiated from memory will not write out new blocks.
-Chain::Chain(const void* data, unsigned len) {
+Chain::Chain(const void* data, unsigned len, const LedgerOptions& opts) :
+  blocks(opts) {
 	LoadBuiltinKeys();
 	if(blocks.LoadData(data, len, lmap, tstore)){
 		throw BlockValidationException();
 	}
+	PublishStats();
 }
 
 const Block& Chain::OutstandingTXs() const {
@@ -52,10 +137,19 @@ Chain::SerializeOutstanding() const {
 // merge them back on failure.
 void Chain::CommitOutstanding() {
 	auto p = SerializeOutstanding();
-	if(blocks.AppendBlock(p.first.get(), p.second, lmap, tstore)){
+	bool invalid;
+	try{
+		invalid = blocks.AppendBlock(p.first.get(), p.second, lmap, tstore);
+	}catch(const std::ofstream::failure&){
+		PublishStats(); // a failed sync leaves the block in place
+		throw;
+	}
+	if(invalid){
 		throw BlockValidationException();
 	}
+	PublishStats();
 	FlushOutstanding();
+	MaybeSnapshot();
 }
 
 void Chain::FlushOutstanding() {
@@ -68,13 +162,11 @@ void Chain::AddConsortiumMember(const TXSpec& keyspec, const unsigned char* pubk
 	// FIXME verify that pubkey is a valid public key
 	auto serialjson = payload.dump();
 	size_t len = publen + 2 + serialjson.length();
-  std::vector<unsigned char> buf;
-  buf.reserve(len);
-	unsigned char *targ = buf.data();
-	targ = ulong_to_nbo(publen, targ, 2);
-	memcpy(targ, pubkey, publen);
-	targ += publen;
-	memcpy(targ, serialjson.c_str(), serialjson.length());
+  std::vector<unsigned char> buf(len);
+	WireWriter w(buf.data(), len);
+	w.Int<2>(publen);
+	w.Bytes(pubkey, publen);
+	w.Bytes(serialjson.c_str(), serialjson.length());
   std::pair<std::unique_ptr<unsigned char[]>, size_t> sig;
   if(privkey){
 	  sig = tstore.Sign(buf.data(), len, keyspec, privkey, privlen);
@@ -82,25 +174,26 @@ void Chain::AddConsortiumMember(const TXSpec& keyspec, const unsigned char* pubk
 	  sig = tstore.Sign(buf.data(), len, keyspec);
   }
 	size_t totlen = len + sig.second + 4 + keyspec.first.size() + 2;
-  std::vector<unsigned char> txbuf;
-  txbuf.reserve(totlen);
-	targ = ulong_to_nbo(sig.second, txbuf.data(), 2);
-	memcpy(targ, keyspec.first.data(), keyspec.first.size());
-	targ += keyspec.first.size();
-	targ = ulong_to_nbo(keyspec.second, targ, 4);
-	memcpy(targ, sig.first.get(), sig.second);
-	targ += sig.second;
-	memcpy(targ, buf.data(), len);
+  // the transaction views txbuf, and keeps it alive
+  std::shared_ptr<unsigned char> txbuf(new unsigned char[totlen],
+                                       std::default_delete<unsigned char[]>());
+	WireWriter tw(txbuf.get(), totlen);
+	tw.Int<2>(sig.second);
+	tw.Spec(keyspec);
+	tw.Bytes(sig.first.get(), sig.second);
+	tw.Bytes(buf.data(), len);
 	auto tx = std::unique_ptr<ConsortiumMemberTX>(new ConsortiumMemberTX());
-	tx.get()->Extract(txbuf.data(), totlen);
+	tx.get()->Extract(txbuf.get(), totlen);
+	tx->Retain(txbuf);
 	AddTransaction(std::move(tx));
 }
 
 void Chain::AddTransaction(std::unique_ptr<Transaction> tx) {
-  auto bcast = tx->Serialize();
+  // outstanding hashes the same cached serialization; tx lives on there
+  auto bcast = tx->Serialized();
 	outstanding.AddTransaction(std::move(tx));
   if(rpcnet){
-    rpcnet->BroadcastTX(bcast.first.get(), bcast.second);
+    rpcnet->BroadcastTX(bcast.first, bcast.second);
   }
 }
 
@@ -111,7 +204,7 @@ std::vector<BlockDetail> Chain::Inspect(int start, int end) const {
 
 BlockDetail Chain::Inspect(const CatenaHash& hash) const {
 	auto idx = blocks.IdxByHash(hash);
-	auto details = blocks.Inspect(idx, idx + 1);
+	auto details = blocks.Inspect(idx, idx);
 	return std::move(details.at(0));
 }
 
@@ -120,13 +213,10 @@ void Chain::AddLookupAuthReq(const TXSpec& cmspec, const TXSpec& elspec,
 	auto serialjson = payload.dump();
 	// Signed payload is ExternalLookup TXSpec + JSON
 	size_t len = elspec.first.size() + 4 + serialjson.length();
-  std::vector<unsigned char> buf;
-  buf.reserve(len);
-	unsigned char *targ = buf.data();
-	memcpy(targ, elspec.first.data(), elspec.first.size());
-	targ += elspec.first.size();
-	targ = ulong_to_nbo(elspec.second, targ, 4);
-	memcpy(targ, serialjson.c_str(), serialjson.length());
+  std::vector<unsigned char> buf(len);
+	WireWriter w(buf.data(), len);
+	w.Spec(elspec);
+	w.Bytes(serialjson.c_str(), serialjson.length());
   std::pair<std::unique_ptr<unsigned char[]>, size_t> sig;
   if(privkey){
 	  sig = tstore.Sign(buf.data(), len, cmspec, privkey, privlen);
@@ -134,17 +224,16 @@ void Chain::AddLookupAuthReq(const TXSpec& cmspec, const TXSpec& elspec,
 	  sig = tstore.Sign(buf.data(), len, cmspec);
   }
 	size_t totlen = len + sig.second + 4 + cmspec.first.size() + 2;
-  std::vector<unsigned char> txbuf;
-  txbuf.reserve(totlen);
-	targ = ulong_to_nbo(sig.second, txbuf.data(), 2);
-	memcpy(targ, cmspec.first.data(), cmspec.first.size());
-	targ += cmspec.first.size();
-	targ = ulong_to_nbo(cmspec.second, targ, 4);
-	memcpy(targ, sig.first.get(), sig.second);
-	targ += sig.second;
-	memcpy(targ, buf.data(), len);
+  std::shared_ptr<unsigned char> txbuf(new unsigned char[totlen],
+                                       std::default_delete<unsigned char[]>());
+	WireWriter tw(txbuf.get(), totlen);
+	tw.Int<2>(sig.second);
+	tw.Spec(cmspec);
+	tw.Bytes(sig.first.get(), sig.second);
+	tw.Bytes(buf.data(), len);
 	auto tx = std::unique_ptr<LookupAuthReqTX>(new LookupAuthReqTX());
-	tx.get()->Extract(txbuf.data(), totlen);
+	tx.get()->Extract(txbuf.get(), totlen);
+	tx->Retain(txbuf);
   AddTransaction(std::move(tx));
 }
 
@@ -153,13 +242,11 @@ void Chain::AddExternalLookup(const TXSpec& keyspec, const unsigned char* pubkey
     const void* privkey, size_t privlen) {
 	// FIXME verify that pubkey is a valid public key
 	size_t len = publen + 2 + extid.size();
-  std::vector<unsigned char> buf;
-  buf.reserve(len);
-	unsigned char *targ = buf.data();
-	targ = ulong_to_nbo(publen, targ, 2);
-	memcpy(targ, pubkey, publen);
-	targ += publen;
-	memcpy(targ, extid.c_str(), extid.size());
+  std::vector<unsigned char> buf(len);
+	WireWriter w(buf.data(), len);
+	w.Int<2>(publen);
+	w.Bytes(pubkey, publen);
+	w.Bytes(extid.c_str(), extid.size());
   std::pair<std::unique_ptr<unsigned char[]>, size_t> sig;
   if(privkey){
     sig = tstore.Sign(buf.data(), len, keyspec, privkey, privlen);
@@ -167,18 +254,17 @@ void Chain::AddExternalLookup(const TXSpec& keyspec, const unsigned char* pubkey
     sig = tstore.Sign(buf.data(), len, keyspec);
   }
 	size_t totlen = len + sig.second + 4 + keyspec.first.size() + 4;
-  std::vector<unsigned char> txbuf;
-  txbuf.reserve(totlen);
-	targ = ulong_to_nbo(static_cast<unsigned>(lookuptype), txbuf.data(), 2);
-	memcpy(targ, keyspec.first.data(), keyspec.first.size());
-	targ += keyspec.first.size();
-	targ = ulong_to_nbo(keyspec.second, targ, 4);
-	targ = ulong_to_nbo(sig.second, targ, 2);
-	memcpy(targ, sig.first.get(), sig.second);
-	targ += sig.second;
-	memcpy(targ, buf.data(), len);
+  std::shared_ptr<unsigned char> txbuf(new unsigned char[totlen],
+                                       std::default_delete<unsigned char[]>());
+	WireWriter tw(txbuf.get(), totlen);
+	tw.Int<2>(static_cast<unsigned>(lookuptype));
+	tw.Spec(keyspec);
+	tw.Int<2>(sig.second);
+	tw.Bytes(sig.first.get(), sig.second);
+	tw.Bytes(buf.data(), len);
 	auto tx = std::unique_ptr<ExternalLookupTX>(new ExternalLookupTX());
-	tx->Extract(txbuf.data(), totlen);
+	tx->Extract(txbuf.get(), totlen);
+	tx->Retain(txbuf);
   AddTransaction(std::move(tx));
 }
 
@@ -192,13 +278,11 @@ void Chain::AddUser(const TXSpec& cmspec, const unsigned char* pubkey,
 	// etext.second is encrypted length, etext.first is ciphertext + IV
 	// The public key, keylen, IV, and encrypted payload are all signed
 	size_t len = publen + 2 + etext.second;
-  std::vector<unsigned char> buf;
-  buf.reserve(len);
-	unsigned char *targ = buf.data();
-	targ = ulong_to_nbo(publen, targ, 2);
-	memcpy(targ, pubkey, publen);
-	targ += publen;
-	memcpy(targ, etext.first.get(), etext.second);
+  std::vector<unsigned char> buf(len);
+	WireWriter w(buf.data(), len);
+	w.Int<2>(publen);
+	w.Bytes(pubkey, publen);
+	w.Bytes(etext.first.get(), etext.second);
   std::pair<std::unique_ptr<unsigned char[]>, size_t> sig;
   if(privkey){
 	  sig = tstore.Sign(buf.data(), len, cmspec, privkey, privlen);
@@ -206,17 +290,16 @@ void Chain::AddUser(const TXSpec& cmspec, const unsigned char* pubkey,
 	  sig = tstore.Sign(buf.data(), len, cmspec);
   }
 	size_t totlen = len + sig.second + 4 + cmspec.first.size() + 2;
-  std::vector<unsigned char> txbuf;
-  txbuf.reserve(totlen);
-	targ = ulong_to_nbo(sig.second, txbuf.data(), 2); // siglen
-	memcpy(targ, cmspec.first.data(), cmspec.first.size()); // sighash
-	targ += cmspec.first.size();
-	targ = ulong_to_nbo(cmspec.second, targ, 4); // sigidx
-	memcpy(targ, sig.first.get(), sig.second); // signature
-	targ += sig.second;
-	memcpy(targ, buf.data(), len); // signed payload (pubkeylen, pubkey, ciphertext)
+  std::shared_ptr<unsigned char> txbuf(new unsigned char[totlen],
+                                       std::default_delete<unsigned char[]>());
+	WireWriter tw(txbuf.get(), totlen);
+	tw.Int<2>(sig.second);
+	tw.Spec(cmspec);
+	tw.Bytes(sig.first.get(), sig.second);
+	tw.Bytes(buf.data(), len); // signed payload (pubkeylen, pubkey, ciphertext)
 	auto tx = std::unique_ptr<UserTX>(new UserTX());
-	tx.get()->Extract(txbuf.data(), totlen);
+	tx.get()->Extract(txbuf.get(), totlen);
+	tx->Retain(txbuf);
   AddTransaction(std::move(tx));
 }
 
@@ -234,14 +317,11 @@ void Chain::AddLookupAuth(const TXSpec& larspec, const TXSpec& uspec,
   }
 	// Encrypted payload is User TXSpec, 16-bit keytype, key
 	auto plainlen = symkey.size() + 2 + uspec.first.size() + 4;
-  std::vector<unsigned char> plaintext;
-  plaintext.reserve(plainlen);
-	unsigned char* targ;
-	memcpy(plaintext.data(), uspec.first.data(), uspec.first.size());
-	targ = plaintext.data() + uspec.first.size();
-	targ = ulong_to_nbo(uspec.second, targ, 4);
-	targ = ulong_to_nbo(static_cast<unsigned>(LookupAuthTX::Keytype::AES256), targ, 2);
-	memcpy(targ, symkey.data(), symkey.size());
+  std::vector<unsigned char> plaintext(plainlen);
+	WireWriter w(plaintext.data(), plainlen);
+	w.Spec(uspec);
+	w.Int<2>(static_cast<unsigned>(LookupAuthTX::Keytype::AES256));
+	w.Bytes(symkey.data(), symkey.size());
 	auto etext = tstore.Encrypt(plaintext.data(), plainlen, derivedkey);
   std::pair<std::unique_ptr<unsigned char[]>, size_t> sig;
   if(privkey){
@@ -250,17 +330,16 @@ void Chain::AddLookupAuth(const TXSpec& larspec, const TXSpec& uspec,
 	  sig = tstore.Sign(etext.first.get(), etext.second, elspec);
   }
 	size_t totlen = etext.second + sig.second + 4 + larspec.first.size() + 2;
-  std::vector<unsigned char> txbuf;
-  txbuf.reserve(totlen);
-	targ = ulong_to_nbo(sig.second, txbuf.data(), 2); // siglen
-	memcpy(targ, larspec.first.data(), larspec.first.size()); // sighash
-	targ += larspec.first.size();
-	targ = ulong_to_nbo(larspec.second, targ, 4); // sigidx
-	memcpy(targ, sig.first.get(), sig.second); // signature
-	targ += sig.second;
-	memcpy(targ, etext.first.get(), etext.second); // signed, encrypted payload
+  std::shared_ptr<unsigned char> txbuf(new unsigned char[totlen],
+                                       std::default_delete<unsigned char[]>());
+	WireWriter tw(txbuf.get(), totlen);
+	tw.Int<2>(sig.second);
+	tw.Spec(larspec);
+	tw.Bytes(sig.first.get(), sig.second);
+	tw.Bytes(etext.first.get(), etext.second); // signed, encrypted payload
 	auto tx = std::unique_ptr<LookupAuthTX>(new LookupAuthTX());
-	tx.get()->Extract(txbuf.data(), totlen);
+	tx.get()->Extract(txbuf.get(), totlen);
+	tx->Retain(txbuf);
   AddTransaction(std::move(tx));
 }
 
@@ -271,13 +350,10 @@ void Chain::AddUserStatus(const TXSpec& usdspec, const nlohmann::json& payload,
 	auto serialjson = payload.dump();
 	// Signed payload is UserStatusDelegation TXSpec + JSON
 	size_t len = usdspec.first.size() + 4 + serialjson.length();
-  std::vector<unsigned char> buf;
-  buf.reserve(len);
-	unsigned char *targ = buf.data();
-	memcpy(targ, usdspec.first.data(), usdspec.first.size());
-	targ += usdspec.first.size();
-	targ = ulong_to_nbo(usdspec.second, targ, 4);
-	memcpy(targ, serialjson.c_str(), serialjson.length());
+  std::vector<unsigned char> buf(len);
+	WireWriter w(buf.data(), len);
+	w.Spec(usdspec);
+	w.Bytes(serialjson.c_str(), serialjson.length());
   std::pair<std::unique_ptr<unsigned char[]>, size_t> sig;
   if(privkey){
 	  sig = tstore.Sign(buf.data(), len, cmspec, privkey, privlen);
@@ -285,17 +361,16 @@ void Chain::AddUserStatus(const TXSpec& usdspec, const nlohmann::json& payload,
 	  sig = tstore.Sign(buf.data(), len, cmspec);
   }
 	size_t totlen = len + sig.second + 4 + cmspec.first.size() + 2;
-  std::vector<unsigned char> txbuf;
-  txbuf.reserve(totlen);
-	targ = ulong_to_nbo(sig.second, txbuf.data(), 2);
-	memcpy(targ, cmspec.first.data(), cmspec.first.size());
-	targ += cmspec.first.size();
-	targ = ulong_to_nbo(cmspec.second, targ, 4);
-	memcpy(targ, sig.first.get(), sig.second);
-	targ += sig.second;
-	memcpy(targ, buf.data(), len);
+  std::shared_ptr<unsigned char> txbuf(new unsigned char[totlen],
+                                       std::default_delete<unsigned char[]>());
+	WireWriter tw(txbuf.get(), totlen);
+	tw.Int<2>(sig.second);
+	tw.Spec(cmspec);
+	tw.Bytes(sig.first.get(), sig.second);
+	tw.Bytes(buf.data(), len);
 	auto tx = std::unique_ptr<UserStatusTX>(new UserStatusTX());
-	tx.get()->Extract(txbuf.data(), totlen);
+	tx.get()->Extract(txbuf.get(), totlen);
+	tx->Retain(txbuf);
   AddTransaction(std::move(tx));
 }
 
@@ -304,14 +379,11 @@ void Chain::AddUserStatusDelegation(const TXSpec& cmspec, const TXSpec& uspec,
 	auto serialjson = payload.dump();
 	// FIXME verify that uspec and cmspec are appropriate
 	size_t len = serialjson.length() + 4 + 4 + cmspec.first.size();
-  std::vector<unsigned char> buf;
-  buf.reserve(len);
-	unsigned char *targ = buf.data();
-	memcpy(targ, cmspec.first.data(), cmspec.first.size());
-	targ += cmspec.first.size();
-	targ = ulong_to_nbo(cmspec.second, targ, 4);
-	targ = ulong_to_nbo(stype, targ, 4);
-	memcpy(targ, serialjson.c_str(), serialjson.length());
+  std::vector<unsigned char> buf(len);
+	WireWriter w(buf.data(), len);
+	w.Spec(cmspec);
+	w.Int<4>(static_cast<unsigned>(stype));
+	w.Bytes(serialjson.c_str(), serialjson.length());
   std::pair<std::unique_ptr<unsigned char[]>, size_t> sig;
   if(privkey){
 	  sig = tstore.Sign(buf.data(), len, uspec, privkey, privlen);
@@ -319,17 +391,16 @@ void Chain::AddUserStatusDelegation(const TXSpec& cmspec, const TXSpec& uspec,
 	  sig = tstore.Sign(buf.data(), len, uspec);
   }
 	size_t totlen = len + sig.second + 4 + uspec.first.size() + 2;
-  std::vector<unsigned char> txbuf;
-  txbuf.reserve(totlen);
-	targ = ulong_to_nbo(sig.second, txbuf.data(), 2);
-	memcpy(targ, uspec.first.data(), uspec.first.size());
-	targ += uspec.first.size();
-	targ = ulong_to_nbo(uspec.second, targ, 4);
-	memcpy(targ, sig.first.get(), sig.second);
-	targ += sig.second;
-	memcpy(targ, buf.data(), len);
+  std::shared_ptr<unsigned char> txbuf(new unsigned char[totlen],
+                                       std::default_delete<unsigned char[]>());
+	WireWriter tw(txbuf.get(), totlen);
+	tw.Int<2>(sig.second);
+	tw.Spec(uspec);
+	tw.Bytes(sig.first.get(), sig.second);
+	tw.Bytes(buf.data(), len);
 	auto tx = std::unique_ptr<UserStatusDelegationTX>(new UserStatusDelegationTX());
-	tx.get()->Extract(txbuf.data(), totlen);
+	tx.get()->Extract(txbuf.get(), totlen);
+	tx->Retain(txbuf);
   AddTransaction(std::move(tx));
 }
 
@@ -338,6 +409,11 @@ nlohmann::json Chain::UserStatus(const TXSpec& uspec, unsigned stype) const {
 	return u.Status(stype);
 }
 
+std::string Chain::UserStatusJSON(const TXSpec& uspec, unsigned stype) const {
+	const auto& u = lmap.LookupUser(uspec);
+	return u.StatusJSON(stype);
+}
+
 std::vector<PeerInfo> Chain::Peers() const {
 	if(!rpcnet){
 		throw NetworkException("rpc networking has not been enabled");
@@ -4,6 +4,7 @@
 #include <mutex>
 #include <nlohmann/json_fwd.hpp>
 #include <libcatena/externallookuptx.h>
+#include <libcatena/ledgerstats.h>
 #include <libcatena/truststore.h>
 #include <libcatena/exceptions.h>
 #include <libcatena/block.h>
@@ -24,11 +25,19 @@ Chain() = default;
 
 // Constructing a Chain requires lexing and validating blocks. On a logic error
 // within the chain, a BlockValidationException exception is thrown. Exceptions
-// can also be thrown for file I/O error. An empty file is acceptable.
-Chain(const std::string& fname);
+// can also be thrown for file I/O error. An empty file is acceptable. A file-
+// backed Chain begins from its newest usable state Snapshot (if any), and
+// writes a new one every snapshot_interval blocks.
+Chain(const std::string& fname) :
+  Chain(fname, LedgerOptions()) {}
+
+Chain(const std::string& fname, const LedgerOptions& opts);
 
 // A Chain instantiated from memory will not write out new blocks.
-Chain(const void* data, unsigned len);
+Chain(const void* data, unsigned len) :
+  Chain(data, len, LedgerOptions()) {}
+
+Chain(const void* data, unsigned len, const LedgerOptions& opts);
 
 // Throw the same exceptions as Chain(), otherwise returning the number of
 // added blocks.
@@ -40,8 +49,15 @@ std::ostream& DumpTrustStore(std::ostream& s) const {
 	return s << tstore;
 }
 
+// Counts describing the ledger, as of its last change. These are maintained
+// as blocks are added, so that reading them costs the same however large the
+// ledger, and never waits on a writer; they're safe to read from any thread.
+LedgerStats Stats() const {
+	return stats.Load();
+}
+
 unsigned GetBlockCount() const {
-	return blocks.GetBlockCount();
+	return stats.Load().blocks;
 }
 
 unsigned OutstandingTXCount() const {
@@ -49,7 +65,15 @@ unsigned OutstandingTXCount() const {
 }
 
 unsigned TXCount() const {
-	return blocks.TXCount();
+	return stats.Load().transactions;
+}
+
+BlockCacheStats CacheStats() const {
+	return blocks.CacheStats();
+}
+
+GroupCommitStats CommitStats() const {
+	return blocks.CommitStats();
 }
 
 time_t MostRecentBlock() const {
@@ -67,36 +91,37 @@ CatenaHash MostRecentBlockHash() const {
 }
 
 int PubkeyCount() const {
-	return tstore.PubkeyCount();
+	return stats.Load().pubkeys;
 }
 
 // Total size of the serialized chain, in bytes (does not include outstandings)
 size_t Size() const {
-	return blocks.Size();
+	return stats.Load().bytes;
 }
 
 int LookupRequestCount() const {
-	return lmap.LookupRequestCount();
+	return stats.Load().lookupreqs;
 }
 
 int LookupRequestCount(bool authorized) const {
-	return lmap.LookupRequestCount(authorized);
+	auto s = stats.Load();
+	return authorized ? s.authorizedlookups : s.lookupreqs - s.authorizedlookups;
 }
 
 int ExternalLookupCount() const {
-	return lmap.ExternalLookupCount();
+	return stats.Load().extlookups;
 }
 
 int StatusDelegationCount() const {
-	return lmap.StatusDelegationCount();
+	return stats.Load().delegations;
 }
 
 int UserCount() const {
-	return lmap.UserCount();
+	return stats.Load().users;
 }
 
 int ConsortiumMemberCount() const {
-	return lmap.ConsortiumMemberCount();
+	return stats.Load().members;
 }
 
 std::vector<ConsortiumMemberSummary> ConsortiumMembers() const {
@@ -128,6 +153,7 @@ void FlushOutstanding();
 
 void AddPrivateKey(const KeyLookup& kl, const Keypair& kp) {
 	tstore.AddKey(&kp, kl);
+	PublishStats();
 }
 
 // Retrieve the most recent UserStatus published for this user of this type.
@@ -135,6 +161,9 @@ void AddPrivateKey(const KeyLookup& kl, const Keypair& kp) {
 // Throws InvalidTXSpec if no such user exists.
 nlohmann::json UserStatus(const TXSpec& uspec, unsigned stype) const;
 
+// As UserStatus(), but the JSON text as published, without parsing it
+std::string UserStatusJSON(const TXSpec& uspec, unsigned stype) const;
+
 // Generate and sign new transactions, to be added to the ledger. Each of these
 // will result in a new outstanding transaction, plus a broadcast. The versions
 // without a key supplied require the specified private key to be loaded in the
@@ -209,9 +238,35 @@ nlohmann::json InspectJSON(int start, int end) const;
 // Pass -1 for end to specify only the start of the range.
 std::vector<BlockDetail> Inspect(int start, int end) const;
 
-// Return details for the specified block hash.
+// As Inspect(), but yielding one block at a time, parsed as it's reached, so
+// that memory use doesn't grow with the range. The Chain must outlive the
+// range; blocks appended in the meantime aren't included.
+BlockRange InspectRange(int start, int end) const {
+	return blocks.InspectRange(start, end);
+}
+
+// Return details for the specified block hash. Throws std::out_of_range if
+// there is no such block.
 BlockDetail Inspect(const CatenaHash& hash) const;
 
+// Return the single specified transaction, without lexing the rest of its
+// block. Throws InvalidTXSpecException if there is no such transaction.
+std::unique_ptr<Transaction> InspectTX(const TXSpec& tx) const {
+	return blocks.InspectTX(tx);
+}
+
+// The TXSpec of the transaction whose serialized form hashes to txhash.
+// Throws InvalidTXSpecException if there is no such transaction.
+TXSpec TXSpecByHash(const CatenaHash& txhash) const {
+	return blocks.TXSpecByHash(txhash);
+}
+
+// Index of the first block timestamped at or after utc, suitable for passing
+// to Inspect(). Returns GetBlockCount() if all blocks are older.
+unsigned FirstBlockSince(time_t utc) const {
+	return blocks.IdxByUTC(utc < 0 ? 0 : utc);
+}
+
 // Enable p2p rpc networking. Throws NetworkException if already enabled for
 // this ledger, or a variety of other possible problems.
 void EnableRPC(const RPCServiceOptions& opts);
@@ -262,8 +317,23 @@ Blocks blocks;
 Block outstanding;
 std::unique_ptr<RPCService> rpcnet;
 std::mutex lock;
+LedgerCounters stats;
+std::string ledgerfile; // empty for in-memory chains
+unsigned snapinterval = 0; // from LedgerOptions, 0 if we don't snapshot
+unsigned snapheight = 0; // height of our newest snapshot
+unsigned snapslot = 0; // next snapshot slot to write
 
 void LoadBuiltinKeys();
+
+// Load the ledger atop the newest snapshot consistent with it. Returns false,
+// leaving lmap and tstore untouched, if no snapshot could be used.
+bool RestoreSnapshot();
+
+// Write a snapshot if snapinterval blocks have been added since the last
+void MaybeSnapshot();
+
+// Refresh stats from blocks, lmap, and tstore, following any change to them
+void PublishStats();
 };
 
 }
@@ -1,64 +1,51 @@
 #include <iostream>
 #include <libcatena/externallookuptx.h>
 #include <libcatena/utility.h>
+#include <libcatena/wire.h>
 
 namespace Catena {
 
 void ExternalLookupTX::Extract(const unsigned char* data, unsigned len) {
-	if(len < 2){ // 16-bit lookup length
-		throw TransactionException("no room for lookup type");
-	}
-  auto ltype = nbo_to_ulong(data, 2);
+	WireReader<TransactionException> r(data, len);
+	auto ltype = r.Int<2>("no room for lookup type");
 	lookuptype = static_cast<ExtIDTypes>(ltype);
 	if(lookuptype != ExtIDTypes::SharecareID){
     throw TransactionException("unknown external lookup type");
 	}
-	data += 2;
-	len -= 2;
-	if(len < signerhash.size() + sizeof(signeridx)){
-		throw TransactionException("no room for signature spec");
-	}
-	memcpy(signerhash.data(), data, signerhash.size());
-	data += signerhash.size();
-	len -= signerhash.size();
-	signeridx = nbo_to_ulong(data, sizeof(signeridx));
-	data += sizeof(signeridx);
-	len -= sizeof(signeridx);
-	if(len < 2){
-		throw TransactionException("no room for signature length");
-	}
-	siglen = nbo_to_ulong(data, 2);
-	data += 2;
-	len -= 2;
-	if(len < siglen || siglen > sizeof(signature)){
+	signerhash = r.Hash("no room for signature spec");
+	signeridx = r.Int<4>("no room for signature spec");
+	siglen = r.Int<2>("no room for signature length");
+	if(siglen > SIGLEN){
 		throw TransactionException("no room for signature");
 	}
-	memcpy(signature, data, siglen);
-	data += siglen;
-	len -= siglen;
-	if(len < 2){
-		throw TransactionException("no room for key length");
-	}
-	keylen = nbo_to_ulong(data, 2);
-	if(keylen + 2 > len){
-		throw TransactionException("no room for key");
-	}
+	signature = r.Bytes(siglen, "no room for signature");
+	keylen = r.Peek<2>(0, "no room for key length");
+	r.Need(keylen + 2, "no room for key");
 	// FIXME verify that key is valid? verify payload is valid for type?
 	// Key length is part of the signed payload, so don't advance data
-	payload = std::unique_ptr<unsigned char[]>(new unsigned char[len]);
-	memcpy(payload.get(), data, len);
-	payloadlen = len;
+	payload = r.Data();
+	payloadlen = r.Left();
+}
+
+bool ExternalLookupTX::SignatureCheckable(SignatureCheck* sc) const {
+	*sc = {{signerhash, signeridx}, payload, payloadlen, signature, siglen};
+	return true;
+}
+
+bool ExternalLookupTX::IntroducedKey(const unsigned char** key, size_t* klen) const {
+	*key = payload + 2;
+	*klen = keylen;
+	return true;
 }
 
 bool ExternalLookupTX::Validate(TrustStore& tstore,
 				LedgerMap& lookups) {
-	if(tstore.Verify({signerhash, signeridx}, payload.get(),
+	if(VerifySignature(tstore, {signerhash, signeridx}, payload,
 				payloadlen, signature, siglen)){
 		return true;
 	}
-	const unsigned char* data = payload.get() + 2;
-	Keypair kp(data, keylen);
-	tstore.AddKey(&kp, {blockhash, txidx});
+	const unsigned char* data = payload + 2;
+	tstore.AddKey(data, keylen, {blockhash, txidx});
 	lookups.AddExtLookup({signerhash, signeridx});
 	return false;
 }
@@ -82,16 +69,14 @@ ExternalLookupTX::Serialize() const {
 	size_t len = 6 + siglen + signerhash.size() + sizeof(signeridx) +
 		payloadlen;
 	std::unique_ptr<unsigned char[]> ret(new unsigned char[len]);
-	auto data = TXType_to_nbo(TXTypes::ExternalLookup, ret.get());
-	data = ulong_to_nbo(static_cast<unsigned>(lookuptype), data, 2);
-	memcpy(data, signerhash.data(), signerhash.size());
-	data += signerhash.size();
-	data = ulong_to_nbo(signeridx, data, 4);
-	data = ulong_to_nbo(siglen, data, 2);
-	memcpy(data, signature, siglen);
-	data += siglen;
-	memcpy(data, payload.get(), payloadlen);
-	data += payloadlen;
+	WireWriter w(ret.get(), len);
+	w.Int<2>(static_cast<unsigned>(TXTypes::ExternalLookup));
+	w.Int<2>(static_cast<unsigned>(lookuptype));
+	w.Hash(signerhash);
+	w.Int<4>(signeridx);
+	w.Int<2>(siglen);
+	w.Bytes(signature, siglen);
+	w.Bytes(payload, payloadlen);
 	return std::make_pair(std::move(ret), len);
 }
 
@@ -9,7 +9,7 @@ enum class ExtIDTypes : uint16_t {
   SharecareID = 0x0000, // 128-bit value in UUID form
 };
 
-class ExternalLookupTX : public Transaction {
+class ExternalLookupTX final : public Transaction {
 public:
 ExternalLookupTX() = default;
 ExternalLookupTX(const CatenaHash& hash, unsigned idx) : Transaction(hash, idx) {}
@@ -18,25 +18,27 @@ bool Validate(TrustStore& tstore, LedgerMap& lmap) override;
 std::ostream& TXOStream(std::ostream& s) const override;
 std::pair<std::unique_ptr<unsigned char[]>, size_t> Serialize() const override;
 nlohmann::json JSONify() const override;
+bool SignatureCheckable(SignatureCheck* sc) const override;
+bool IntroducedKey(const unsigned char** key, size_t* keylen) const override;
 
 private:
-unsigned char signature[SIGLEN];
+const unsigned char* signature = nullptr; // within the lexed transaction
 CatenaHash signerhash;
 uint32_t signeridx;
 ExtIDTypes lookuptype;
 size_t siglen; // length of signature, up to SIGLEN
-std::unique_ptr<unsigned char[]> payload;
+const unsigned char* payload = nullptr;
 size_t keylen; // length of public key within payload
 size_t payloadlen; // total length of signed payload
 
 const unsigned char*
 GetPubKey() const {
-	return payload.get() + 2;
+	return payload + 2;
 }
 
 const unsigned char*
 GetPayload() const {
-	return payload.get() + 2 + keylen;
+	return payload + 2 + keylen;
 }
 
 size_t GetPayloadLength() const {
@@ -0,0 +1,329 @@
+#ifndef CATENA_LIBCATENA_FLATMAP
+#define CATENA_LIBCATENA_FLATMAP
+
+#include <new>
+#include <memory>
+#include <cstdint>
+#include <cstring>
+#include <utility>
+#include <functional>
+#include <type_traits>
+
+namespace Catena {
+
+// Open-addressed hash table with linear probing, holding its elements inline
+// in one array rather than in per-element nodes. A control byte per slot
+// (empty, or seven bits of the occupant's hash) lets most probes skip
+// comparing keys, and keeps probe runs within a cache line or two. Erasure
+// shifts the rest of the probe run back, so no tombstones accumulate.
+// Insertion and erasure invalidate all iterators, pointers, and references,
+// and iteration order is unspecified. The hash ought be well-mixed in all bits.
+// KeyOf may carry state (such as where the keys are stored). Assignment
+// carries only the elements, leaving each table its own KeyOf.
+template<typename K, typename T, typename KeyOf, typename H = std::hash<K>,
+	typename Eq = std::equal_to<K>>
+class FlatTable {
+// sets mustn't hand out mutable keys
+using Elem = std::conditional_t<std::is_same_v<K, T>, const T, T>;
+
+template<typename Table, typename V>
+class Iter {
+public:
+V& operator*() const {
+	return t->slots[idx].v;
+}
+
+V* operator->() const {
+	return &t->slots[idx].v;
+}
+
+Iter& operator++() {
+	++idx;
+	Skip();
+	return *this;
+}
+
+bool operator==(const Iter& i) const {
+	return idx == i.idx;
+}
+
+bool operator!=(const Iter& i) const {
+	return idx != i.idx;
+}
+
+private:
+Table* t;
+size_t idx;
+
+Iter(Table* t, size_t idx) : t(t), idx(idx) {
+	Skip();
+}
+
+void Skip() {
+	while(idx < t->cap && t->ctrl[idx] == EMPTY){
+		++idx;
+	}
+}
+
+friend class FlatTable;
+};
+
+public:
+using key_type = K;
+using value_type = T;
+using iterator = Iter<FlatTable, Elem>;
+using const_iterator = Iter<const FlatTable, const T>;
+
+FlatTable() :
+  cap(0),
+  count(0) {}
+
+explicit FlatTable(const KeyOf& keyof) :
+  keyof(keyof),
+  cap(0),
+  count(0) {}
+
+FlatTable(const FlatTable& ft) : FlatTable(ft.keyof) {
+	*this = ft;
+}
+
+FlatTable(FlatTable&& ft) noexcept : FlatTable(ft.keyof) {
+	Swap(ft);
+}
+
+FlatTable& operator=(const FlatTable& ft) {
+	if(this != &ft){
+		FlatTable copy;
+		copy.Allocate(ft.cap);
+		for(size_t i = 0 ; i < ft.cap ; ++i){
+			if(ft.ctrl[i] != EMPTY){
+				new(&copy.slots[i].v) T(ft.slots[i].v);
+				copy.ctrl[i] = ft.ctrl[i];
+				++copy.count;
+			}
+		}
+		Swap(copy);
+	}
+	return *this;
+}
+
+FlatTable& operator=(FlatTable&& ft) noexcept {
+	Swap(ft);
+	return *this;
+}
+
+~FlatTable() {
+	clear();
+}
+
+size_t size() const {
+	return count;
+}
+
+bool empty() const {
+	return count == 0;
+}
+
+iterator begin() {
+	return iterator(this, 0);
+}
+
+iterator end() {
+	return iterator(this, cap);
+}
+
+const_iterator begin() const {
+	return const_iterator(this, 0);
+}
+
+const_iterator end() const {
+	return const_iterator(this, cap);
+}
+
+iterator find(const K& k) {
+	return iterator(this, Find(k));
+}
+
+const_iterator find(const K& k) const {
+	return const_iterator(this, Find(k));
+}
+
+// If k is absent, construct T from k and args in its place. For maps, args
+// is the mapped value.
+template<typename... Args>
+std::pair<iterator, bool> emplace(const K& k, Args&&... args) {
+	auto h = H()(k);
+	auto idx = Probe(k, h);
+	if(idx < cap && ctrl[idx] != EMPTY){
+		return {iterator(this, idx), false};
+	}
+	if((count + 1) * 8 > cap * 7){
+		Rehash(cap ? cap * 2 : MINCAP);
+		idx = Probe(k, h);
+	}
+	new(&slots[idx].v) T(k, std::forward<Args>(args)...);
+	ctrl[idx] = Tag(h);
+	++count;
+	return {iterator(this, idx), true};
+}
+
+std::pair<iterator, bool> insert(const K& k) {
+	return emplace(k);
+}
+
+size_t erase(const K& k) {
+	auto idx = Find(k);
+	if(idx == cap){
+		return 0;
+	}
+	Remove(idx);
+	return 1;
+}
+
+void clear() {
+	for(size_t i = 0 ; i < cap ; ++i){
+		if(ctrl[i] != EMPTY){
+			slots[i].v.~T();
+			ctrl[i] = EMPTY;
+		}
+	}
+	count = 0;
+}
+
+// Size the table to hold n elements without rehashing
+void reserve(size_t n) {
+	size_t want = MINCAP;
+	while(n * 8 > want * 7){
+		want *= 2;
+	}
+	if(want > cap){
+		Rehash(want);
+	}
+}
+
+private:
+static constexpr uint8_t EMPTY = 0;
+static constexpr size_t MINCAP = 16;
+
+union Slot {
+	Slot() {}
+	~Slot() {}
+	T v;
+};
+
+KeyOf keyof;
+std::unique_ptr<Slot[]> slots;
+std::unique_ptr<uint8_t[]> ctrl;
+size_t cap; // zero or a power of two
+size_t count;
+
+const K& Key(const T& v) const {
+	return keyof(v);
+}
+
+// The top seven bits of the hash, with the high bit set to mark occupancy
+static uint8_t Tag(size_t h) {
+	return 0x80u | (h >> (sizeof(h) * 8 - 7));
+}
+
+// The slot holding k, or the empty slot where it would go. Only valid with a
+// nonzero capacity, where there's always at least one empty slot.
+size_t Probe(const K& k, size_t h) const {
+	if(cap == 0){
+		return 0;
+	}
+	auto tag = Tag(h);
+	auto mask = cap - 1;
+	for(auto idx = h & mask ; ; idx = (idx + 1) & mask){
+		if(ctrl[idx] == EMPTY){
+			return idx;
+		}
+		if(ctrl[idx] == tag && Eq()(Key(slots[idx].v), k)){
+			return idx;
+		}
+	}
+}
+
+// The slot holding k, or cap if it's absent
+size_t Find(const K& k) const {
+	if(count == 0){
+		return cap;
+	}
+	auto idx = Probe(k, H()(k));
+	return ctrl[idx] == EMPTY ? cap : idx;
+}
+
+// Empty the slot at idx, and pull back any later members of its probe run
+// which can now sit closer to their home slot
+void Remove(size_t idx) {
+	slots[idx].v.~T();
+	ctrl[idx] = EMPTY;
+	--count;
+	auto mask = cap - 1;
+	for(auto j = (idx + 1) & mask ; ctrl[j] != EMPTY ; j = (j + 1) & mask){
+		auto home = H()(Key(slots[j].v)) & mask;
+		if(((j - home) & mask) >= ((j - idx) & mask)){
+			new(&slots[idx].v) T(std::move(slots[j].v));
+			slots[j].v.~T();
+			ctrl[idx] = ctrl[j];
+			ctrl[j] = EMPTY;
+			idx = j;
+		}
+	}
+}
+
+void Allocate(size_t n) {
+	slots.reset(n ? new Slot[n] : nullptr);
+	ctrl.reset(n ? new uint8_t[n] : nullptr);
+	if(n){
+		memset(ctrl.get(), EMPTY, n);
+	}
+	cap = n;
+	count = 0;
+}
+
+void Rehash(size_t n) {
+	FlatTable old;
+	old.Swap(*this);
+	Allocate(n);
+	for(size_t i = 0 ; i < old.cap ; ++i){
+		if(old.ctrl[i] != EMPTY){
+			auto idx = Probe(Key(old.slots[i].v), H()(Key(old.slots[i].v)));
+			new(&slots[idx].v) T(std::move(old.slots[i].v));
+			ctrl[idx] = old.ctrl[i];
+			++count;
+		}
+	}
+}
+
+void Swap(FlatTable& ft) noexcept {
+	std::swap(slots, ft.slots);
+	std::swap(ctrl, ft.ctrl);
+	std::swap(cap, ft.cap);
+	std::swap(count, ft.count);
+}
+};
+
+struct FlatMapKey {
+	template<typename P>
+	const typename P::first_type& operator()(const P& p) const {
+		return p.first;
+	}
+};
+
+struct FlatSetKey {
+	template<typename K>
+	const K& operator()(const K& k) const {
+		return k;
+	}
+};
+
+template<typename K, typename V, typename H = std::hash<K>, typename Eq = std::equal_to<K>>
+using FlatMap = FlatTable<K, std::pair<const K, V>, FlatMapKey, H, Eq>;
+
+template<typename K, typename H = std::hash<K>, typename Eq = std::equal_to<K>>
+using FlatSet = FlatTable<K, K, FlatSetKey, H, Eq>;
+
+}
+
+#endif
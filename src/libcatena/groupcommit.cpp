@@ -0,0 +1,72 @@
+#include <thread>
+#include <unistd.h>
+#include <libcatena/groupcommit.h>
+
+namespace Catena {
+
+uint64_t GroupCommit::Written(size_t len){
+	std::lock_guard<std::mutex> guard(lock);
+	stats.bytes += len;
+	return ++written;
+}
+
+bool GroupCommit::Wait(int fd, uint64_t ticket){
+	std::unique_lock<std::mutex> guard(lock);
+	while(synced < ticket && !failed){
+		if(syncing){
+			cond.wait(guard);
+			continue;
+		}
+		syncing = true;
+		guard.unlock();
+		if(delay.count()){ // let other writers join this sync
+			std::this_thread::sleep_for(delay);
+		}
+		guard.lock();
+		auto target = written;
+		guard.unlock();
+		int ret = fdatasync(fd);
+		guard.lock();
+		syncing = false;
+		if(ret){
+			failed = true;
+		}else{
+			synced = target;
+			++stats.syncs;
+		}
+		cond.notify_all();
+	}
+	return failed;
+}
+
+bool GroupCommit::Drain(int fd){
+	uint64_t ticket;
+	{
+		std::lock_guard<std::mutex> guard(lock);
+		ticket = written;
+	}
+	return Wait(fd, ticket);
+}
+
+void GroupCommit::Committed(std::chrono::steady_clock::time_point start){
+	auto us = std::chrono::duration_cast<std::chrono::microseconds>(
+			std::chrono::steady_clock::now() - start).count();
+	std::lock_guard<std::mutex> guard(lock);
+	++stats.commits;
+	stats.total_us += us;
+	if(static_cast<uint64_t>(us) > stats.max_us){
+		stats.max_us = us;
+	}
+}
+
+bool GroupCommit::Failed() const {
+	std::lock_guard<std::mutex> guard(lock);
+	return failed;
+}
+
+GroupCommitStats GroupCommit::Stats() const {
+	std::lock_guard<std::mutex> guard(lock);
+	return stats;
+}
+
+}
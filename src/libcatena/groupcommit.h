@@ -0,0 +1,70 @@
+#ifndef CATENA_LIBCATENA_GROUPCOMMIT
+#define CATENA_LIBCATENA_GROUPCOMMIT
+
+#include <mutex>
+#include <chrono>
+#include <cstdint>
+#include <condition_variable>
+
+namespace Catena {
+
+struct GroupCommitStats {
+	uint64_t commits; // appends made durable (or accepted, if not syncing)
+	uint64_t syncs; // calls to fdatasync(), each covering one or more commits
+	uint64_t bytes;
+	uint64_t total_us; // summed commit latency, from append to durability
+	uint64_t max_us;
+};
+
+// Makes writes to a file durable, sharing one fdatasync() among however many
+// writers arrive while a sync is underway (or, given a delay, shortly before
+// it begins). Each writer reports its write via Written(), and then calls
+// Wait() with the resulting ticket. The first waiter to find no sync in
+// progress becomes the leader, and syncs on behalf of everyone written so far;
+// the others sleep until a sync covers their ticket. Safe for use from
+// multiple threads.
+class GroupCommit {
+public:
+GroupCommit(std::chrono::microseconds delay) :
+  delay(delay),
+  written(0),
+  synced(0),
+  syncing(false),
+  failed(false),
+  stats() {}
+
+GroupCommit(const GroupCommit&) = delete;
+GroupCommit& operator=(const GroupCommit&) = delete;
+
+// Record that len bytes were written, returning a ticket for Wait()
+uint64_t Written(size_t len);
+
+// Block until all writes through ticket are durable, syncing fd if we're the
+// leader. fd must remain open until then. Returns true if a sync has ever
+// failed, after which nothing further can be assumed durable.
+bool Wait(int fd, uint64_t ticket);
+
+// Make everything written so far durable, as Wait()
+bool Drain(int fd);
+
+// Account for one commit, begun at start
+void Committed(std::chrono::steady_clock::time_point start);
+
+bool Failed() const;
+
+GroupCommitStats Stats() const;
+
+private:
+mutable std::mutex lock;
+std::condition_variable cond;
+std::chrono::microseconds delay;
+uint64_t written; // tickets issued
+uint64_t synced; // tickets known to be durable
+bool syncing; // a leader is in fdatasync()
+bool failed;
+GroupCommitStats stats;
+};
+
+}
+
+#endif
@@ -1,17 +1,46 @@
+#include <memory>
 #include <stdexcept>
 #include <openssl/evp.h>
 #include <libcatena/utility.h>
 #include <libcatena/hash.h>
+#include <libcatena/wire.h>
+
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+#define CATENA_AVX512 1
+#include <cpuid.h>
+#include <immintrin.h>
+#endif
 
 namespace Catena {
 
-// FIXME can we extract these context creations?
-void catenaHash(const void* in, unsigned len, void* hash){
-	auto mdctx = EVP_MD_CTX_create(); // FIXME clean up on all paths
+namespace {
+
+// The SHA256 implementation, looked up once. Under OpenSSL 3, EVP_sha256()
+// would otherwise be fetched from the provider on every initialization.
+const EVP_MD* SHA256MD(){
+#if OPENSSL_VERSION_NUMBER >= 0x30000000L
+	static const std::unique_ptr<EVP_MD, decltype(&EVP_MD_free)>
+		md(EVP_MD_fetch(nullptr, "SHA256", nullptr), EVP_MD_free);
+	return md ? md.get() : EVP_sha256();
+#else
+	return EVP_sha256();
+#endif
+}
+
+// Each thread reuses a single digest context, reinitializing it per hash.
+// Reinitialization with the same digest skips the setup done by a fresh one.
+EVP_MD_CTX* ThreadContext(){
+	thread_local std::unique_ptr<EVP_MD_CTX, decltype(&EVP_MD_CTX_free)>
+		mdctx(EVP_MD_CTX_new(), EVP_MD_CTX_free);
 	if(!mdctx){
 		throw std::runtime_error("couldn't get EVP context");
 	}
-	if(1 != EVP_DigestInit_ex(mdctx, EVP_sha256(), NULL)){
+	return mdctx.get();
+}
+
+void DigestWith(EVP_MD_CTX* mdctx, const EVP_MD* md, const void* in,
+		size_t len, void* hash){
+	if(1 != EVP_DigestInit_ex(mdctx, md, NULL)){
 		throw std::runtime_error("couldn't get SHA256 context");
 	}
 	if(1 != EVP_DigestUpdate(mdctx, in, len)){
@@ -20,7 +49,237 @@ void catenaHash(const void* in, unsigned len, void* hash){
 	if(1 != EVP_DigestFinal_ex(mdctx, (unsigned char*)hash, NULL)){
 		throw std::runtime_error("error finalizing SHA256");
 	}
-	EVP_MD_CTX_destroy(mdctx);
+}
+
+#ifdef CATENA_AVX512
+// SHA-256 of sixteen independent buffers at once, one per 32-bit lane of the
+// AVX-512 registers. On long buffers, this has about 1.7 times the throughput
+// of OpenSSL's SHA-NI digest; short ones gain more, escaping the EVP overhead.
+// Interleaving two SHA-NI digests gained nothing, sha256rnds2 being limited by
+// throughput rather than latency.
+
+// GCC before 13 warns about its own _mm512_undefined_epi32() (bug 105593)
+#if defined(__GNUC__) && !defined(__clang__) && __GNUC__ < 13
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wmaybe-uninitialized"
+#endif
+
+#define AVX512 __attribute__((target("avx512f")))
+
+constexpr unsigned LANES = 16;
+
+const uint32_t SHA256K[64] = {
+	0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+	0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+	0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+	0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+	0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+	0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+	0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+	0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2,
+};
+
+const uint32_t SHA256IV[8] = {
+	0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a, 0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19,
+};
+
+// A buffer being hashed, presented as a sequence of 64-byte blocks, the last
+// one or two of which are built from its tail and the padding
+class PaddedInput {
+public:
+void Reset(const HashInput& in){
+	data = static_cast<const unsigned char*>(in.data);
+	full = in.len / 64;
+	auto rem = in.len % 64;
+	if(rem){
+		memcpy(tail, data + full * 64, rem);
+	}
+	tail[rem] = 0x80;
+	auto tlen = rem < 56 ? 64 : 128;
+	memset(tail + rem + 1, 0, tlen - rem - 1 - 8);
+	StoreNBO<8>(in.len * 8, tail + tlen - 8);
+	count = full + tlen / 64;
+	next = 0;
+}
+
+bool Done() const {
+	return next == count;
+}
+
+const unsigned char* Next(){
+	auto i = next++;
+	return i < full ? data + i * 64 : tail + (i - full) * 64;
+}
+
+private:
+const unsigned char* data;
+size_t full; // blocks taken directly from data
+size_t count; // full, plus one or two blocks of tail
+size_t next;
+unsigned char tail[128];
+};
+
+AVX512 inline __m512i Sigma(__m512i x, int r1, int r2, int r3){
+	return _mm512_ternarylogic_epi32(_mm512_ror_epi32(x, r1), _mm512_ror_epi32(x, r2),
+					_mm512_ror_epi32(x, r3), 0x96);
+}
+
+AVX512 inline __m512i SmallSigma(__m512i x, int r1, int r2, int sh){
+	return _mm512_ternarylogic_epi32(_mm512_ror_epi32(x, r1), _mm512_ror_epi32(x, r2),
+					_mm512_srli_epi32(x, sh), 0x96);
+}
+
+// Run a 64-byte block from each lane through s (s[0] holding every lane's a,
+// and so on)
+AVX512 inline void Compress16(__m512i (&s)[8], const unsigned char* const (&block)[LANES]){
+	// Word j of each block, gathered through the block pointers themselves,
+	// and byte-swapped to host order
+	const __m512i lo = _mm512_loadu_si512(block);
+	const __m512i hi = _mm512_loadu_si512(block + 8);
+	const __m512i evenbytes = _mm512_set1_epi32(0xff00ff00);
+	__m512i w[16];
+	for(unsigned j = 0 ; j < 16 ; ++j){
+		const auto off = _mm512_set1_epi64(4 * j);
+		auto g0 = _mm512_i64gather_epi32(_mm512_add_epi64(lo, off), nullptr, 1);
+		auto g1 = _mm512_i64gather_epi32(_mm512_add_epi64(hi, off), nullptr, 1);
+		auto x = _mm512_inserti64x4(_mm512_castsi256_si512(g0), g1, 1);
+		w[j] = _mm512_ternarylogic_epi32(_mm512_ror_epi32(x, 8), _mm512_rol_epi32(x, 8),
+						evenbytes, 0xe4);
+	}
+	auto a = s[0], b = s[1], c = s[2], d = s[3], e = s[4], f = s[5], g = s[6], h = s[7];
+#pragma GCC unroll 64
+	for(unsigned t = 0 ; t < 64 ; ++t){
+		auto& wt = w[t % 16];
+		if(t >= 16){
+			wt = _mm512_add_epi32(_mm512_add_epi32(wt, SmallSigma(w[(t - 15) % 16], 7, 18, 3)),
+					_mm512_add_epi32(w[(t - 7) % 16], SmallSigma(w[(t - 2) % 16], 17, 19, 10)));
+		}
+		auto t1 = _mm512_add_epi32(_mm512_add_epi32(h, Sigma(e, 6, 11, 25)),
+				_mm512_add_epi32(_mm512_ternarylogic_epi32(e, f, g, 0xca),
+					_mm512_add_epi32(wt, _mm512_set1_epi32(SHA256K[t]))));
+		auto t2 = _mm512_add_epi32(Sigma(a, 2, 13, 22), _mm512_ternarylogic_epi32(a, b, c, 0xe8));
+		h = g;
+		g = f;
+		f = e;
+		e = _mm512_add_epi32(d, t1);
+		d = c;
+		c = b;
+		b = a;
+		a = _mm512_add_epi32(t1, t2);
+	}
+	s[0] = _mm512_add_epi32(s[0], a);
+	s[1] = _mm512_add_epi32(s[1], b);
+	s[2] = _mm512_add_epi32(s[2], c);
+	s[3] = _mm512_add_epi32(s[3], d);
+	s[4] = _mm512_add_epi32(s[4], e);
+	s[5] = _mm512_add_epi32(s[5], f);
+	s[6] = _mm512_add_epi32(s[6], g);
+	s[7] = _mm512_add_epi32(s[7], h);
+}
+
+// Each lane takes up the next buffer as soon as it finishes its own. Lanes
+// left without one run over a dummy block, and their results are discarded.
+AVX512 void HashBatch16(const HashInput* in, size_t count, CatenaHash* out){
+	static const unsigned char idle[64] = {};
+	PaddedInput p[LANES];
+	size_t idx[LANES];
+	bool busy[LANES];
+	alignas(64) uint32_t st[8][LANES];
+	size_t taken = 0;
+	unsigned active = 0;
+	for(unsigned l = 0 ; l < LANES ; ++l){
+		busy[l] = taken < count;
+		if(busy[l]){
+			p[l].Reset(in[taken]);
+			idx[l] = taken++;
+			++active;
+		}
+		for(unsigned i = 0 ; i < 8 ; ++i){
+			st[i][l] = SHA256IV[i];
+		}
+	}
+	__m512i s[8];
+	for(unsigned i = 0 ; i < 8 ; ++i){
+		s[i] = _mm512_load_si512(st[i]);
+	}
+	while(active){
+		const unsigned char* blocks[LANES];
+		bool finished = false;
+		for(unsigned l = 0 ; l < LANES ; ++l){
+			blocks[l] = busy[l] ? p[l].Next() : idle;
+			finished |= busy[l] && p[l].Done();
+		}
+		Compress16(s, blocks);
+		if(!finished){
+			continue;
+		}
+		for(unsigned i = 0 ; i < 8 ; ++i){
+			_mm512_store_si512(st[i], s[i]);
+		}
+		for(unsigned l = 0 ; l < LANES ; ++l){
+			if(!busy[l] || !p[l].Done()){
+				continue;
+			}
+			for(unsigned i = 0 ; i < 8 ; ++i){
+				StoreNBO<4>(st[i][l], out[idx[l]].data() + 4 * i);
+				st[i][l] = SHA256IV[i];
+			}
+			if(taken < count){
+				p[l].Reset(in[taken]);
+				idx[l] = taken++;
+			}else{
+				busy[l] = false;
+				--active;
+			}
+		}
+		for(unsigned i = 0 ; i < 8 ; ++i){
+			s[i] = _mm512_load_si512(st[i]);
+		}
+	}
+}
+
+#undef AVX512
+
+#if defined(__GNUC__) && !defined(__clang__) && __GNUC__ < 13
+#pragma GCC diagnostic pop
+#endif
+
+// The CPU must support AVX-512F, and the OS must preserve the opmask and zmm
+// registers (XCR0 bits 1, 2, and 5 through 7)
+bool HaveAVX512(){
+	unsigned eax, ebx, ecx, edx;
+	if(!__get_cpuid(1, &eax, &ebx, &ecx, &edx) || !(ecx & bit_OSXSAVE)){
+		return false;
+	}
+	if(!__get_cpuid_count(7, 0, &eax, &ebx, &ecx, &edx) || !(ebx & bit_AVX512F)){
+		return false;
+	}
+	uint32_t xcr0, xcr0hi;
+	__asm__("xgetbv" : "=a"(xcr0), "=d"(xcr0hi) : "c"(0));
+	return (xcr0 & 0xe6) == 0xe6;
+}
+#endif
+
+}
+
+void catenaHash(const void* in, unsigned len, void* hash){
+	DigestWith(ThreadContext(), SHA256MD(), in, len, hash);
+}
+
+// Too few buffers leave most of the lanes idle, and are hashed one at a time
+void catenaHashBatch(const HashInput* in, size_t count, CatenaHash* out){
+#ifdef CATENA_AVX512
+	static const bool avx512 = HaveAVX512();
+	if(avx512 && count >= LANES){
+		HashBatch16(in, count, out);
+		return;
+	}
+#endif
+	auto mdctx = ThreadContext();
+	auto md = SHA256MD();
+	for(size_t i = 0 ; i < count ; ++i){
+		DigestWith(mdctx, md, in[i].data, in[i].len, out[i].data());
+	}
 }
 
 void catenaHash(const void* in, unsigned len, CatenaHash& hash){
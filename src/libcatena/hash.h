@@ -1,7 +1,10 @@
 #ifndef CATENA_LIBCATENA_HASH
 #define CATENA_LIBCATENA_HASH
 
+#include <cstdint>
+#include <cstring>
 #include <ostream>
+#include <functional>
 #include <libcatena/utility.h>
 
 namespace Catena {
@@ -41,6 +44,18 @@ std::string hashOString(const CatenaHash& hash);
 
 // Naked interface to hashing functions. hash must be at least HASHLEN bytes.
 void catenaHash(const void* in, unsigned len, void* hash);
+
+// One of a batch of independent buffers to be hashed by catenaHashBatch()
+struct HashInput {
+	const void* data;
+	size_t len;
+};
+
+// Hash count buffers into out, which must have room for count hashes. Equal
+// to calling catenaHash() on each, but where the CPU has AVX-512, sixteen
+// buffers are hashed at once, one per vector lane.
+void catenaHashBatch(const HashInput* in, size_t count, CatenaHash* out);
+
 std::ostream& hashOStream(std::ostream& s, const void* hash);
 
 // Hex representation of block hash. Throws ConvertInputException on lex error.
@@ -73,4 +88,41 @@ static TXSpec StrToTXSpec(const std::string& s);
 
 }
 
+namespace std {
+// Block and TX hashes are already uniformly distributed, so just take their
+// least significant bytes (leading bytes might be constrained by mining).
+template <>
+struct hash<Catena::CatenaHash>{
+size_t operator()(const Catena::CatenaHash& k) const {
+	size_t sha;
+	static_assert(sizeof(sha) <= Catena::HASHLEN, "hash too small for size_t");
+	memcpy(&sha, k.data() + k.size() - sizeof(sha), sizeof(sha));
+	return sha;
+}
+};
+
+// Implement std::hash<TXSpec> so it can be used as key in e.g. unordered_maps.
+// Since TX hashes are already "random", use them as base (using the least
+// significant bytes, since some mining schemes require leading digits). The
+// TX idx is highly non-random (weighted towards low numbers), and open-addressed
+// tables cluster badly on correlated keys, so fold it in with a multiplicative
+// spread and finish with MurmurHash3's 64-bit mixer, leaving every output bit
+// dependent on every input bit.
+template <>
+struct hash<Catena::TXSpec>{
+size_t operator()(const Catena::TXSpec& k) const {
+	uint64_t h;
+	static_assert(sizeof(h) <= Catena::HASHLEN, "hash too small for uint64_t");
+	memcpy(&h, k.first.data() + k.first.size() - sizeof(h), sizeof(h));
+	h ^= k.second * 0x9e3779b97f4a7c15ull;
+	h ^= h >> 33;
+	h *= 0xff51afd7ed558ccdull;
+	h ^= h >> 33;
+	h *= 0xc4ceb9fe1a85ec53ull;
+	h ^= h >> 33;
+	return h;
+}
+};
+}
+
 #endif
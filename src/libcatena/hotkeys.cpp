@@ -0,0 +1,138 @@
+#include <cstring>
+#include <openssl/evp.h>
+#include <openssl/objects.h>
+#if OPENSSL_VERSION_NUMBER >= 0x30000000L
+#include <openssl/core_names.h>
+#else
+#include <openssl/ec.h>
+#include <openssl/ecdsa.h>
+#endif
+#include <libcatena/hotkeys.h>
+
+namespace Catena {
+
+#if OPENSSL_VERSION_NUMBER >= 0x30000000L
+// OpenSSL 3 deprecates the EC_KEY calls through which a key could share a
+// precomputed group, and its providers build their own groups, so here the
+// preparation is a verification context, initialized once for the key and
+// duplicated for each use (a context can't be shared between threads)
+class HotKeys::Prepared {
+public:
+// Returns nullptr if kp isn't a secp256k1 key
+static std::shared_ptr<const Prepared> Prepare(const Keypair& kp){
+	auto pkey = const_cast<EVP_PKEY*>(kp.PublicKey());
+	char curve[32];
+	if(!pkey || !EVP_PKEY_is_a(pkey, "EC") || 1 != EVP_PKEY_get_utf8_string_param(pkey,
+				OSSL_PKEY_PARAM_GROUP_NAME, curve, sizeof(curve), nullptr) ||
+			strcmp(curve, SN_secp256k1)){
+		return nullptr;
+	}
+	std::shared_ptr<Prepared> ret(new Prepared(EVP_PKEY_CTX_new_from_pkey(nullptr, pkey, nullptr)));
+	if(!ret->ctx || 1 != EVP_PKEY_verify_init(ret->ctx) ||
+			1 != EVP_PKEY_CTX_set_signature_md(ret->ctx, EVP_sha256())){
+		return nullptr;
+	}
+	return ret;
+}
+
+~Prepared(){
+	EVP_PKEY_CTX_free(ctx);
+}
+
+Prepared(const Prepared&) = delete;
+Prepared& operator=(const Prepared&) = delete;
+
+bool Verify(const unsigned char* in, size_t inlen, const unsigned char* sig,
+		size_t siglen) const {
+	EVP_PKEY_CTX* vctx = EVP_PKEY_CTX_dup(ctx);
+	if(!vctx){
+		return true;
+	}
+	bool ret = 1 != EVP_PKEY_verify(vctx, sig, siglen, in, inlen);
+	EVP_PKEY_CTX_free(vctx);
+	return ret;
+}
+
+private:
+Prepared(EVP_PKEY_CTX* ctx) :
+  ctx(ctx) {}
+
+EVP_PKEY_CTX* ctx; // initialized for verification, never used directly
+};
+#else
+namespace {
+
+// secp256k1 with its generator table, computed once and shared (by reference)
+// with every prepared key
+const EC_GROUP* PrecomputedGroup(){
+	static const std::unique_ptr<EC_GROUP, decltype(&EC_GROUP_free)> group([]{
+		EC_GROUP* g = EC_GROUP_new_by_curve_name(NID_secp256k1);
+		if(g && 1 != EC_GROUP_precompute_mult(g, nullptr)){
+			EC_GROUP_free(g);
+			g = nullptr;
+		}
+		return g;
+	}(), EC_GROUP_free);
+	return group.get();
+}
+
+}
+
+class HotKeys::Prepared {
+public:
+// Returns nullptr if kp isn't a secp256k1 key
+static std::shared_ptr<const Prepared> Prepare(const Keypair& kp){
+	auto group = PrecomputedGroup();
+	auto pkey = kp.PublicKey();
+	if(!group || !pkey || EVP_PKEY_base_id(pkey) != EVP_PKEY_EC){
+		return nullptr;
+	}
+	const EC_KEY* src = EVP_PKEY_get0_EC_KEY(const_cast<EVP_PKEY*>(pkey));
+	if(!src || EC_GROUP_get_curve_name(EC_KEY_get0_group(src)) != NID_secp256k1){
+		return nullptr;
+	}
+	std::shared_ptr<Prepared> ret(new Prepared(EC_KEY_new()));
+	// the group is copied, but its precomputation is shared
+	if(!ret->ec || 1 != EC_KEY_set_group(ret->ec, group) ||
+			1 != EC_KEY_set_public_key(ret->ec, EC_KEY_get0_public_key(src))){
+		return nullptr;
+	}
+	return ret;
+}
+
+~Prepared(){
+	EC_KEY_free(ec);
+}
+
+Prepared(const Prepared&) = delete;
+Prepared& operator=(const Prepared&) = delete;
+
+// Keypair::Verify() hands the input to ECDSA as the digest, as we do here
+bool Verify(const unsigned char* in, size_t inlen, const unsigned char* sig,
+		size_t siglen) const {
+	return 1 != ECDSA_verify(0, in, inlen, sig, siglen, ec);
+}
+
+private:
+Prepared(EC_KEY* ec) :
+  ec(ec) {}
+
+EC_KEY* ec;
+};
+#endif
+
+bool HotKeys::Verify(const TXSpec& kidx, const Keypair& kp,
+		const unsigned char* in, size_t inlen, const unsigned char* sig,
+		size_t siglen){
+	std::shared_ptr<const Prepared> key;
+	if(!cache.Get(kidx, &key)){
+		key = Prepared::Prepare(kp);
+		cache.Put(kidx, key);
+	}
+	if(!key){
+		return kp.Verify(in, inlen, sig, siglen);
+	}
+	return key->Verify(in, inlen, sig, siglen);
+}
+
+}
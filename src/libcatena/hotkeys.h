@@ -0,0 +1,53 @@
+#ifndef CATENA_LIBCATENA_HOTKEYS
+#define CATENA_LIBCATENA_HOTKEYS
+
+#include <memory>
+#include <libcatena/hash.h>
+#include <libcatena/lrucache.h>
+#include <libcatena/keypair.h>
+
+namespace Catena {
+
+// A least-recently-used set of public keys prepared for fast verification,
+// keyed by their TrustStore index. Before OpenSSL 3, preparing a secp256k1 key
+// decodes it once into an EC_KEY bound to a shared group carrying precomputed
+// multiples of the generator, so verifications skip the per-call EVP setup,
+// and the generator half of their point multiplication is table-driven. Under
+// OpenSSL 3, which offers no supported way to share such a group, it's an
+// initialized verification context, copied for each use. Keys on other curves
+// are verified through Keypair as usual. Safe for use from multiple threads.
+class HotKeys {
+public:
+static constexpr size_t DEFAULT_CAPACITY = 256;
+
+HotKeys(size_t capacity = DEFAULT_CAPACITY) :
+  cache(capacity) {}
+
+// Verify as kp.Verify() would, where kp is the key at kidx, preparing kp if
+// it isn't already
+bool Verify(const TXSpec& kidx, const Keypair& kp, const unsigned char* in,
+		size_t inlen, const unsigned char* sig, size_t siglen);
+
+// Forget kidx, which is no longer (or may no longer be) kp
+void Erase(const TXSpec& kidx) {
+	cache.Erase(kidx);
+}
+
+void Clear() {
+	cache.Clear();
+}
+
+LRUStats Stats() const {
+	return cache.Stats();
+}
+
+private:
+class Prepared;
+
+// nullptr for keys which can't be prepared
+LRUCache<TXSpec, std::shared_ptr<const Prepared>> cache;
+};
+
+}
+
+#endif
@@ -0,0 +1,331 @@
+#include <cmath>
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <libcatena/jsoncheck.h>
+
+namespace Catena {
+
+namespace {
+
+// A single pass over the text, tracking only whether each open container is
+// an object or an array. Methods return true on error.
+class JSONScanner {
+public:
+JSONScanner(const unsigned char* data, size_t len) :
+  p(data),
+  end(data + len),
+  depth(0) {}
+
+bool Invalid() {
+	if(p < end && *p == 0xef){
+		if(end - p < 3 || p[1] != 0xbb || p[2] != 0xbf){
+			return true;
+		}
+		p += 3;
+	}
+	enum { VALUE, KEY, AFTER } state = VALUE;
+	while(true){
+		SkipSpace();
+		if(state == AFTER && depth == 0){
+			return p != end;
+		}
+		if(p == end){
+			return true;
+		}
+		if(state == KEY){
+			if(*p != '"' || String()){
+				return true;
+			}
+			SkipSpace();
+			if(p == end || *p++ != ':'){
+				return true;
+			}
+			state = VALUE;
+		}else if(state == VALUE){
+			state = AFTER;
+			switch(*p){
+			case '{': case '[':
+				Push(*p == '{');
+				++p;
+				SkipSpace();
+				if(p < end && *p == (Top() ? '}' : ']')){
+					++p;
+					Pop();
+				}else{
+					state = Top() ? KEY : VALUE;
+				}
+				break;
+			case '"':
+				if(String()){
+					return true;
+				}
+				break;
+			case 't':
+				if(Literal("true")){
+					return true;
+				}
+				break;
+			case 'f':
+				if(Literal("false")){
+					return true;
+				}
+				break;
+			case 'n':
+				if(Literal("null")){
+					return true;
+				}
+				break;
+			default:
+				if(Number()){
+					return true;
+				}
+				break;
+			}
+		}else{ // AFTER a complete value, within a container
+			if(*p == ','){
+				++p;
+				state = Top() ? KEY : VALUE;
+			}else if(*p == (Top() ? '}' : ']')){
+				++p;
+				Pop();
+			}else{
+				return true;
+			}
+		}
+	}
+}
+
+private:
+static constexpr size_t SHALLOW = 512;
+
+const unsigned char* p;
+const unsigned char* end;
+size_t depth;
+uint64_t shallow[SHALLOW / 64]; // bit set for objects, clear for arrays
+std::vector<bool> deep; // beyond SHALLOW levels
+
+void Push(bool object) {
+	if(depth < SHALLOW){
+		auto bit = uint64_t(1) << (depth % 64);
+		if(object){
+			shallow[depth / 64] |= bit;
+		}else{
+			shallow[depth / 64] &= ~bit;
+		}
+	}else{
+		deep.push_back(object);
+	}
+	++depth;
+}
+
+void Pop() {
+	if(--depth >= SHALLOW){
+		deep.pop_back();
+	}
+}
+
+// Is the innermost open container an object?
+bool Top() const {
+	auto d = depth - 1;
+	return d < SHALLOW ? (shallow[d / 64] >> (d % 64)) & 1 : deep.back();
+}
+
+void SkipSpace() {
+	while(p < end && (*p == ' ' || *p == '\t' || *p == '\n' || *p == '\r')){
+		++p;
+	}
+}
+
+bool Literal(const char* lit) {
+	auto len = strlen(lit);
+	if(static_cast<size_t>(end - p) < len || memcmp(p, lit, len)){
+		return true;
+	}
+	p += len;
+	return false;
+}
+
+static bool Digit(unsigned char c) {
+	return c >= '0' && c <= '9';
+}
+
+void Digits() {
+	while(p < end && Digit(*p)){
+		++p;
+	}
+}
+
+// nlohmann::json stores numbers which aren't integers representable in 64
+// bits as doubles, and rejects those which overflow
+bool Number() {
+	auto start = p;
+	bool integral = true;
+	if(*p == '-'){
+		++p;
+	}
+	if(p == end || !Digit(*p)){
+		return true;
+	}
+	if(*p++ != '0'){
+		Digits();
+	}
+	if(p < end && *p == '.'){
+		++p;
+		if(p == end || !Digit(*p)){
+			return true;
+		}
+		Digits();
+		integral = false;
+	}
+	if(p < end && (*p == 'e' || *p == 'E')){
+		++p;
+		if(p < end && (*p == '+' || *p == '-')){
+			++p;
+		}
+		if(p == end || !Digit(*p)){
+			return true;
+		}
+		Digits();
+		integral = false;
+	}
+	size_t len = p - start;
+	if(integral && len < 19){ // fits in an int64_t
+		return false;
+	}
+	char buf[65];
+	std::string big;
+	const char* num = buf;
+	if(len < sizeof(buf)){
+		memcpy(buf, start, len);
+		buf[len] = '\0';
+	}else{
+		big.assign(reinterpret_cast<const char*>(start), len);
+		num = big.c_str();
+	}
+	return !std::isfinite(strtod(num, nullptr));
+}
+
+// Four hex digits of a \u escape
+bool Hex4(unsigned* cp) {
+	if(end - p < 4){
+		return true;
+	}
+	*cp = 0;
+	for(int i = 0 ; i < 4 ; ++i){
+		unsigned c = *p++;
+		unsigned v;
+		if(Digit(c)){
+			v = c - '0';
+		}else if(c >= 'a' && c <= 'f'){
+			v = c - 'a' + 10;
+		}else if(c >= 'A' && c <= 'F'){
+			v = c - 'A' + 10;
+		}else{
+			return true;
+		}
+		*cp = *cp * 16 + v;
+	}
+	return false;
+}
+
+bool Escape() {
+	if(p == end){
+		return true;
+	}
+	switch(*p++){
+	case '"': case '\\': case '/': case 'b': case 'f': case 'n': case 'r': case 't':
+		return false;
+	case 'u':
+		break;
+	default:
+		return true;
+	}
+	unsigned cp;
+	if(Hex4(&cp)){
+		return true;
+	}
+	if(cp >= 0xdc00 && cp <= 0xdfff){ // unpaired low surrogate
+		return true;
+	}
+	if(cp >= 0xd800 && cp <= 0xdbff){ // high surrogate must lead a low one
+		if(end - p < 2 || p[0] != '\\' || p[1] != 'u'){
+			return true;
+		}
+		p += 2;
+		if(Hex4(&cp) || cp < 0xdc00 || cp > 0xdfff){
+			return true;
+		}
+	}
+	return false;
+}
+
+// One well-formed UTF-8 sequence (RFC 3629) led by c >= 0x80
+bool UTF8(unsigned c) {
+	size_t n = 2;
+	unsigned lo = 0x80, hi = 0xbf; // bounds on the first continuation byte
+	if(c >= 0xc2 && c <= 0xdf){
+		n = 1;
+	}else if(c == 0xe0){
+		lo = 0xa0;
+	}else if(c == 0xed){
+		hi = 0x9f; // no encoded surrogates
+	}else if(c >= 0xe1 && c <= 0xef){
+		// defaults
+	}else if(c == 0xf0){
+		n = 3;
+		lo = 0x90;
+	}else if(c >= 0xf1 && c <= 0xf3){
+		n = 3;
+	}else if(c == 0xf4){
+		n = 3;
+		hi = 0x8f;
+	}else{
+		return true;
+	}
+	if(static_cast<size_t>(end - p) < n || *p < lo || *p > hi){
+		return true;
+	}
+	for(size_t i = 1 ; i < n ; ++i){
+		if(p[i] < 0x80 || p[i] > 0xbf){
+			return true;
+		}
+	}
+	p += n;
+	return false;
+}
+
+// p is at the opening quote
+bool String() {
+	++p;
+	while(p < end){
+		unsigned c = *p++;
+		if(c == '"'){
+			return false;
+		}
+		if(c < 0x20){
+			return true;
+		}
+		if(c == '\\'){
+			if(Escape()){
+				return true;
+			}
+		}else if(c >= 0x80){
+			if(UTF8(c)){
+				return true;
+			}
+		}
+	}
+	return true;
+}
+};
+
+}
+
+bool InvalidJSON(const void* data, size_t len){
+	return JSONScanner(static_cast<const unsigned char*>(data), len).Invalid();
+}
+
+}
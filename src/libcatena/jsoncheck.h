@@ -0,0 +1,17 @@
+#ifndef CATENA_LIBCATENA_JSONCHECK
+#define CATENA_LIBCATENA_JSONCHECK
+
+#include <cstddef>
+
+namespace Catena {
+
+// Returns true unless [data, data + len) is exactly one JSON text, accepting
+// precisely what nlohmann::json::parse() does (RFC 8259 in UTF-8, optionally
+// led by a byte order mark, numbers finite as doubles), but without building
+// anything. Allocates only for nesting over 512 levels deep, or numbers over
+// 64 characters long. For JSON which is to be kept as text.
+bool InvalidJSON(const void* data, size_t len);
+
+}
+
+#endif
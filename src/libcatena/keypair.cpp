@@ -139,7 +139,7 @@ Keypair::Sign(const unsigned char* in, size_t inlen) const {
 	return std::make_pair(std::move(ret), len);
 }
 
-bool Keypair::Verify(const unsigned char* in, size_t inlen, const unsigned char* sig, size_t siglen){
+bool Keypair::Verify(const unsigned char* in, size_t inlen, const unsigned char* sig, size_t siglen) const {
 	EVP_PKEY_CTX* ctx = EVP_PKEY_CTX_new(pubkey, NULL);
 	if(1 != EVP_PKEY_verify_init(ctx)){
 		EVP_PKEY_CTX_free(ctx);
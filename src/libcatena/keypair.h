@@ -61,7 +61,7 @@ size_t Sign(const unsigned char* in, size_t inlen,
 std::pair<std::unique_ptr<unsigned char[]>, size_t>
 Sign(const unsigned char* in, size_t inlen) const;
 
-bool Verify(const unsigned char* in, size_t inlen, const unsigned char* sig, size_t siglen);
+bool Verify(const unsigned char* in, size_t inlen, const unsigned char* sig, size_t siglen) const;
 
 bool HasPrivateKey() const {
 	return privkey != nullptr;
@@ -110,6 +110,11 @@ void Generate();
 // Get the PEM-encoded public key
 std::string PubkeyPEM() const;
 
+// The public key, valid as long as we are
+const EVP_PKEY* PublicKey() const {
+	return pubkey;
+}
+
 private:
 EVP_PKEY* pubkey;
 EVP_PKEY* privkey;
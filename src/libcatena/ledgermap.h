@@ -4,10 +4,17 @@
 // Metadata for outstanding elements in the ledger. Contains fast lookup for
 // essentially "everything which hasn't been obsoleted by a later transaction."
 
-#include <set>
-#include <map>
+#include <string>
+#include <vector>
+#include <cstdint>
 #include <utility>
+#include <variant>
+#include <stdexcept>
+#include <algorithm>
 #include <nlohmann/json.hpp>
+#include <libcatena/txspectable.h>
+#include <libcatena/jsoncheck.h>
+#include <libcatena/undolog.h>
 #include <libcatena/hash.h>
 
 namespace Catena {
@@ -77,27 +84,55 @@ UserSummary(const TXSpec& txspec) :
 TXSpec uspec;
 };
 
+// Statuses are held as the JSON text published (already validated, see
+// InvalidJSON()), and parsed only on request
 class User {
 public:
 nlohmann::json Status(int stype) const {
-	const auto& it = statuses.find(stype);
-	if(it == statuses.end()){
+	return nlohmann::json::parse(StatusJSON(stype));
+}
+
+const std::string& StatusJSON(int stype) const {
+	auto it = Find(statuses, stype);
+	if(it == statuses.end() || it->first != stype){
 		throw UserStatusException("user had no such status");
 	}
 	return it->second;
 }
 
-void SetStatus(int stype, const nlohmann::json& status) {
-	const auto& it = statuses.find(stype);
-	if(it == statuses.end()){
-		statuses.insert({stype, status});
+void SetStatus(int stype, std::string status) {
+	auto it = Find(statuses, stype);
+	if(it == statuses.end() || it->first != stype){
+		statuses.emplace(it, stype, std::move(status));
 	}else{
-		it->second = status;
+		it->second = std::move(status);
+	}
+}
+
+void RemoveStatus(int stype) {
+	auto it = Find(statuses, stype);
+	if(it != statuses.end() && it->first == stype){
+		statuses.erase(it);
 	}
 }
 
+bool HasStatus(int stype) const {
+	auto it = Find(statuses, stype);
+	return it != statuses.end() && it->first == stype;
+}
+
 private:
-std::map<int, nlohmann::json> statuses;
+// Sorted by type. Users hold few statuses, so this beats a map.
+std::vector<std::pair<int, std::string>> statuses;
+
+// The first status of type no less than stype
+template<typename V>
+static auto Find(V& v, int stype) -> decltype(v.begin()) {
+	return std::lower_bound(v.begin(), v.end(), stype,
+		[](const std::pair<int, std::string>& s, int t){ return s.first < t; });
+}
+
+friend class Snapshot;
 };
 
 struct ConsortiumMemberSummary {
@@ -111,6 +146,7 @@ int users;
 nlohmann::json payload;
 };
 
+// Users are held as TXIds from the owning LedgerMap's TXSpecTable
 class ConsortiumMember {
 public:
 
@@ -120,16 +156,17 @@ int UserCount() const {
 	return users.size();
 }
 
-void AddUser(const TXSpec& u) {
+void AddUser(TXId u) {
 	users.push_back(u);
 }
 
-std::vector<UserSummary> Users() const {
-	std::vector<UserSummary> ret;
-	for(auto it = std::begin(users) ; it != std::end(users); ++it){
-		ret.emplace_back(*it);
-	}
-	return ret;
+// Undoes the most recent AddUser()
+void RemoveLastUser() {
+	users.pop_back();
+}
+
+const std::vector<TXId>& Users() const {
+	return users;
 }
 
 nlohmann::json Payload() const {
@@ -137,29 +174,50 @@ nlohmann::json Payload() const {
 }
 
 private:
-std::vector<TXSpec> users;
+std::vector<TXId> users;
 nlohmann::json payload;
+
+friend class Snapshot;
 };
 
+// Mutations between Begin() and Commit() can be reverted with Rollback(),
+// at a cost proportional to the number of mutations. These may nest. Changes made through
+// references returned by LookupUser() are not journaled; use SetUserStatus()
+// instead. References returned by LookupUser() are invalidated by any
+// subsequent mutation.
+//
+// Every TXSpec is interned, and a transaction's record is stored alongside its
+// own TXSpec, in an array indexed by TXId. Records refer to other transactions
+// by TXId, translated back to TXSpecs only when handed out. Consortium members
+// are held in their own array, keeping the common records small. External
+// lookups, recorded under their signer, are a bit indexed by TXId.
 class LedgerMap {
 public:
 
+void Begin() {
+	undo.Begin();
+}
+
+void Commit() {
+	undo.Commit();
+}
+
+void Rollback() {
+	undo.Rollback();
+}
+
 // Total number of LookupAuthReq transactions in the ledger
 int LookupRequestCount() const {
-	return lookupreqs.size();
+	return lookupreqcount;
 }
 
 // Number of LookupAuthReqs that (authorized==true) have a corresponding
 // LookupAuth, or (authorized==false) do not.
 int LookupRequestCount(bool authorized) const {
-	auto authed = std::accumulate(lookupreqs.begin(), lookupreqs.end(), 0,
-			[](int total, const decltype(lookupreqs)::value_type& lr){
-				return total + lr.second.IsAuthorized();
-			});
 	if(authorized){
-		return authed;
+		return authorizedlookups;
 	}else{
-		return LookupRequestCount() - authed;
+		return LookupRequestCount() - authorizedlookups;
 	}
 }
 
@@ -168,131 +226,291 @@ int ExternalLookupCount() const {
 }
 
 int StatusDelegationCount() const {
-	return delegations.size();
+	return delegationcount;
 }
 
 int UserCount() const {
-	return users.size();
+	return usercount;
 }
 
 int ConsortiumMemberCount() const {
 	return cmembers.size();
 }
 
-LookupRequest& LookupReq(const TXSpec& lar) {
-	const auto& it = lookupreqs.find(lar);
-	if(it == lookupreqs.end()){
-		throw InvalidTXSpecException("unknown lookup auth req");
+// Number of distinct TXSpecs referenced by the ledger state
+size_t TXSpecCount() const {
+	return specs.size();
+}
+
+LookupRequest LookupReq(const TXSpec& lar) const {
+	const auto& r = Get<LookupRecord>(lar, "unknown lookup auth req");
+	LookupRequest ret(specs.Spec(r.el), specs.Spec(r.cm));
+	if(r.authorized){
+		ret.Authorize();
 	}
-	return it->second;
+	return ret;
 }
 
 void AddLookupReq(const TXSpec& larspec, const TXSpec& elspec, const TXSpec& cmspec) {
-	lookupreqs.emplace(larspec, LookupRequest{elspec, cmspec});
+	auto lar = Intern(larspec);
+	auto el = Intern(elspec);
+	auto cm = Intern(cmspec);
+	if(Claim(lar, LookupRecord{el, cm, false})){
+		++lookupreqcount;
+		undo.Record([this, lar](){
+			Unclaim(lar);
+			--lookupreqcount;
+		});
+	}
 }
 
-void AddExtLookup(const TXSpec& elspec) {
-	extlookups.insert(elspec);
+void AuthorizeLookupReq(const TXSpec& larspec) {
+	TXId lar;
+	auto& r = Get<LookupRecord>(larspec, "unknown lookup auth req", &lar);
+	if(!r.authorized){
+		undo.Record([this, lar](){
+			std::get<LookupRecord>(specs.Record(lar)).authorized = false;
+			--authorizedlookups;
+		});
+		r.authorized = true;
+		++authorizedlookups;
+	}
 }
 
-StatusDelegation& LookupDelegation(const TXSpec& psd) {
-	const auto& it = delegations.find(psd);
-	if(it == delegations.end()){
-		throw InvalidTXSpecException("unknown status delegation");
+void AddExtLookup(const TXSpec& elspec) {
+	auto el = Intern(elspec);
+	if(isextlookup.size() <= el){
+		isextlookup.resize(el + 1);
+	}
+	if(!isextlookup[el]){
+		isextlookup[el] = true;
+		extlookups.push_back(el);
+		undo.Record([this](){
+			isextlookup[extlookups.back()] = false;
+			extlookups.pop_back();
+		});
 	}
-	return it->second;
+}
+
+StatusDelegation LookupDelegation(const TXSpec& psd) const {
+	const auto& d = Get<DelegationRecord>(psd, "unknown status delegation");
+	return StatusDelegation(d.stype, specs.Spec(d.cm), specs.Spec(d.u));
 }
 
 void AddDelegation(const TXSpec& usdspec, const TXSpec& cmspec,
 			const TXSpec& uspec, int stype) {
-	delegations.emplace(usdspec, StatusDelegation{stype, cmspec, uspec});
+	auto usd = Intern(usdspec);
+	auto cm = Intern(cmspec);
+	auto u = Intern(uspec);
+	if(Claim(usd, DelegationRecord{stype, cm, u})){
+		++delegationcount;
+		undo.Record([this, usd](){
+			Unclaim(usd);
+			--delegationcount;
+		});
+	}
+}
+
+// Set the status of the user named by the status delegation usdspec, of the
+// delegated type, to the len bytes of JSON text at status. Equivalent to
+// SetUserStatus() with the results of LookupDelegation(), without copying
+// them out. The delegation and user are looked up first, throwing
+// InvalidTXSpecException if either is unknown; the text is then checked,
+// returning true (and changing nothing) if it isn't valid JSON.
+bool SetDelegatedStatus(const TXSpec& usdspec, const char* status, size_t len) {
+	const auto& d = Get<DelegationRecord>(usdspec, "unknown status delegation");
+	auto u = std::get_if<User>(&specs.Record(d.u));
+	if(u == nullptr){
+		throw InvalidTXSpecException("unknown user");
+	}
+	if(InvalidJSON(status, len)){
+		return true;
+	}
+	SetStatus(d.u, *u, d.stype, std::string(status, len));
+	return false;
 }
 
 void AddUser(const TXSpec& uspec, const TXSpec& cmspec) {
-	auto it = cmembers.find(cmspec);
-	if(it == cmembers.end()){
-		throw InvalidTXSpecException("unknown consortium member");
+	auto cm = Get<MemberRecord>(cmspec, "unknown consortium member").idx;
+	auto u = Intern(uspec);
+	bool added = Claim(u, User{});
+	if(added){
+		++usercount;
 	}
-	users.emplace(uspec, User{});
-	it->second.AddUser(uspec);
+	cmembers[cm].second.AddUser(u);
+	undo.Record([this, cm, u, added](){
+		cmembers[cm].second.RemoveLastUser();
+		if(added){
+			Unclaim(u);
+			--usercount;
+		}
+	});
+}
+
+void SetUserStatus(const TXSpec& uspec, int stype, const nlohmann::json& status) {
+	TXId uid;
+	auto& u = Get<User>(uspec, "unknown user", &uid);
+	SetStatus(uid, u, stype, status.dump());
+}
+
+// As above, with status the len bytes of valid JSON text at status
+void SetUserStatus(const TXSpec& uspec, int stype, const char* status, size_t len) {
+	TXId uid;
+	auto& u = Get<User>(uspec, "unknown user", &uid);
+	SetStatus(uid, u, stype, std::string(status, len));
 }
 
 const User& LookupUser(const TXSpec& u) const {
-	const auto& it = users.find(u);
-	if(it == users.end()){
-		throw InvalidTXSpecException("unknown user");
-	}
-	return it->second;
+	return Get<User>(u, "unknown user");
 }
 
 User& LookupUser(const TXSpec& u) {
-	const auto& it = users.find(u);
-	if(it == users.end()){
-		throw InvalidTXSpecException("unknown user");
-	}
-	return it->second;
+	return Get<User>(u, "unknown user");
 }
 
 void AddConsortiumMember(const TXSpec& cmspec, const nlohmann::json& json) {
-	cmembers.emplace(cmspec, Catena::ConsortiumMember{json});
+	auto cm = Intern(cmspec);
+	if(Claim(cm, MemberRecord{static_cast<unsigned>(cmembers.size())})){
+		cmembers.emplace_back(cm, Catena::ConsortiumMember{json});
+		undo.Record([this](){
+			Unclaim(cmembers.back().first);
+			cmembers.pop_back();
+		});
+	}
 }
 
 std::vector<ConsortiumMemberSummary> ConsortiumMembers() const {
 	std::vector<ConsortiumMemberSummary> ret;
-	for(auto it = std::begin(cmembers) ; it != std::end(cmembers); ++it){
-		ret.emplace_back(ConsortiumMemberSummary(it->first,
-				it->second.UserCount(), it->second.Payload()));
+	for(const auto& [id, cm] : cmembers){
+		ret.emplace_back(ConsortiumMemberSummary(specs.Spec(id),
+				cm.UserCount(), cm.Payload()));
 	}
+	// order of arrival is meaningless to viewers
+	std::sort(ret.begin(), ret.end(),
+		[](const ConsortiumMemberSummary& c1, const ConsortiumMemberSummary& c2){
+			return c1.cmspec < c2.cmspec;
+		});
 	return ret;
 }
 
 ConsortiumMemberSummary ConsortiumMember(const TXSpec& cmspec) const {
-	auto it = cmembers.find(cmspec);
-	if(it == cmembers.end()){
-		throw InvalidTXSpecException("unknown consortium member");
-	}
-	return ConsortiumMemberSummary(it->first, it->second.UserCount(),
-					it->second.Payload());
+	const auto& cm = Member(cmspec);
+	return ConsortiumMemberSummary(cmspec, cm.UserCount(), cm.Payload());
 }
 
 std::vector<UserSummary> ConsortiumUsers(const TXSpec& cmspec) const {
-	auto it = cmembers.find(cmspec);
-	if(it == cmembers.end()){
-		throw InvalidTXSpecException("unknown consortium member");
+	const auto& cm = Member(cmspec);
+	std::vector<UserSummary> ret;
+	for(auto u : cm.Users()){
+		ret.emplace_back(specs.Spec(u));
 	}
-	return it->second.Users();
+	return ret;
 }
 
 private:
-// We're using maps rather than unordered maps, but probably don't need to.
-// We could just hash TXSpecs, as we already do in TrustStore. With that said,
-// I see claims that std::map is usually more memory-efficient than
-// unordered_map. Both guarantee validity of pointers to container data.
-std::map<TXSpec, LookupRequest> lookupreqs;
-std::map<TXSpec, StatusDelegation> delegations;
-std::map<TXSpec, User> users;
-std::map<TXSpec, Catena::ConsortiumMember> cmembers;
-std::set<TXSpec> extlookups;
+struct LookupRecord {
+	TXId el; // ExternalLookupTX
+	TXId cm; // ConsortiumMemberTX
+	bool authorized; // Have we seen a LookupAuthTX?
+};
+
+struct DelegationRecord {
+	int stype;
+	TXId cm; // ConsortiumMemberTX
+	TXId u; // UserTX
 };
 
+struct MemberRecord {
+	unsigned idx; // into cmembers
+};
+
+// Stored with each TXSpec. A TXSpec names a single transaction, so it keys at
+// most one record.
+using SpecRecord = std::variant<std::monostate, MemberRecord, User,
+	DelegationRecord, LookupRecord>;
+
+int lookupreqcount = 0;
+int authorizedlookups = 0; // lookup requests with authorized set
+int delegationcount = 0;
+int usercount = 0;
+// in order of arrival
+std::vector<std::pair<TXId, Catena::ConsortiumMember>> cmembers;
+std::vector<TXId> extlookups;
+std::vector<bool> isextlookup; // indexed by TXId, possibly short
+TXSpecTable<SpecRecord> specs; // every TXSpec referenced by the ledger state
+UndoLog undo;
+
+// The id of spec, interning it if need be. Recorded before any mutation using
+// the id, so it is undone only after them.
+TXId Intern(const TXSpec& spec) {
+	bool added;
+	auto id = specs.Intern(spec, &added);
+	if(added){
+		undo.Record([this](){ specs.PopLast(); });
+	}
+	return id;
+}
+
+// Store rec as the record keyed by id. Returns false if it already has a
+// record of that type, and throws InvalidTXSpecException if it has one of
+// another type. Record additions must be undone in reverse order, which
+// UndoLog guarantees.
+template<typename T>
+bool Claim(TXId id, T rec) {
+	auto& r = specs.Record(id);
+	if(std::holds_alternative<T>(r)){
+		return false;
+	}
+	if(!std::holds_alternative<std::monostate>(r)){
+		throw InvalidTXSpecException("transaction already recorded with another type");
+	}
+	r.template emplace<T>(std::move(rec));
+	return true;
+}
+
+void Unclaim(TXId id) {
+	specs.Record(id) = std::monostate{};
+}
+
+// The record keyed by spec, should it be of type T, otherwise throwing
+// InvalidTXSpecException with msg. Sets *id to spec's id, should id be
+// non-null.
+template<typename T>
+const T& Get(const TXSpec& spec, const char* msg, TXId* id = nullptr) const {
+	auto r = specs.Find(spec, id);
+	auto t = r ? std::get_if<T>(r) : nullptr;
+	if(t == nullptr){
+		throw InvalidTXSpecException(msg);
+	}
+	return *t;
+}
+
+template<typename T>
+T& Get(const TXSpec& spec, const char* msg, TXId* id = nullptr) {
+	return const_cast<T&>(static_cast<const LedgerMap*>(this)->Get<T>(spec, msg, id));
 }
 
-namespace std {
-// Implement std::hash<TXSpec> so it can be used as key in e.g. unordered_maps.
-// Since TX hashes are already "random", use them as base (using the least
-// significant bytes, since some mining schemes require leading digits),
-// adding the (highly non-random, weighted towards low numbers) TX idx so that
-// one block's transactions all map to different buckers.
-template <>
-struct hash<Catena::TXSpec>{
-template <class T1, class T2>
-size_t operator()(const std::pair<T1, T2>& k) const {
-	// FIXME verify sizeof(sha) < KEYLEN (at compile time) (bit it will)
-	size_t sha;
-	memcpy(&sha, k.first.data() + k.first.size() - sizeof(sha), sizeof(sha));
-	return sha + k.second;
+const Catena::ConsortiumMember& Member(const TXSpec& cmspec) const {
+	return cmembers[Get<MemberRecord>(cmspec, "unknown consortium member").idx].second;
 }
+
+// Set status type stype of u, the user with id uid
+void SetStatus(TXId uid, User& u, int stype, std::string status) {
+	if(u.HasStatus(stype)){
+		undo.Record([this, uid, stype, old = u.StatusJSON(stype)](){
+			std::get<User>(specs.Record(uid)).SetStatus(stype, old);
+		});
+	}else{
+		undo.Record([this, uid, stype](){
+			std::get<User>(specs.Record(uid)).RemoveStatus(stype);
+		});
+	}
+	u.SetStatus(stype, std::move(status));
+}
+
+friend class Snapshot;
 };
+
 }
 
 #endif
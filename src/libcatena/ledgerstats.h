@@ -0,0 +1,78 @@
+#ifndef CATENA_LIBCATENA_LEDGERSTATS
+#define CATENA_LIBCATENA_LEDGERSTATS
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <type_traits>
+#include <libcatena/tx.h>
+
+namespace Catena {
+
+// Counts describing a ledger and the state built from it
+struct LedgerStats {
+	uint64_t blocks;
+	uint64_t bytes; // serialized chain, not including outstandings
+	uint64_t transactions;
+	std::array<uint64_t, TXTYPELIMIT> txtypes; // indexed by TXTypes, 0 for unknown
+	uint64_t pubkeys;
+	uint64_t members;
+	uint64_t users;
+	uint64_t extlookups;
+	uint64_t lookupreqs;
+	uint64_t authorizedlookups; // lookupreqs with a corresponding LookupAuth
+	uint64_t delegations;
+};
+
+// LedgerStats published by a single writer, and read without locking by any
+// number of threads. A sequence number (odd while a Store() is underway) lets
+// readers detect and retry torn reads, so each Load() is self-consistent.
+class LedgerCounters {
+public:
+LedgerCounters() :
+  sequence(0) {
+	for(auto& w : words){
+		w.store(0, std::memory_order_relaxed);
+	}
+}
+
+LedgerStats Load() const {
+	uint64_t raw[WORDS];
+	uint64_t seq;
+	do{
+		seq = sequence.load(std::memory_order_acquire);
+		for(size_t i = 0 ; i < WORDS ; ++i){
+			raw[i] = words[i].load(std::memory_order_relaxed);
+		}
+		std::atomic_thread_fence(std::memory_order_acquire);
+	}while((seq & 1) || seq != sequence.load(std::memory_order_relaxed));
+	LedgerStats s;
+	memcpy(&s, raw, sizeof(s));
+	return s;
+}
+
+void Store(const LedgerStats& s) {
+	uint64_t raw[WORDS];
+	memcpy(raw, &s, sizeof(s));
+	auto seq = sequence.load(std::memory_order_relaxed);
+	sequence.store(seq + 1, std::memory_order_relaxed);
+	std::atomic_thread_fence(std::memory_order_release);
+	for(size_t i = 0 ; i < WORDS ; ++i){
+		words[i].store(raw[i], std::memory_order_relaxed);
+	}
+	sequence.store(seq + 2, std::memory_order_release);
+}
+
+private:
+static_assert(std::is_trivially_copyable_v<LedgerStats> &&
+	sizeof(LedgerStats) % sizeof(uint64_t) == 0, "LedgerStats must be plain words");
+static constexpr size_t WORDS = sizeof(LedgerStats) / sizeof(uint64_t);
+
+std::atomic<uint64_t> sequence;
+std::array<std::atomic<uint64_t>, WORDS> words;
+};
+
+}
+
+#endif
@@ -2,48 +2,37 @@
 #include <libcatena/lookupauthreqtx.h>
 #include <libcatena/chain.h>
 #include <libcatena/hash.h>
+#include <libcatena/wire.h>
 
 namespace Catena {
 
 void LookupAuthReqTX::Extract(const unsigned char* data, unsigned len) {
-	if(len < 2){ // 16-bit signature length
-		throw TransactionException("no room for signature length");
-	}
-	siglen = nbo_to_ulong(data, 2);
-	data += 2;
-	len -= 2;
-	if(len < signerhash.size() + sizeof(signeridx)){
-		throw TransactionException("no room for signature spec");
-	}
-	memcpy(signerhash.data(), data, signerhash.size());
-	data += signerhash.size();
-	len -= signerhash.size();
-	signeridx = nbo_to_ulong(data, sizeof(signeridx));
-	data += sizeof(signeridx);
-	len -= sizeof(signeridx);
-	if(len < siglen || siglen > sizeof(signature)){
+	WireReader<TransactionException> r(data, len);
+	siglen = r.Int<2>("no room for signature length");
+	signerhash = r.Hash("no room for signature spec");
+	signeridx = r.Int<4>("no room for signature spec");
+	if(siglen > SIGLEN){
 		throw TransactionException("no room for signature");
 	}
-	memcpy(signature, data, siglen);
-	data += siglen;
-	len -= siglen;
-	if(len < signerhash.size() + 4){
-		throw TransactionException("no room for subject spec");
-	}
-	subjectidx = nbo_to_ulong(data + signerhash.size(), 4);
+	signature = r.Bytes(siglen, "no room for signature");
+	subjectidx = r.Peek<4>(signerhash.size(), "no room for subject spec");
 	// FIXME verify that subjectspec is valid? verify payload is valid JSON?
-	payload = std::unique_ptr<unsigned char[]>(new unsigned char[len]);
-	memcpy(payload.get(), data, len);
-	payloadlen = len;
+	payload = r.Data();
+	payloadlen = r.Left();
+}
+
+bool LookupAuthReqTX::SignatureCheckable(SignatureCheck* sc) const {
+	*sc = {{signerhash, signeridx}, payload, payloadlen, signature, siglen};
+	return true;
 }
 
 bool LookupAuthReqTX::Validate(TrustStore& tstore, LedgerMap& lmap) {
-	if(tstore.Verify({signerhash, signeridx}, payload.get(),
+	if(VerifySignature(tstore, {signerhash, signeridx}, payload,
 				payloadlen, signature, siglen)){
 		return true;
 	}
 	TXSpec elspec;
-	memcpy(elspec.first.data(), payload.get(), elspec.first.size());
+	memcpy(elspec.first.data(), payload, elspec.first.size());
 	elspec.second = subjectidx;
 	auto cmspec = TXSpec(signerhash, signeridx);
 	lmap.AddLookupReq({blockhash, txidx}, elspec, cmspec);
@@ -54,7 +43,7 @@ std::ostream& LookupAuthReqTX::TXOStream(std::ostream& s) const {
 	s << "LookupAuthReq (" << siglen << "b signature, " << payloadlen << "b payload)\n";
 	s << " requester: " << signerhash << "." << signeridx << "\n";
 	s << " subject: ";
-	hashOStream(s, payload.get()) << "." << subjectidx << "\n";
+	hashOStream(s, payload) << "." << subjectidx << "\n";
 	s << " payload: ";
 	std::copy(GetJSONPayload(), GetJSONPayload() + GetJSONPayloadLength(), std::ostream_iterator<char>(s, ""));
 	return s;
@@ -65,15 +54,13 @@ std::pair<std::unique_ptr<unsigned char[]>, size_t> LookupAuthReqTX::Serialize()
 	size_t len = 4 + siglen + signerhash.size() + sizeof(signeridx) +
 		payloadlen;
 	std::unique_ptr<unsigned char[]> ret(new unsigned char[len]);
-	auto data = TXType_to_nbo(TXTypes::LookupAuthReq, ret.get());
-	data = ulong_to_nbo(siglen, data, 2);
-	memcpy(data, signerhash.data(), signerhash.size());
-	data += signerhash.size();
-	data = ulong_to_nbo(signeridx, data, 4);
-	memcpy(data, signature, siglen);
-	data += siglen;
-	memcpy(data, payload.get(), payloadlen);
-	data += payloadlen;
+	WireWriter w(ret.get(), len);
+	w.Int<2>(static_cast<unsigned>(TXTypes::LookupAuthReq));
+	w.Int<2>(siglen);
+	w.Hash(signerhash);
+	w.Int<4>(signeridx);
+	w.Bytes(signature, siglen);
+	w.Bytes(payload, payloadlen);
 	return std::make_pair(std::move(ret), len);
 }
 
@@ -84,7 +71,7 @@ nlohmann::json LookupAuthReqTX::JSONify() const {
 	ss << signerhash << "." << signeridx;
 	ret["signerspec"] = ss.str();
 	ss.str(std::string());
-	hashOStream(ss, payload.get());
+	hashOStream(ss, payload);
 	ss << "." << subjectidx;
 	ret["subjectspec"] = ss.str();
 	auto pload = std::string(GetJSONPayload(), GetJSONPayloadLength());
@@ -93,34 +80,18 @@ nlohmann::json LookupAuthReqTX::JSONify() const {
 }
 
 void LookupAuthTX::Extract(const unsigned char* data, unsigned len) {
-	if(len < 2){ // 16-bit signature length
-		throw TransactionException("no room for signature length");
-	}
-	siglen = nbo_to_ulong(data, 2);
-	data += 2;
-	len -= 2;
-	if(len < signerhash.size() + sizeof(signeridx)){
-		throw TransactionException("no room for signature spec");
-	}
-	memcpy(signerhash.data(), data, signerhash.size());
-	data += signerhash.size();
-	len -= signerhash.size();
-	signeridx = nbo_to_ulong(data, sizeof(signeridx));
-	data += sizeof(signeridx);
-	len -= sizeof(signeridx);
-	if(len < siglen || siglen > sizeof(signature)){
+	WireReader<TransactionException> r(data, len);
+	siglen = r.Int<2>("no room for signature length");
+	signerhash = r.Hash("no room for signature spec");
+	signeridx = r.Int<4>("no room for signature spec");
+	if(siglen > SIGLEN){
 		throw TransactionException("no room for signature");
 	}
-	memcpy(signature, data, siglen);
-	data += siglen;
-	len -= siglen;
-	if(len == 0){
-		throw TransactionException("no room for payload");
-	}
+	signature = r.Bytes(siglen, "no room for signature");
+	r.Need(1, "no room for payload");
 	// FIXME verify that elspec is valid?
-	payload = std::unique_ptr<unsigned char[]>(new unsigned char[len]);
-	memcpy(payload.get(), data, len);
-	payloadlen = len;
+	payload = r.Data();
+	payloadlen = r.Left();
 }
 
 nlohmann::json LookupAuthTX::JSONify() const {
@@ -130,7 +101,7 @@ nlohmann::json LookupAuthTX::JSONify() const {
 	ss << signerhash << "." << signeridx;
 	ret["signerspec"] = ss.str();
 	ss.str(std::string());
-	HexOutput(ss, payload.get(), payloadlen);
+	HexOutput(ss, payload, payloadlen);
         ret["encpayload"] = ss.str();
 	return ret;
 }
@@ -139,15 +110,13 @@ std::pair<std::unique_ptr<unsigned char[]>, size_t> LookupAuthTX::Serialize() co
 	size_t len = 4 + siglen + signerhash.size() + sizeof(signeridx) +
 		payloadlen;
 	std::unique_ptr<unsigned char[]> ret(new unsigned char[len]);
-	auto data = TXType_to_nbo(TXTypes::LookupAuth, ret.get());
-	data = ulong_to_nbo(siglen, data, 2);
-	memcpy(data, signerhash.data(), signerhash.size());
-	data += signerhash.size();
-	data = ulong_to_nbo(signeridx, data, 4);
-	memcpy(data, signature, siglen);
-	data += siglen;
-	memcpy(data, payload.get(), payloadlen);
-	data += payloadlen;
+	WireWriter w(ret.get(), len);
+	w.Int<2>(static_cast<unsigned>(TXTypes::LookupAuth));
+	w.Int<2>(siglen);
+	w.Hash(signerhash);
+	w.Int<4>(signeridx);
+	w.Bytes(signature, siglen);
+	w.Bytes(payload, payloadlen);
 	return std::make_pair(std::move(ret), len);
 }
 
@@ -162,23 +131,23 @@ std::ostream& LookupAuthTX::TXOStream(std::ostream& s) const {
 bool LookupAuthTX::Validate(TrustStore& tstore, LedgerMap& lmap) {
 	// Bears a TXSpec for a LookupAuthReq TX; need to check it to get the
 	// ExternalLookup with the actual signing key.
-	auto& lar = lmap.LookupReq({signerhash, signeridx});
+	const auto& lar = lmap.LookupReq({signerhash, signeridx});
 	TXSpec elspec = lar.ELSpec();
-	if(tstore.Verify(elspec, payload.get(), payloadlen, signature, siglen)){
+	if(VerifySignature(tstore, elspec, payload, payloadlen, signature, siglen)){
 		return true;
 	}
 	/* FIXME catch exceptions here, maybe do this in Extract()?
 	auto cmspec = lar.CMSpec();
 	auto key = tstore.DeriveSymmetricKey(elspec, cmspec);
-	auto ptext = tstore.Decrypt(payload.get(), payloadlen, key);
+	auto ptext = tstore.Decrypt(payload, payloadlen, key);
 	if(ptext.second < elspec.first.size() + 4){
 		throw BlockValidationException("plaintext too small for txspec");
 	}
 	TXSpec uspec;
 	memcpy(uspec.first.data(), ptext.first.get(), uspec.first.size());
-	uspec.second = nbo_to_ulong(ptext.first.get() + uspec.first.size(), 4);
+	uspec.second = LoadNBO<4>(ptext.first.get() + uspec.first.size());
 	// FIXME do something with uspec? verify it is patient? */
-	lar.Authorize();
+	lmap.AuthorizeLookupReq({signerhash, signeridx});
 	return false;
 }
 
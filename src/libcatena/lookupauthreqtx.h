@@ -5,7 +5,7 @@
 
 namespace Catena {
 
-class LookupAuthReqTX : public Transaction {
+class LookupAuthReqTX final : public Transaction {
 public:
 LookupAuthReqTX() = default;
 LookupAuthReqTX(const CatenaHash& hash, unsigned idx) : Transaction(hash, idx) {}
@@ -14,21 +14,22 @@ bool Validate(TrustStore& tstore, LedgerMap& lmap) override;
 std::ostream& TXOStream(std::ostream& s) const override;
 std::pair<std::unique_ptr<unsigned char[]>, size_t> Serialize() const override;
 nlohmann::json JSONify() const override;
+bool SignatureCheckable(SignatureCheck* sc) const override;
 
 private:
-unsigned char signature[SIGLEN];
+const unsigned char* signature = nullptr; // within the lexed transaction
 
 // specifier of who signed this tx
 CatenaHash signerhash;
 uint32_t signeridx; // must be exactly 32 bits for serialization
 size_t siglen; // length of signature, up to SIGLEN
-std::unique_ptr<unsigned char[]> payload;
+const unsigned char* payload = nullptr;
 uint32_t subjectidx; // subject idx of request (ExternalLookupTX), from payload
 size_t payloadlen; // total length of signed payload
 
 const char*
 GetJSONPayload() const {
-	return reinterpret_cast<const char*>(payload.get()) + 32 + 4;
+	return reinterpret_cast<const char*>(payload) + 32 + 4;
 }
 
 size_t GetJSONPayloadLength() const {
@@ -37,7 +38,7 @@ size_t GetJSONPayloadLength() const {
 
 };
 
-class LookupAuthTX : public Transaction {
+class LookupAuthTX final : public Transaction {
 public:
 LookupAuthTX() = default;
 LookupAuthTX(const CatenaHash& hash, unsigned idx) : Transaction(hash, idx) {}
@@ -53,12 +54,12 @@ enum class Keytype {
 };
 
 private:
-unsigned char signature[SIGLEN];
+const unsigned char* signature = nullptr; // within the lexed transaction
 
 CatenaHash signerhash; // specifier of who signed this tx
 uint32_t signeridx; // must be exactly 32 bits for serialization
 size_t siglen; // length of signature, up to SIGLEN
-std::unique_ptr<unsigned char[]> payload;
+const unsigned char* payload = nullptr;
 size_t payloadlen; // total length of signed payload
 
 };
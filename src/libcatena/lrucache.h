@@ -0,0 +1,108 @@
+#ifndef CATENA_LIBCATENA_LRUCACHE
+#define CATENA_LIBCATENA_LRUCACHE
+
+#include <list>
+#include <mutex>
+#include <cstdint>
+#include <unordered_map>
+
+namespace Catena {
+
+struct LRUStats {
+	uint64_t hits;
+	uint64_t misses;
+	size_t entries;
+	size_t capacity;
+};
+
+// A least-recently-used map holding at most capacity entries, for values
+// which can always be rebuilt from elsewhere. Copies start out empty. Safe for
+// use from multiple threads; values ought be cheap to copy (e.g. shared_ptrs).
+template<typename K, typename V>
+class LRUCache {
+public:
+LRUCache(size_t capacity) :
+  capacity(capacity),
+  hits(0),
+  misses(0) {}
+
+LRUCache(const LRUCache& lc) :
+  LRUCache(lc.Capacity()) {}
+
+LRUCache& operator=(const LRUCache& lc) {
+	if(this != &lc){
+		auto cap = lc.Capacity();
+		std::lock_guard<std::mutex> guard(lock);
+		lru.clear();
+		entries.clear();
+		capacity = cap;
+	}
+	return *this;
+}
+
+// Returns false (and counts a miss) if k isn't cached
+bool Get(const K& k, V* v) {
+	std::lock_guard<std::mutex> guard(lock);
+	auto it = entries.find(k);
+	if(it == entries.end()){
+		++misses;
+		return false;
+	}
+	++hits;
+	lru.splice(lru.begin(), lru, it->second);
+	*v = it->second->second;
+	return true;
+}
+
+// Insert k, evicting the least recently used entries as necessary. If k is
+// already present (say, having raced with another thread), it is kept.
+void Put(const K& k, V v) {
+	std::lock_guard<std::mutex> guard(lock);
+	if(capacity == 0 || entries.find(k) != entries.end()){
+		return;
+	}
+	while(lru.size() >= capacity){
+		entries.erase(lru.back().first);
+		lru.pop_back();
+	}
+	lru.emplace_front(k, std::move(v));
+	entries.emplace(k, lru.begin());
+}
+
+void Erase(const K& k) {
+	std::lock_guard<std::mutex> guard(lock);
+	auto it = entries.find(k);
+	if(it != entries.end()){
+		lru.erase(it->second);
+		entries.erase(it);
+	}
+}
+
+void Clear() {
+	std::lock_guard<std::mutex> guard(lock);
+	lru.clear();
+	entries.clear();
+}
+
+size_t Capacity() const {
+	std::lock_guard<std::mutex> guard(lock);
+	return capacity;
+}
+
+LRUStats Stats() const {
+	std::lock_guard<std::mutex> guard(lock);
+	return LRUStats{hits, misses, entries.size(), capacity};
+}
+
+private:
+mutable std::mutex lock;
+size_t capacity;
+uint64_t hits;
+uint64_t misses;
+std::list<std::pair<K, V>> lru; // most recently used at the front
+std::unordered_map<K, typename std::list<std::pair<K, V>>::iterator> entries;
+};
+
+}
+
+#endif
@@ -1,53 +1,45 @@
 #include <iostream> // FIXME convert std::cerr to exceptions
 #include <libcatena/utility.h>
 #include <libcatena/member.h>
+#include <libcatena/wire.h>
 
 namespace Catena {
 
 void ConsortiumMemberTX::Extract(const unsigned char* data, unsigned len){
-	if(len < 2){ // 16-bit signature length
-		throw TransactionException("no room for signature length");
-	}
-	siglen = nbo_to_ulong(data, 2);
-	data += 2;
-	len -= 2;
-	if(len < signerhash.size() + sizeof(signeridx)){
-		throw TransactionException("no room for signature spec");
-	}
-	memcpy(signerhash.data(), data, signerhash.size());
-	data += signerhash.size();
-	len -= signerhash.size();
-	signeridx = nbo_to_ulong(data, sizeof(signeridx));
-	data += sizeof(signeridx);
-	len -= sizeof(signeridx);
-	if(len < siglen || siglen > sizeof(signature)){
+	WireReader<TransactionException> r(data, len);
+	siglen = r.Int<2>("no room for signature length");
+	signerhash = r.Hash("no room for signature spec");
+	signeridx = r.Int<4>("no room for signature spec");
+	if(siglen > SIGLEN){
 		throw TransactionException("no room for signature");
 	}
-	memcpy(signature, data, siglen);
-	data += siglen;
-	len -= siglen;
-	if(len < 2){
-		throw TransactionException("no room for key length");
-	}
-	keylen = nbo_to_ulong(data, 2);
-	if(keylen + 2 > len){
-		throw TransactionException("no room for key");
-	}
+	signature = r.Bytes(siglen, "no room for signature");
+	keylen = r.Peek<2>(0, "no room for key length");
+	r.Need(keylen + 2, "no room for key");
 	// FIXME verify that key is valid?
 	// Key length is part of the signed payload, so don't advance data
-	payload = std::unique_ptr<unsigned char[]>(new unsigned char[len]);
-	memcpy(payload.get(), data, len);
-	payloadlen = len;
+	payload = r.Data();
+	payloadlen = r.Left();
+}
+
+bool ConsortiumMemberTX::SignatureCheckable(SignatureCheck* sc) const {
+	*sc = {{signerhash, signeridx}, payload, payloadlen, signature, siglen};
+	return true;
+}
+
+bool ConsortiumMemberTX::IntroducedKey(const unsigned char** key, size_t* klen) const {
+	*key = payload + 2;
+	*klen = keylen;
+	return true;
 }
 
 bool ConsortiumMemberTX::Validate(TrustStore& tstore, LedgerMap& lmap){
-	if(tstore.Verify({signerhash, signeridx}, payload.get(),
+	if(VerifySignature(tstore, {signerhash, signeridx}, payload,
 				payloadlen, signature, siglen)){
 		return true;
 	}
 	auto jsonstr = std::string(GetJSONPayload(), GetJSONPayloadLength());
-	Keypair kp(payload.get() + 2, keylen);
-	tstore.AddKey(&kp, {blockhash, txidx});
+	tstore.AddKey(payload + 2, keylen, {blockhash, txidx});
 	lmap.AddConsortiumMember({blockhash, txidx}, nlohmann::json::parse(jsonstr));
 	return false;
 }
@@ -66,15 +58,13 @@ ConsortiumMemberTX::Serialize() const {
 	size_t len = 4 + siglen + signerhash.size() + sizeof(signeridx) +
 		payloadlen;
 	std::unique_ptr<unsigned char[]> ret(new unsigned char[len]);
-	auto data = TXType_to_nbo(TXTypes::ConsortiumMember, ret.get());
-	data = ulong_to_nbo(siglen, data, 2);
-	memcpy(data, signerhash.data(), signerhash.size());
-	data += signerhash.size();
-	data = ulong_to_nbo(signeridx, data, 4);
-	memcpy(data, signature, siglen);
-	data += siglen;
-	memcpy(data, payload.get(), payloadlen);
-	data += payloadlen;
+	WireWriter w(ret.get(), len);
+	w.Int<2>(static_cast<unsigned>(TXTypes::ConsortiumMember));
+	w.Int<2>(siglen);
+	w.Hash(signerhash);
+	w.Int<4>(signeridx);
+	w.Bytes(signature, siglen);
+	w.Bytes(payload, payloadlen);
 	return std::make_pair(std::move(ret), len);
 }
 
@@ -6,7 +6,7 @@
 
 namespace Catena {
 
-class ConsortiumMemberTX : public Transaction {
+class ConsortiumMemberTX final : public Transaction {
 public:
 ConsortiumMemberTX() = default;
 ConsortiumMemberTX(const CatenaHash& hash, unsigned idx) : Transaction(hash, idx) {}
@@ -15,26 +15,28 @@ bool Validate(TrustStore& tstore, LedgerMap& lmap) override;
 std::ostream& TXOStream(std::ostream& s) const override;
 std::pair<std::unique_ptr<unsigned char[]>, size_t> Serialize() const override;
 nlohmann::json JSONify() const override;
+bool SignatureCheckable(SignatureCheck* sc) const override;
+bool IntroducedKey(const unsigned char** key, size_t* keylen) const override;
 
 private:
-unsigned char signature[SIGLEN];
+const unsigned char* signature = nullptr; // within the lexed transaction
 
 // specifier of who signed this tx
 CatenaHash signerhash;
 uint32_t signeridx; // must be exactly 32 bits for serialization
 size_t siglen; // length of signature, up to SIGLEN
-std::unique_ptr<unsigned char[]> payload;
+const unsigned char* payload = nullptr;
 size_t keylen; // length of public key
 size_t payloadlen; // total length of signed payload
 
 const unsigned char*
 GetPubKey() const {
-	return payload.get() + 2;
+	return payload + 2;
 }
 
 const char*
 GetJSONPayload() const {
-	return reinterpret_cast<const char*>(payload.get()) + 2 + keylen;
+	return reinterpret_cast<const char*>(payload) + 2 + keylen;
 }
 
 size_t GetJSONPayloadLength() const {
@@ -0,0 +1,48 @@
+#include <fcntl.h>
+#include <fstream>
+#include <unistd.h>
+#include <algorithm>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <libcatena/mmap.h>
+
+namespace Catena {
+
+// Reserving address space is cheap, and remapping means rereading (or at least
+// refaulting) the file, so err well on the side of a large reservation.
+constexpr size_t MINRESERVE = 64u * 1024 * 1024;
+
+MappedFile::MappedFile(const std::string& fname, size_t reserve) {
+	int fd = open(fname.c_str(), O_RDONLY | O_CLOEXEC);
+	if(fd < 0){
+		throw std::ifstream::failure("couldn't open file");
+	}
+	struct stat stats;
+	if(fstat(fd, &stats)){
+		close(fd);
+		throw std::ifstream::failure("couldn't fstat file");
+	}
+	if((stats.st_mode & S_IFMT) != S_IFREG){
+		close(fd);
+		throw std::ifstream::failure("not a regular file");
+	}
+	len = stats.st_size;
+	reserved = std::max({reserve, len * 2, MINRESERVE});
+	size_t pgsize = sysconf(_SC_PAGESIZE);
+	reserved = (reserved + pgsize - 1) / pgsize * pgsize;
+	// Pages beyond the end of the file can't be touched (SIGBUS), but become
+	// valid as the file grows. We never look past len.
+	auto m = mmap(nullptr, reserved, PROT_READ, MAP_SHARED, fd, 0);
+	close(fd);
+	if(m == MAP_FAILED){
+		throw std::ifstream::failure("couldn't mmap file");
+	}
+	map = static_cast<const unsigned char*>(m);
+}
+
+MappedFile::~MappedFile() {
+	munmap(const_cast<unsigned char*>(map), reserved);
+}
+
+}
@@ -0,0 +1,56 @@
+#ifndef CATENA_LIBCATENA_MMAP
+#define CATENA_LIBCATENA_MMAP
+
+#include <string>
+#include <cstddef>
+
+namespace Catena {
+
+// A read-only, shared mapping of a regular file. Address space is reserved
+// beyond the end of the file, so that data later appended to the file can be
+// made visible via Extend() without moving the mapping (and thus without
+// invalidating pointers into it). Throws std::ifstream::failure on errors, as
+// does ReadBinaryFile().
+class MappedFile {
+public:
+MappedFile() = delete;
+MappedFile(const MappedFile&) = delete;
+MappedFile& operator=(const MappedFile&) = delete;
+
+// At least reserve bytes of address space will be reserved, and always
+// somewhat more than the current length of the file.
+MappedFile(const std::string& fname, size_t reserve = 0);
+~MappedFile();
+
+const unsigned char* Data() const {
+	return map;
+}
+
+// Number of valid bytes in the mapping
+size_t Size() const {
+	return len;
+}
+
+size_t Capacity() const {
+	return reserved;
+}
+
+// The underlying file has grown to newlen bytes. Returns false if newlen
+// exceeds our reservation, in which case a new MappedFile is necessary.
+bool Extend(size_t newlen) {
+	if(newlen > reserved){
+		return false;
+	}
+	len = newlen;
+	return true;
+}
+
+private:
+const unsigned char* map;
+size_t len;
+size_t reserved;
+};
+
+}
+
+#endif
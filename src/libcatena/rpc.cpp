@@ -734,7 +734,11 @@ void RPCService::HandleAdvertiseNodes(const Proto::AdvertiseNodes::Reader& reade
 void RPCService::HandleBroadcastTX(const Proto::BroadcastTX::Reader& reader) {
   auto b = reader.getTx().asBytes();
   CatenaHash ch; // FIXME don't know the block hash yet!
-  auto tx = Transaction::LexTX(b.begin(), b.size(), ch, 0); // FIXME see above
+  // the message won't outlive the transaction, which views its bytes
+  std::shared_ptr<unsigned char> txbuf(new unsigned char[b.size()],
+                                       std::default_delete<unsigned char[]>());
+  memcpy(txbuf.get(), b.begin(), b.size());
+  auto tx = Transaction::LexTX(txbuf.get(), b.size(), ch, 0, txbuf); // FIXME see above
   try{
     ledger.AddTransaction(std::move(tx));
   }catch(TransactionException& e){
@@ -0,0 +1,76 @@
+#include <vector>
+#include <libcatena/sigcache.h>
+#include <libcatena/wire.h>
+
+namespace Catena {
+
+SigCache::SigCache(const SigCache& sc) :
+  hits(0),
+  misses(0) {
+	std::lock_guard<std::mutex> guard(sc.lock);
+	capacity = sc.capacity;
+	order = sc.order;
+	entries = sc.entries;
+}
+
+SigCache& SigCache::operator=(const SigCache& sc) {
+	if(this != &sc){
+		std::scoped_lock guard(lock, sc.lock);
+		capacity = sc.capacity;
+		order = sc.order;
+		entries = sc.entries;
+	}
+	return *this;
+}
+
+// The signed data is hashed separately, so the signature and signer needn't
+// be copied alongside a potentially large payload.
+CatenaHash SigCache::Digest(const TXSpec& signer, const unsigned char* in,
+		size_t inlen, const unsigned char* sig, size_t siglen) {
+	std::vector<unsigned char> buf(HASHLEN * 2 + 4 + 4 + siglen);
+	WireWriter w(buf.data(), buf.size());
+	w.Spec(signer);
+	w.Int<4>(siglen);
+	w.Bytes(sig, siglen);
+	CatenaHash inhash;
+	catenaHash(in, inlen, inhash);
+	w.Hash(inhash);
+	CatenaHash ret;
+	catenaHash(buf.data(), buf.size(), ret);
+	return ret;
+}
+
+bool SigCache::Contains(const CatenaHash& digest){
+	std::lock_guard<std::mutex> guard(lock);
+	if(entries.find(digest) == entries.end()){
+		++misses;
+		return false;
+	}
+	++hits;
+	return true;
+}
+
+void SigCache::Insert(const CatenaHash& digest){
+	std::lock_guard<std::mutex> guard(lock);
+	if(capacity == 0 || !entries.insert(digest).second){
+		return;
+	}
+	order.push_back(digest);
+	while(order.size() > capacity){
+		entries.erase(order.front());
+		order.pop_front();
+	}
+}
+
+void SigCache::Clear(){
+	std::lock_guard<std::mutex> guard(lock);
+	order.clear();
+	entries.clear();
+}
+
+SigCacheStats SigCache::Stats() const {
+	std::lock_guard<std::mutex> guard(lock);
+	return SigCacheStats{hits, misses, entries.size(), capacity};
+}
+
+}
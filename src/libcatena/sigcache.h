@@ -0,0 +1,60 @@
+#ifndef CATENA_LIBCATENA_SIGCACHE
+#define CATENA_LIBCATENA_SIGCACHE
+
+#include <deque>
+#include <mutex>
+#include <cstdint>
+#include <unordered_set>
+#include <libcatena/hash.h>
+
+namespace Catena {
+
+struct SigCacheStats {
+	uint64_t hits;
+	uint64_t misses;
+	size_t entries;
+	size_t capacity;
+};
+
+// A record of signatures known to verify, holding at most capacity entries
+// and evicting the oldest first. Entries are digests of the signer's TXSpec,
+// the signature, and the signed data, so a hit means this exact check has
+// already passed. Safe for use from multiple threads.
+class SigCache {
+public:
+static constexpr size_t DEFAULT_CAPACITY = 65536;
+
+SigCache(size_t capacity = DEFAULT_CAPACITY) :
+  capacity(capacity),
+  hits(0),
+  misses(0) {}
+
+// Copies take the contents and capacity, but not the statistics
+SigCache(const SigCache& sc);
+SigCache& operator=(const SigCache& sc);
+
+// The cache key for a verification of sig over in by signer
+static CatenaHash Digest(const TXSpec& signer, const unsigned char* in,
+		size_t inlen, const unsigned char* sig, size_t siglen);
+
+// Returns true (and counts a hit) if digest is cached
+bool Contains(const CatenaHash& digest);
+
+void Insert(const CatenaHash& digest);
+
+void Clear();
+
+SigCacheStats Stats() const;
+
+private:
+mutable std::mutex lock;
+size_t capacity;
+uint64_t hits;
+uint64_t misses;
+std::deque<CatenaHash> order; // oldest at the front
+std::unordered_set<CatenaHash> entries;
+};
+
+}
+
+#endif
@@ -0,0 +1,232 @@
+#include <cstring>
+#include <sys/stat.h>
+#include <libcatena/jsoncheck.h>
+#include <libcatena/snapshot.h>
+#include <libcatena/utility.h>
+#include <libcatena/hash.h>
+#include <libcatena/wire.h>
+
+namespace Catena {
+
+constexpr unsigned Snapshot::SLOTS;
+
+// Snapshot format (all integers big-endian):
+//  8-byte magic, 4-byte version, 4-byte height, 32-byte hash of last block
+//  LedgerMap: external lookups, consortium members (with their users), users
+//   (with their statuses), status delegations, and lookup requests, each
+//   preceded by a 4-byte count. JSON is stored as serialized text.
+//  TrustStore: 4-byte count, then TXSpec and PEM public key for each
+//  32-byte hash of everything preceding
+namespace {
+
+const unsigned char SNAPMAGIC[8] = { 'C', 'A', 'T', 'E', 'N', 'A', 'S', 'N', };
+constexpr unsigned SNAPVERSION = 0;
+
+class SnapWriter {
+public:
+template<unsigned BYTES>
+void Int(uint64_t val) {
+	auto off = buf.size();
+	buf.resize(off + BYTES);
+	StoreNBO<BYTES>(val, buf.data() + off);
+}
+
+void Bytes(const void* data, size_t len) {
+	auto d = static_cast<const unsigned char*>(data);
+	buf.insert(buf.end(), d, d + len);
+}
+
+void Spec(const TXSpec& spec) {
+	Bytes(spec.first.data(), spec.first.size());
+	Int<4>(spec.second);
+}
+
+void Str(const std::string& s) {
+	Int<4>(s.size());
+	Bytes(s.data(), s.size());
+}
+
+std::vector<unsigned char> buf;
+};
+
+// Throws ConvertInputException on truncated input
+class SnapReader : public WireReader<ConvertInputException> {
+public:
+SnapReader(const unsigned char* data, size_t len) :
+  WireReader(data, len, "truncated snapshot") {}
+
+std::string Str() {
+	auto len = Int<4>();
+	return std::string(reinterpret_cast<const char*>(Bytes(len)), len);
+}
+};
+
+}
+
+std::string Snapshot::FileName(const std::string& ledger, unsigned slot){
+	struct stat st;
+	if(stat(ledger.c_str(), &st) == 0 && S_ISDIR(st.st_mode)){
+		return ledger + "/state.snap" + std::to_string(slot);
+	}
+	return ledger + ".snap" + std::to_string(slot);
+}
+
+void Snapshot::Write(const std::string& fname, const LedgerAnchor& anchor,
+			const LedgerMap& lmap, const TrustStore& tstore){
+	SnapWriter w;
+	w.Bytes(SNAPMAGIC, sizeof(SNAPMAGIC));
+	w.Int<4>(SNAPVERSION);
+	w.Int<4>(anchor.height);
+	w.Bytes(anchor.hash.data(), anchor.hash.size());
+	w.Int<4>(lmap.extlookups.size());
+	for(const auto& el : lmap.extlookups){
+		w.Spec(lmap.specs.Spec(el));
+	}
+	w.Int<4>(lmap.cmembers.size());
+	for(const auto& [id, cm] : lmap.cmembers){
+		w.Spec(lmap.specs.Spec(id));
+		w.Str(cm.payload.dump());
+		w.Int<4>(cm.users.size());
+		for(const auto& u : cm.users){
+			w.Spec(lmap.specs.Spec(u));
+		}
+	}
+	// users, delegations, and lookup requests live with their specs, in order
+	// of interning, and thus of arrival
+	w.Int<4>(lmap.usercount);
+	for(TXId id = 0 ; id < lmap.specs.size() ; ++id){
+		if(auto u = std::get_if<User>(&lmap.specs.Record(id))){
+			w.Spec(lmap.specs.Spec(id));
+			w.Int<4>(u->statuses.size());
+			for(const auto& s : u->statuses){
+				w.Int<4>(static_cast<unsigned>(s.first));
+				w.Str(s.second);
+			}
+		}
+	}
+	w.Int<4>(lmap.delegationcount);
+	for(TXId id = 0 ; id < lmap.specs.size() ; ++id){
+		if(auto d = std::get_if<LedgerMap::DelegationRecord>(&lmap.specs.Record(id))){
+			w.Spec(lmap.specs.Spec(id));
+			w.Int<4>(static_cast<unsigned>(d->stype));
+			w.Spec(lmap.specs.Spec(d->cm));
+			w.Spec(lmap.specs.Spec(d->u));
+		}
+	}
+	w.Int<4>(lmap.lookupreqcount);
+	for(TXId id = 0 ; id < lmap.specs.size() ; ++id){
+		if(auto lr = std::get_if<LedgerMap::LookupRecord>(&lmap.specs.Record(id))){
+			w.Spec(lmap.specs.Spec(id));
+			w.Int<1>(lr->authorized);
+			w.Spec(lmap.specs.Spec(lr->el));
+			w.Spec(lmap.specs.Spec(lr->cm));
+		}
+	}
+	w.Int<4>(tstore.keys.size());
+	for(const auto& k : tstore.keys){
+		w.Spec(k.first);
+		w.Str(k.second.pem ? *k.second.pem : k.second.kp->PubkeyPEM());
+	}
+	CatenaHash digest;
+	catenaHash(w.buf.data(), w.buf.size(), digest);
+	w.Bytes(digest.data(), digest.size());
+	ReplaceBinaryFile(fname, w.buf.data(), w.buf.size());
+}
+
+bool Snapshot::Read(const std::string& fname, LedgerAnchor* anchor,
+			LedgerMap& lmap, TrustStore& tstore){
+	size_t len;
+	std::unique_ptr<unsigned char[]> snap;
+	try{
+		snap = ReadBinaryFile(fname, &len);
+	}catch(const std::ifstream::failure&){
+		return true;
+	}
+	if(len < sizeof(SNAPMAGIC) + 8 + HASHLEN * 2){
+		return true;
+	}
+	CatenaHash digest;
+	catenaHash(snap.get(), len - HASHLEN, digest);
+	if(memcmp(digest.data(), snap.get() + len - HASHLEN, HASHLEN)){
+		return true;
+	}
+	if(memcmp(snap.get(), SNAPMAGIC, sizeof(SNAPMAGIC))){
+		return true;
+	}
+	SnapReader r(snap.get() + sizeof(SNAPMAGIC), len - sizeof(SNAPMAGIC) - HASHLEN);
+	LedgerMap new_lmap;
+	TrustStore new_tstore = tstore;
+	LedgerAnchor new_anchor;
+	try{
+		if(r.Int<4>() != SNAPVERSION){
+			return true;
+		}
+		new_anchor.height = r.Int<4>();
+		new_anchor.hash = r.Hash();
+		if(new_anchor.height == 0){
+			return true;
+		}
+		for(auto count = r.Int<4>() ; count ; --count){
+			new_lmap.AddExtLookup(r.Spec());
+		}
+		for(auto count = r.Int<4>() ; count ; --count){
+			auto cmspec = r.Spec();
+			new_lmap.AddConsortiumMember(cmspec, nlohmann::json::parse(r.Str()));
+			for(auto ucount = r.Int<4>() ; ucount ; --ucount){
+				new_lmap.AddUser(r.Spec(), cmspec);
+			}
+		}
+		for(auto count = r.Int<4>() ; count ; --count){
+			// every user was introduced by its consortium member(s)
+			auto uspec = r.Spec();
+			for(auto scount = r.Int<4>() ; scount ; --scount){
+				int stype = static_cast<int>(r.Int<4>());
+				auto status = r.Str();
+				if(InvalidJSON(status.data(), status.size())){
+					return true;
+				}
+				new_lmap.SetUserStatus(uspec, stype, status.data(), status.size());
+			}
+		}
+		for(auto count = r.Int<4>() ; count ; --count){
+			auto usdspec = r.Spec();
+			int stype = static_cast<int>(r.Int<4>());
+			auto cmspec = r.Spec();
+			auto uspec = r.Spec();
+			new_lmap.AddDelegation(usdspec, cmspec, uspec, stype);
+		}
+		for(auto count = r.Int<4>() ; count ; --count){
+			auto larspec = r.Spec();
+			bool authorized = r.Int<1>();
+			auto elspec = r.Spec();
+			auto cmspec = r.Spec();
+			new_lmap.AddLookupReq(larspec, elspec, cmspec);
+			if(authorized){
+				new_lmap.AuthorizeLookupReq(larspec);
+			}
+		}
+		for(auto count = r.Int<4>() ; count ; --count){
+			auto kspec = r.Spec();
+			auto pem = r.Str();
+			new_tstore.RestoreKey(reinterpret_cast<const unsigned char*>(pem.data()),
+					pem.size(), kspec);
+		}
+		if(r.Left()){
+			return true;
+		}
+	}catch(const ConvertInputException&){
+		return true;
+	}catch(const KeypairException&){
+		return true;
+	}catch(const InvalidTXSpecException&){
+		return true;
+	}catch(const nlohmann::json::exception&){
+		return true;
+	}
+	*anchor = new_anchor;
+	lmap = std::move(new_lmap);
+	tstore = new_tstore;
+	return false;
+}
+
+}
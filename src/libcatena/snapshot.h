@@ -0,0 +1,37 @@
+#ifndef CATENA_LIBCATENA_SNAPSHOT
+#define CATENA_LIBCATENA_SNAPSHOT
+
+#include <string>
+#include <libcatena/truststore.h>
+#include <libcatena/ledgermap.h>
+#include <libcatena/block.h>
+
+namespace Catena {
+
+// A point-in-time image of the state built by replaying a ledger (the
+// LedgerMap, and the public keys of the TrustStore), tagged with the last
+// block it reflects. Loading a snapshot means only later blocks need be
+// replayed. Private keys are never written.
+class Snapshot {
+public:
+// Each ledger has this many snapshot files, reused oldest first
+static constexpr unsigned SLOTS = 2;
+
+// ledger.snapN for a single file, dir/state.snapN for a segmented ledger
+static std::string FileName(const std::string& ledger, unsigned slot);
+
+// Throws std::ofstream::failure on I/O error. The file is replaced
+// atomically, so an existing snapshot survives a failed write.
+static void Write(const std::string& fname, const LedgerAnchor& anchor,
+		const LedgerMap& lmap, const TrustStore& tstore);
+
+// Returns true if the snapshot is missing, fails its digest check, or can't
+// be parsed, in which case lmap and tstore are untouched. Otherwise, lmap is
+// replaced, and the snapshot's keys are added to tstore.
+static bool Read(const std::string& fname, LedgerAnchor* anchor,
+		LedgerMap& lmap, TrustStore& tstore);
+};
+
+}
+
+#endif
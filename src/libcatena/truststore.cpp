@@ -11,45 +11,152 @@ static constexpr size_t IVSIZE = 16;
 std::ostream& operator<<(std::ostream& s, const TrustStore& ts){
 	for(const auto& k : ts.keys){
 		const KeyLookup& kl = k.first;
-		const Keypair& kp = k.second;
-		if(kp.HasPrivateKey()){
+		auto kp = ts.Decode(kl, k.second);
+		if(kp && kp->HasPrivateKey()){
 			s << "(*) ";
 		}
 		HexOutput(s, kl.first) << "." << kl.second << "\n";
-		s << kp;
+		if(kp){
+			s << *kp;
+		}else{
+			s << " invalid key";
+		}
 	}
 	return s;
 }
 
-void TrustStore::AddKey(const Keypair* kp, const KeyLookup& kidx){
+TrustStore::KeyEntry TrustStore::Encoded(const unsigned char* pem, size_t len){
+	auto p = std::make_shared<const std::string>(reinterpret_cast<const char*>(pem), len);
+	return KeyEntry{nullptr, *pems.insert(std::move(p)).first};
+}
+
+std::shared_ptr<const Keypair>
+TrustStore::Decode(const KeyLookup& kidx, const KeyEntry& entry) const {
+	if(entry.kp){
+		return entry.kp;
+	}
+	std::shared_ptr<const Keypair> kp;
+	if(decoded.Get(kidx, &kp)){
+		return kp;
+	}
+	try{
+		kp = std::make_shared<const Keypair>(
+			reinterpret_cast<const unsigned char*>(entry.pem->data()), entry.pem->size());
+	}catch(const KeypairException&){
+		return nullptr;
+	}
+	decoded.Put(kidx, kp);
+	return kp;
+}
+
+std::shared_ptr<const Keypair> TrustStore::LookupKey(const KeyLookup& kidx) const {
+	auto it = keys.find(kidx);
+	if(it == keys.end()){
+		return nullptr;
+	}
+	return Decode(kidx, it->second);
+}
+
+std::shared_ptr<const Keypair> TrustStore::Find(const KeyLookup& kidx) const {
+	auto kp = LookupKey(kidx);
+	if(!kp){
+		throw SigningException("no such entry in truststore");
+	}
+	return kp;
+}
+
+// kp, if provided, is entry decoded
+void TrustStore::AddEntry(const KeyLookup& kidx, KeyEntry entry,
+		std::shared_ptr<const Keypair> kp){
 	auto it = keys.find(kidx);
 	if(it != keys.end()){
-		it->second.Merge(*kp);
+		if(it->second.pem && it->second.pem == entry.pem){
+			return; // the same encoding; there's nothing to merge
+		}
+		auto cur = it->second.kp;
+		if(!cur){
+			cur = std::make_shared<const Keypair>(
+				reinterpret_cast<const unsigned char*>(it->second.pem->data()),
+				it->second.pem->size());
+		}
+		if(!kp){
+			kp = std::make_shared<const Keypair>(
+				reinterpret_cast<const unsigned char*>(entry.pem->data()), entry.pem->size());
+		}
+		auto merged = std::make_shared<Keypair>(*cur);
+		merged->Merge(*kp);
+		KeyEntry old = it->second;
+		it->second = KeyEntry{std::move(merged), nullptr};
+		decoded.Erase(kidx);
+		undo.Record([this, kidx, old](){ keys.find(kidx)->second = old; });
 	}else{
-		keys.insert({kidx, *kp});
+		keys.emplace(kidx, entry);
+		if(kp && !entry.kp){
+			decoded.Put(kidx, std::move(kp));
+		}
+		// a different key might later take kidx, invalidating cached checks
+		undo.Record([this, kidx](){
+			keys.erase(kidx);
+			decoded.Erase(kidx);
+			hot.Erase(kidx);
+			sigs.Clear();
+		});
 	}
 }
 
+void TrustStore::AddKey(const Keypair* kp, const KeyLookup& kidx){
+	auto shared = std::make_shared<const Keypair>(*kp);
+	AddEntry(kidx, KeyEntry{shared, nullptr}, shared);
+}
+
+void TrustStore::AddKey(const unsigned char* pem, size_t len, const KeyLookup& kidx){
+	auto kp = std::make_shared<const Keypair>(pem, len);
+	AddEntry(kidx, Encoded(pem, len), std::move(kp));
+}
+
+void TrustStore::RestoreKey(const unsigned char* pem, size_t len, const KeyLookup& kidx){
+	AddEntry(kidx, Encoded(pem, len), nullptr);
+}
+
 std::pair<std::unique_ptr<unsigned char[]>, size_t>
 TrustStore::Sign(const unsigned char* in, size_t inlen, const KeyLookup& signer) const {
-	const auto& it = keys.find(signer);
-	if(it == keys.end()){
-		throw SigningException("no such entry in truststore");
-	}
-	return it->second.Sign(in, inlen);
+	auto ret = Find(signer)->Sign(in, inlen);
+	sigs.Insert(SigCache::Digest(signer, in, inlen, ret.first.get(), ret.second));
+	return ret;
 }
 
 std::pair<std::unique_ptr<unsigned char[]>, size_t>
 TrustStore::Sign(const unsigned char* in, size_t inlen, const KeyLookup& signer,
       const void* pkey, size_t plen) const {
-	const auto& it = keys.find(signer);
-	if(it == keys.end()){
-		throw SigningException("no such entry in truststore");
-	}
-  Keypair kp(it->second);
+  Keypair kp(*Find(signer));
   Keypair kpp = Keypair::PrivateKeypair(pkey, plen);
   kp.Merge(kpp); // make sure private key matches public key in truststore
-	return kp.Sign(in, inlen);
+	auto ret = kp.Sign(in, inlen);
+	sigs.Insert(SigCache::Digest(signer, in, inlen, ret.first.get(), ret.second));
+	return ret;
+}
+
+bool TrustStore::Verify(const KeyLookup& kidx, const unsigned char* in,
+		size_t inlen, const unsigned char* sig, size_t siglen) const {
+	auto kp = LookupKey(kidx);
+	if(!kp){
+		return true;
+	}
+	return Verify(kidx, *kp, in, inlen, sig, siglen);
+}
+
+bool TrustStore::Verify(const KeyLookup& kidx, const Keypair& kp,
+		const unsigned char* in, size_t inlen, const unsigned char* sig,
+		size_t siglen) const {
+	auto digest = SigCache::Digest(kidx, in, inlen, sig, siglen);
+	if(sigs.Contains(digest)){
+		return false;
+	}
+	if(hot.Verify(kidx, kp, in, inlen, sig, siglen)){
+		return true;
+	}
+	sigs.Insert(digest);
+	return false;
 }
 
 // Returned ciphertext includes 128 bits of random AES IV, so size >= IVSIZE
@@ -131,26 +238,26 @@ TrustStore::Decrypt(const void* in, size_t len, const SymmetricKey& key) const {
 
 SymmetricKey
 TrustStore::DeriveSymmetricKey(const KeyLookup& k1, const KeyLookup& k2) const {
-	auto kit1 = keys.find(k1);
-	auto kit2 = keys.find(k2);
-	if(kit1 == keys.end() || kit2 == keys.end()){
+	auto kp1 = LookupKey(k1);
+	auto kp2 = LookupKey(k2);
+	if(!kp1 || !kp2){
 		throw SigningException("key not found for derivation");
 	}
-	return kit1->second.DeriveSymmetricKey(kit2->second);
+	return kp1->DeriveSymmetricKey(*kp2);
 }
 
 SymmetricKey
 TrustStore::DeriveSymmetricKey(const KeyLookup& k1, const KeyLookup& k2,
     const void* pkey, size_t plen) const {
-	auto kit1 = keys.find(k1);
-	auto kit2 = keys.find(k2);
-	if(kit1 == keys.end() || kit2 == keys.end()){
+	auto kp1 = LookupKey(k1);
+	auto kp2 = LookupKey(k2);
+	if(!kp1 || !kp2){
 		throw SigningException("key not found for derivation");
 	}
-  Keypair kp(kit2->second);
+  Keypair kp(*kp2);
   Keypair kpp = Keypair::PrivateKeypair(pkey, plen);
   kp.Merge(kpp); // make sure private key matches public key in truststore
-	return kit1->second.DeriveSymmetricKey(kp);
+	return kp1->DeriveSymmetricKey(kp);
 }
 
 }
@@ -2,9 +2,14 @@
 #define CATENA_LIBCATENA_TRUSTSTORE
 
 #include <memory>
+#include <string>
 #include <cstring>
+#include <unordered_set>
 #include <unordered_map>
 #include <libcatena/ledgermap.h>
+#include <libcatena/sigcache.h>
+#include <libcatena/lrucache.h>
+#include <libcatena/hotkeys.h>
 #include <libcatena/keypair.h>
 #include <libcatena/hash.h>
 
@@ -12,31 +17,80 @@ namespace Catena {
 
 using KeyLookup = TXSpec;
 
+// As with LedgerMap, AddKey()s between Begin() and Commit() can be reverted
+// with Rollback(). Public keys added in their PEM encoding are held only as
+// those bytes (shared among identical keys), and decoded on demand into a
+// bounded cache, so that the many keys which rarely sign cost little.
 class TrustStore {
 public:
-TrustStore() = default;
-TrustStore(const TrustStore& ts) : keys(ts.keys) {}
+static constexpr size_t DECODED_KEYS = 4096; // default decoded cache size
+
+TrustStore(size_t decodedkeys = DECODED_KEYS) : decoded(decodedkeys) {}
+TrustStore(const TrustStore& ts) = default;
+TrustStore& operator=(const TrustStore& ts) = default;
 virtual ~TrustStore() = default;
 
+void Begin() {
+	undo.Begin();
+}
+
+void Commit() {
+	undo.Commit();
+}
+
+void Rollback() {
+	undo.Rollback();
+}
+
 // Add the keypair (usually just public key), using the specified hash and
 // index as its source (this is how it will be referenced in the ledger).
 void AddKey(const Keypair* kp, const KeyLookup& kidx);
 
+// Add a PEM-encoded public key. It is decoded once, throwing KeypairException
+// if invalid, but only the encoding is retained.
+void AddKey(const unsigned char* pem, size_t len, const KeyLookup& kidx);
+
+// Add a PEM-encoded public key known to be valid (say, from a verified
+// snapshot) without decoding it. Should it prove invalid, it will be treated
+// as absent.
+void RestoreKey(const unsigned char* pem, size_t len, const KeyLookup& kidx);
+
+// Returns true if there is no such key, or the signature doesn't verify.
+// Successful verifications are cached, and not repeated.
 bool Verify(const KeyLookup& kidx, const unsigned char* in, size_t inlen,
-		const unsigned char* sig, size_t siglen){
-	try{
-		return keys.at(kidx).Verify(in, inlen, sig, siglen);
-	}catch(const std::out_of_range& oor){ // no such key
-		return true;
-	}
+		const unsigned char* sig, size_t siglen) const;
+
+// Verify using kp, which is (or is about to be added as) the key at kidx,
+// sharing Verify()'s cache. For checks made ahead of the key's AddKey().
+bool Verify(const KeyLookup& kidx, const Keypair& kp, const unsigned char* in,
+		size_t inlen, const unsigned char* sig, size_t siglen) const;
+
+SigCacheStats SignatureCacheStats() const {
+	return sigs.Stats();
 }
 
+LRUStats HotKeyCacheStats() const {
+	return hot.Stats();
+}
+
+LRUStats DecodedKeyStats() const {
+	return decoded.Stats();
+}
+
+bool HasKey(const KeyLookup& kidx) const {
+	return keys.find(kidx) != keys.end();
+}
+
+// Returns nullptr if there is no such (valid) key
+std::shared_ptr<const Keypair> LookupKey(const KeyLookup& kidx) const;
+
 int PubkeyCount() const {
 	return keys.size();
 }
 
 // Sign the provided blob with the specified key. The private component of the
-// specified key must have already been loaded into the truststore.
+// specified key must have already been loaded into the truststore. Signatures
+// we make are known good, and are entered into the verification cache.
 std::pair<std::unique_ptr<unsigned char[]>, size_t>
 Sign(const unsigned char* in, size_t inlen, const KeyLookup& signer) const;
 
@@ -69,7 +123,39 @@ SymmetricKey DeriveSymmetricKey(const KeyLookup& k1, const KeyLookup& k2,
 friend std::ostream& operator<<(std::ostream& s, const TrustStore& ts);
 
 private:
-std::unordered_map<KeyLookup, Keypair> keys;
+// Each key is held decoded, or as its public PEM encoding
+struct KeyEntry {
+	std::shared_ptr<const Keypair> kp;
+	std::shared_ptr<const std::string> pem;
+};
+
+struct PEMHash {
+	size_t operator()(const std::shared_ptr<const std::string>& p) const {
+		return std::hash<std::string>()(*p);
+	}
+};
+
+struct PEMEqual {
+	bool operator()(const std::shared_ptr<const std::string>& p1,
+			const std::shared_ptr<const std::string>& p2) const {
+		return *p1 == *p2;
+	}
+};
+
+std::unordered_map<KeyLookup, KeyEntry> keys;
+std::unordered_set<std::shared_ptr<const std::string>, PEMHash, PEMEqual> pems;
+mutable LRUCache<KeyLookup, std::shared_ptr<const Keypair>> decoded;
+UndoLog undo;
+mutable SigCache sigs; // successful verifications
+mutable HotKeys hot; // keys prepared for verification
+
+void AddEntry(const KeyLookup& kidx, KeyEntry entry, std::shared_ptr<const Keypair> kp);
+KeyEntry Encoded(const unsigned char* pem, size_t len);
+std::shared_ptr<const Keypair> Decode(const KeyLookup& kidx, const KeyEntry& entry) const;
+// As LookupKey(), but throws SigningException rather than returning nullptr
+std::shared_ptr<const Keypair> Find(const KeyLookup& kidx) const;
+
+friend class Snapshot;
 };
 
 }
@@ -1,55 +1,215 @@
 #include <cstring>
 #include <cstdint>
 #include <iostream>
+#include <unordered_map>
 #include <libcatena/externallookuptx.h>
 #include <libcatena/lookupauthreqtx.h>
 #include <libcatena/ustatus.h>
 #include <libcatena/usertx.h>
 #include <libcatena/utility.h>
+#include <libcatena/workers.h>
+#include <libcatena/txvalue.h>
 #include <libcatena/member.h>
+#include <libcatena/wire.h>
 #include <libcatena/tx.h>
 
 namespace Catena {
 
-// Each transaction starts with a 16-bit unsigned type. Throws
-// TransactionException on an invalid or unknown type.
-std::unique_ptr<Transaction> Transaction::LexTX(const unsigned char* data, unsigned len,
-					const CatenaHash& blkhash, unsigned txidx){
+namespace {
+
+template<typename T>
+struct TXTag {
+	using type = T;
+};
+
+// Each transaction starts with a 16-bit unsigned type. Strip it, and call fn
+// with the TXTag of the corresponding class. Throws TransactionException on
+// an invalid or unknown type.
+template<typename F>
+void DispatchTXType(const unsigned char*& data, unsigned& len, F&& fn){
 	uint16_t txtype;
 	if(len < sizeof(txtype)){
 		throw TransactionException("too small for transaction type field");
 	}
-	txtype = nbo_to_ulong(data, sizeof(txtype));
+	txtype = LoadNBO<sizeof(txtype)>(data);
 	len -= sizeof(txtype);
 	data += sizeof(txtype);
-  std::unique_ptr<Transaction> tx;
 	switch(static_cast<TXTypes>(txtype)){
 	case TXTypes::ConsortiumMember:
-		tx = std::make_unique<ConsortiumMemberTX>(blkhash, txidx);
+		fn(TXTag<ConsortiumMemberTX>());
 		break;
 	case TXTypes::ExternalLookup:
-		tx = std::make_unique<ExternalLookupTX>(blkhash, txidx);
+		fn(TXTag<ExternalLookupTX>());
 		break;
 	case TXTypes::User:
-		tx = std::make_unique<UserTX>(blkhash, txidx);
+		fn(TXTag<UserTX>());
 		break;
 	case TXTypes::UserStatus:
-		tx = std::make_unique<UserStatusTX>(blkhash, txidx);
+		fn(TXTag<UserStatusTX>());
 		break;
 	case TXTypes::LookupAuthReq:
-		tx = std::make_unique<LookupAuthReqTX>(blkhash, txidx);
+		fn(TXTag<LookupAuthReqTX>());
 		break;
 	case TXTypes::LookupAuth:
-		tx = std::make_unique<LookupAuthTX>(blkhash, txidx);
+		fn(TXTag<LookupAuthTX>());
 		break;
 	case TXTypes::UserStatusDelegation:
-		tx = std::make_unique<UserStatusDelegationTX>(blkhash, txidx);
+		fn(TXTag<UserStatusDelegationTX>());
 		break;
 	default:
 		throw TransactionException("unknown transaction type " + std::to_string(txtype));
 	}
+}
+
+// Apply fn to the transaction, however it's held
+template<typename F>
+auto VisitTX(const std::unique_ptr<Transaction>& tx, F&& fn){
+	return fn(*tx);
+}
+
+template<typename F>
+auto VisitTX(TXValue& tx, F&& fn){
+	return std::visit(std::forward<F>(fn), tx);
+}
+
+}
+
+const char* TXTypeName(unsigned txtype){
+	switch(static_cast<TXTypes>(txtype)){
+	case TXTypes::ConsortiumMember: return "ConsortiumMember";
+	case TXTypes::ExternalLookup: return "ExternalLookup";
+	case TXTypes::User: return "User";
+	case TXTypes::UserStatus: return "UserStatus";
+	case TXTypes::LookupAuthReq: return "LookupAuthReq";
+	case TXTypes::LookupAuth: return "LookupAuth";
+	case TXTypes::UserStatusDelegation: return "UserStatusDelegation";
+	}
+	return "unknown";
+}
+
+std::unique_ptr<Transaction> Transaction::LexTX(const unsigned char* data, unsigned len,
+					const CatenaHash& blkhash, unsigned txidx,
+					std::shared_ptr<const void> keep){
+	std::unique_ptr<Transaction> tx;
+	DispatchTXType(data, len, [&](auto tag){
+		tx = std::make_unique<typename decltype(tag)::type>(blkhash, txidx);
+	});
 	tx->Extract(data, len);
+	tx->Retain(std::move(keep));
 	return tx;
 }
 
+void LexTXValue(std::vector<TXValue>& txs, const unsigned char* data,
+		unsigned len, const CatenaHash& blkhash, unsigned txidx){
+	DispatchTXType(data, len, [&](auto tag){
+		using T = typename decltype(tag)::type;
+		auto& tx = std::get<T>(txs.emplace_back(std::in_place_type<T>, blkhash, txidx));
+		try{
+			tx.Extract(data, len);
+		}catch(...){
+			txs.pop_back();
+			throw;
+		}
+	});
+}
+
+// Verify, across workers threads, those signatures which can be verified
+// ahead of the in-order replay, recording the results within each transaction.
+// Anything which fails here for reasons other than a bad signature (e.g. an
+// unparseable introduced key) is left unchecked, to fail in Validate().
+template<typename TXs>
+void Transaction::PrecheckSignatures(TXs& txs, const TrustStore& tstore,
+				unsigned workers){
+	// keys introduced within txs, mapped to the index of their introducer
+	std::unordered_map<KeyLookup, size_t> introducers;
+	for(size_t i = 0 ; i < txs.size() ; ++i){
+		const unsigned char* key;
+		size_t keylen;
+		const Transaction* tx = VisitTX(txs[i], [&](const auto& t) -> const Transaction* {
+			return t.IntroducedKey(&key, &keylen) ? &t : nullptr;
+		});
+		if(tx){
+			introducers.emplace(KeyLookup(tx->blockhash, tx->txidx), i);
+		}
+	}
+	struct Check {
+		Transaction* tx;
+		SignatureCheck sc;
+		std::shared_ptr<const Keypair> kp; // nullptr if it must come from introduced
+	};
+	std::vector<Check> checks;
+	std::unordered_map<KeyLookup, std::unique_ptr<Keypair>> introduced;
+	for(size_t i = 0 ; i < txs.size() ; ++i){
+		Check c{nullptr, {}, nullptr};
+		c.tx = VisitTX(txs[i], [&](auto& t) -> Transaction* {
+			return t.SignatureCheckable(&c.sc) ? &t : nullptr;
+		});
+		if(c.tx == nullptr){
+			continue;
+		}
+		if( (c.kp = tstore.LookupKey(c.sc.signer)) == nullptr){
+			auto intro = introducers.find(c.sc.signer);
+			if(intro == introducers.end() || intro->second >= i){
+				continue; // Validate() will find no such key
+			}
+			introduced.emplace(c.sc.signer, nullptr);
+		}
+		checks.push_back(c);
+	}
+	std::vector<std::pair<const KeyLookup, std::unique_ptr<Keypair>>*> toparse;
+	for(auto& kv : introduced){
+		toparse.push_back(&kv);
+	}
+	ParallelFor(workers, toparse.size(), [&](size_t i){
+		const unsigned char* key;
+		size_t keylen;
+		VisitTX(txs[introducers.at(toparse[i]->first)], [&](const auto& t){
+			return t.IntroducedKey(&key, &keylen);
+		});
+		try{
+			toparse[i]->second = std::make_unique<Keypair>(key, keylen);
+		}catch(const KeypairException&){
+			// leave it for Validate() to throw
+		}
+	});
+	ParallelFor(workers, checks.size(), [&](size_t i){
+		auto& c = checks[i];
+		auto kp = c.kp ? c.kp.get() : introduced.at(c.sc.signer).get();
+		if(kp == nullptr){
+			return;
+		}
+		try{
+			bool failed = tstore.Verify(c.sc.signer, *kp, c.sc.data, c.sc.len,
+							c.sc.sig, c.sc.siglen);
+			c.tx->sigstate = failed ? SigState::Invalid : SigState::Valid;
+		}catch(const std::runtime_error&){
+			// leave it for Validate() to throw
+		}
+	});
+}
+
+template<typename TXs>
+bool Transaction::ValidateAll(TXs& txs, TrustStore& tstore, LedgerMap& lmap,
+				unsigned workers){
+	if(workers > 1){
+		PrecheckSignatures(txs, tstore, workers);
+	}
+	for(auto& tx : txs){
+		if(VisitTX(tx, [&](auto& t){ return t.Validate(tstore, lmap); })){
+			return true;
+		}
+	}
+	return false;
+}
+
+bool Transaction::ValidateBatch(const std::vector<std::unique_ptr<Transaction>>& txs,
+				TrustStore& tstore, LedgerMap& lmap, unsigned workers){
+	return ValidateAll(txs, tstore, lmap, workers);
+}
+
+bool Transaction::ValidateBatch(std::vector<TXValue>& txs,
+				TrustStore& tstore, LedgerMap& lmap, unsigned workers){
+	return ValidateAll(txs, tstore, lmap, workers);
+}
+
 }
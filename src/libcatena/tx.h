@@ -2,7 +2,9 @@
 #define CATENA_LIBCATENA_TX
 
 #include <memory>
+#include <vector>
 #include <cstring>
+#include <variant>
 #include <nlohmann/json.hpp>
 #include <libcatena/truststore.h>
 #include <libcatena/ledgermap.h>
@@ -12,6 +14,7 @@
 
 namespace Catena {
 
+// Always serialized as a 16-bit unsigned integer
 enum class TXTypes {
 	ConsortiumMember = 0x0001,
 	ExternalLookup = 0x0002,
@@ -22,10 +25,37 @@ enum class TXTypes {
 	UserStatusDelegation = 0x0007,
 };
 
-// TXType is always serialized as a 16-bit unsigned integer
-inline unsigned char* TXType_to_nbo(TXTypes tt, unsigned char* data){
-	return ulong_to_nbo(static_cast<unsigned long>(tt), data, 2);
-}
+// One past the greatest TXTypes value, for tables indexed by type
+constexpr unsigned TXTYPELIMIT = 8;
+
+// The name of the transaction type, or "unknown"
+const char* TXTypeName(unsigned txtype);
+
+// A signature which can be verified independently of ledger state, given the
+// signer's public key.
+struct SignatureCheck {
+	KeyLookup signer;
+	const unsigned char* data; // signed payload
+	size_t len;
+	const unsigned char* sig;
+	size_t siglen;
+};
+
+class ConsortiumMemberTX;
+class ExternalLookupTX;
+class UserTX;
+class UserStatusTX;
+class LookupAuthReqTX;
+class LookupAuthTX;
+class UserStatusDelegationTX;
+
+// A transaction of any of the TXTypes, held by value. Vectors of these store
+// transactions contiguously, without an allocation apiece, and since each
+// alternative is final, calls made through std::visit() bind statically.
+// Include txvalue.h to make use of them.
+using TXValue = std::variant<ConsortiumMemberTX, ExternalLookupTX, UserTX,
+				UserStatusTX, LookupAuthReqTX, LookupAuthTX,
+				UserStatusDelegationTX>;
 
 class Transaction {
 public:
@@ -35,7 +65,15 @@ Transaction(const CatenaHash& hash, unsigned idx) :
 	blockhash(hash) {}
 
 virtual ~Transaction() = default;
+
+// Lex the transaction from data. Transactions are views: they point into data
+// rather than copying from it, so data must outlive them (see Retain()).
 virtual void Extract(const unsigned char* data, unsigned len) = 0;
+
+// Keep data, which Extract() was or will be handed, alive as long as we are
+void Retain(std::shared_ptr<const void> data){
+	backing = std::move(data);
+}
 virtual bool Validate(TrustStore& tstore, LedgerMap& lmap) = 0;
 virtual nlohmann::json JSONify() const = 0;
 
@@ -45,19 +83,95 @@ virtual std::ostream& TXOStream(std::ostream& s) const = 0;
 // Serialize oneself
 virtual std::pair<std::unique_ptr<unsigned char[]>, size_t> Serialize() const = 0;
 
+// Our serialization, produced by Serialize() on first call and thereafter
+// cached for the life of the transaction (which never changes once lexed).
+// The view is valid until we are destroyed.
+std::pair<const unsigned char*, size_t> Serialized() {
+	if(!serialized){
+		auto ser = Serialize();
+		serialized.reset(ser.first.release(), std::default_delete<unsigned char[]>());
+		serlen = ser.second;
+	}
+	return std::make_pair(serialized.get(), serlen);
+}
+
+// Exact length of our serialization, caching it as Serialized() does
+size_t SerializedSize() {
+	return Serialized().second;
+}
+
 friend std::ostream& operator<<(std::ostream& s, const Transaction* t){
 	return t->TXOStream(s);
 }
 
+// The result views data, and holds keep (if provided) to keep it alive; see
+// Extract().
 static std::unique_ptr<Transaction>
 LexTX(const unsigned char* data, unsigned len,
-	const CatenaHash& blkhash, unsigned txidx);
+	const CatenaHash& blkhash, unsigned txidx,
+	std::shared_ptr<const void> keep = nullptr);
+
+// Validate the transactions in order, stopping at (and returning true for) the
+// first failure, exactly as if Validate() were called on each in turn. With
+// more than one worker, signatures which don't depend on ledger state (their
+// signer being in tstore, or introduced earlier in txs) are first verified in
+// parallel, leaving only state mutation to the sequential pass.
+static bool ValidateBatch(const std::vector<std::unique_ptr<Transaction>>& txs,
+		TrustStore& tstore, LedgerMap& lmap, unsigned workers);
+static bool ValidateBatch(std::vector<TXValue>& txs,
+		TrustStore& tstore, LedgerMap& lmap, unsigned workers);
+
+// If the signer can be determined without consulting the LedgerMap, fill in
+// sc and return true.
+virtual bool SignatureCheckable(SignatureCheck* sc) const {
+	(void)sc;
+	return false;
+}
+
+// If this transaction introduces a public key (to be stored in the TrustStore
+// under its own TXSpec), return it via key and keylen.
+virtual bool IntroducedKey(const unsigned char** key, size_t* keylen) const {
+	(void)key;
+	(void)keylen;
+	return false;
+}
 
 protected:
 // FIXME shouldn't need to keep these, but don't want to explicitly pass them
 // into validate(). wrap them up in a lambda?
 unsigned txidx; // transaction index within block
 CatenaHash blockhash; // containing block hash
+
+// Implementations of Validate() ought use this rather than TrustStore::Verify()
+// directly, so that any result from ValidateBatch()'s first phase is used.
+bool VerifySignature(TrustStore& tstore, const KeyLookup& signer,
+		const unsigned char* in, size_t inlen,
+		const unsigned char* sig, size_t siglen) const {
+	// the prechecked key can't have changed, but it might not yet be present
+	if(sigstate != SigState::Unchecked && tstore.HasKey(signer)){
+		return sigstate == SigState::Invalid;
+	}
+	return tstore.Verify(signer, in, inlen, sig, siglen);
+}
+
+private:
+std::shared_ptr<const void> backing; // owner of the data we view, if any
+std::shared_ptr<const unsigned char> serialized; // see Serialized(); shared by copies
+size_t serlen = 0;
+
+enum class SigState {
+	Unchecked,
+	Valid,
+	Invalid,
+} sigstate = SigState::Unchecked;
+
+template<typename TXs>
+static bool ValidateAll(TXs& txs, TrustStore& tstore, LedgerMap& lmap,
+		unsigned workers);
+
+template<typename TXs>
+static void PrecheckSignatures(TXs& txs, const TrustStore& tstore,
+		unsigned workers);
 };
 
 }
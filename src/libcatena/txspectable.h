@@ -0,0 +1,140 @@
+#ifndef CATENA_LIBCATENA_TXSPECTABLE
+#define CATENA_LIBCATENA_TXSPECTABLE
+
+#include <vector>
+#include <cstdint>
+#include <utility>
+#include <stdexcept>
+#include <libcatena/flatmap.h>
+#include <libcatena/hash.h>
+
+namespace Catena {
+
+// Dense stand-in for a TXSpec, valid within the TXSpecTable which issued it
+using TXId = uint32_t;
+
+// Issues each distinct TXSpec a TXId, in order of first appearance, so that
+// state which refers to transactions can hold 4 bytes rather than 36. Each
+// spec is stored once, in an array indexed by id, alongside the owner's record
+// R for it (value-initialized when the spec is interned). The index from specs
+// to ids is a FlatTable holding only the ids, which finds keys in that array.
+// Interning and PopLast() invalidate references to specs and records.
+template<typename R>
+class TXSpecTable {
+public:
+TXSpecTable() : index(SpecOf{&entries}) {}
+
+TXSpecTable(const TXSpecTable& t) : entries(t.entries), index(SpecOf{&entries}) {
+	index = t.index;
+}
+
+TXSpecTable(TXSpecTable&& t) noexcept :
+  entries(std::move(t.entries)),
+  index(SpecOf{&entries}) {
+	index = std::move(t.index);
+}
+
+// the index's SpecOf stays with each table, pointing at its own entries
+TXSpecTable& operator=(const TXSpecTable& t) {
+	entries = t.entries;
+	index = t.index;
+	return *this;
+}
+
+TXSpecTable& operator=(TXSpecTable&& t) noexcept {
+	entries.swap(t.entries);
+	index = std::move(t.index);
+	return *this;
+}
+
+size_t size() const {
+	return entries.size();
+}
+
+const TXSpec& Spec(TXId id) const {
+	return entries[id].spec;
+}
+
+const R& Record(TXId id) const {
+	return entries[id].rec;
+}
+
+R& Record(TXId id) {
+	return entries[id].rec;
+}
+
+// spec's record, or nullptr if it has never been interned. Sets *id to spec's
+// id when found, should id be non-null.
+const R* Find(const TXSpec& spec, TXId* id = nullptr) const {
+	auto it = index.find(spec);
+	if(it == index.end()){
+		return nullptr;
+	}
+	if(id){
+		*id = it->id;
+	}
+	return &entries[it->id].rec;
+}
+
+R* Find(const TXSpec& spec, TXId* id = nullptr) {
+	return const_cast<R*>(static_cast<const TXSpecTable*>(this)->Find(spec, id));
+}
+
+// The id of spec, issuing the next one if it has none (in which case *added
+// is set). Throws std::length_error if the ids are exhausted.
+TXId Intern(const TXSpec& spec, bool* added) {
+	auto it = index.find(spec);
+	if(it != index.end()){
+		*added = false;
+		return it->id;
+	}
+	if(entries.size() >= UINT32_MAX){
+		throw std::length_error("TXSpec ids exhausted");
+	}
+	TXId id = entries.size();
+	// the spec must be in place before the index can look it up
+	entries.push_back({spec, R{}});
+	try{
+		index.emplace(spec, id);
+	}catch(...){
+		entries.pop_back();
+		throw;
+	}
+	*added = true;
+	return id;
+}
+
+// Forget the most recently issued id and its record, undoing its Intern().
+// Any references to it must already be gone.
+void PopLast() {
+	index.erase(entries.back().spec);
+	entries.pop_back();
+}
+
+private:
+struct Entry {
+	TXSpec spec;
+	R rec;
+};
+
+// An index slot, constructed by FlatTable from the spec and its id
+struct Slot {
+	Slot(const TXSpec&, TXId id) : id(id) {}
+	TXId id;
+};
+
+struct SpecOf {
+	const std::vector<Entry>* entries = nullptr;
+
+	const TXSpec& operator()(const Slot& s) const {
+		return (*entries)[s.id].spec;
+	}
+};
+
+std::vector<Entry> entries; // indexed by id
+FlatTable<TXSpec, Slot, SpecOf> index;
+};
+
+}
+
+#endif
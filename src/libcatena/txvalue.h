@@ -0,0 +1,21 @@
+#ifndef CATENA_LIBCATENA_TXVALUE
+#define CATENA_LIBCATENA_TXVALUE
+
+#include <vector>
+#include <libcatena/externallookuptx.h>
+#include <libcatena/lookupauthreqtx.h>
+#include <libcatena/ustatus.h>
+#include <libcatena/usertx.h>
+#include <libcatena/member.h>
+#include <libcatena/tx.h>
+
+namespace Catena {
+
+// Lex a transaction onto the end of txs, exactly as LexTX() would. On error,
+// TransactionException is thrown, and txs is unchanged.
+void LexTXValue(std::vector<TXValue>& txs, const unsigned char* data,
+		unsigned len, const CatenaHash& blkhash, unsigned txidx);
+
+}
+
+#endif
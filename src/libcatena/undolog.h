@@ -0,0 +1,67 @@
+#ifndef CATENA_LIBCATENA_UNDOLOG
+#define CATENA_LIBCATENA_UNDOLOG
+
+#include <vector>
+#include <utility>
+#include <functional>
+
+namespace Catena {
+
+// A record of how to reverse a series of mutations, kept only between Begin()
+// and Commit() / Rollback(). These nest: an inner Commit() hands its entries
+// to the enclosing scope, while an inner Rollback() undoes only its own.
+// Entries typically refer back to their owner, so copies of an UndoLog start
+// out empty and inactive.
+class UndoLog {
+public:
+UndoLog() = default;
+
+UndoLog(const UndoLog&) {}
+
+UndoLog& operator=(const UndoLog&) {
+	return *this;
+}
+
+void Begin() {
+	marks.push_back(entries.size());
+}
+
+void Commit() {
+	if(!marks.empty()){
+		marks.pop_back();
+	}
+	if(marks.empty()){
+		entries.clear();
+	}
+}
+
+// Undo everything recorded since the matching Begin(), most recent first
+void Rollback() {
+	if(marks.empty()){
+		return;
+	}
+	auto mark = marks.back();
+	marks.pop_back();
+	while(entries.size() > mark){
+		auto undo = std::move(entries.back());
+		entries.pop_back();
+		undo();
+	}
+}
+
+// Record the inverse of a mutation just made (dropped if we're inactive)
+template<typename F>
+void Record(F&& undo) {
+	if(!marks.empty()){
+		entries.emplace_back(std::forward<F>(undo));
+	}
+}
+
+private:
+std::vector<size_t> marks; // entries.size() at each open Begin()
+std::vector<std::function<void()>> entries;
+};
+
+}
+
+#endif
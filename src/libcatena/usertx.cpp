@@ -1,51 +1,43 @@
 #include <iostream>
 #include <libcatena/utility.h>
 #include <libcatena/usertx.h>
+#include <libcatena/wire.h>
 
 namespace Catena {
 
 void UserTX::Extract(const unsigned char* data, unsigned len) {
-	if(len < 2){ // 16-bit signature length
-		throw TransactionException("no room for signature length");
-	}
-	siglen = nbo_to_ulong(data, 2);
-	data += 2;
-	len -= 2;
-	if(len < signerhash.size() + sizeof(signeridx)){
-		throw TransactionException("no room for signature spec");
-	}
-	memcpy(signerhash.data(), data, signerhash.size());
-	data += signerhash.size();
-	len -= signerhash.size();
-	signeridx = nbo_to_ulong(data, sizeof(signeridx));
-	data += sizeof(signeridx);
-	len -= sizeof(signeridx);
-	if(len < siglen || siglen > sizeof(signature)){
+	WireReader<TransactionException> r(data, len);
+	siglen = r.Int<2>("no room for signature length");
+	signerhash = r.Hash("no room for signature spec");
+	signeridx = r.Int<4>("no room for signature spec");
+	if(siglen > SIGLEN){
 		throw TransactionException("no room for signature");
 	}
-	memcpy(signature, data, siglen);
-	data += siglen;
-	len -= siglen;
-	if(len < 2){
-		throw TransactionException("no room for key length");
-	}
-	keylen = nbo_to_ulong(data, 2);
-	if(keylen + 2 > len){
-		throw TransactionException("no room for key");
-	}
+	signature = r.Bytes(siglen, "no room for signature");
+	keylen = r.Peek<2>(0, "no room for key length");
+	r.Need(keylen + 2, "no room for key");
 	// FIXME verify that key is valid?
-	payload = std::unique_ptr<unsigned char[]>(new unsigned char[len]);
-	memcpy(payload.get(), data, len);
-	payloadlen = len;
+	payload = r.Data();
+	payloadlen = r.Left();
+}
+
+bool UserTX::SignatureCheckable(SignatureCheck* sc) const {
+	*sc = {{signerhash, signeridx}, payload, payloadlen, signature, siglen};
+	return true;
+}
+
+bool UserTX::IntroducedKey(const unsigned char** key, size_t* klen) const {
+	*key = payload + 2;
+	*klen = keylen;
+	return true;
 }
 
 bool UserTX::Validate(TrustStore& tstore, LedgerMap& lmap) {
-	if(tstore.Verify({signerhash, signeridx}, payload.get(),
+	if(VerifySignature(tstore, {signerhash, signeridx}, payload,
 				payloadlen, signature, siglen)){
 		return true;
 	}
-	Keypair kp(payload.get() + 2, keylen);
-	tstore.AddKey(&kp, {blockhash, txidx});
+	tstore.AddKey(payload + 2, keylen, {blockhash, txidx});
 	lmap.AddUser({blockhash, txidx}, {signerhash, signeridx});
 	return false;
 }
@@ -62,15 +54,13 @@ std::pair<std::unique_ptr<unsigned char[]>, size_t>
 UserTX::Serialize() const {
 	size_t len = 4 + signerhash.size() + sizeof(signeridx) + siglen + payloadlen;
 	std::unique_ptr<unsigned char[]> ret(new unsigned char[len]);
-	auto data = TXType_to_nbo(TXTypes::User, ret.get());
-	data = ulong_to_nbo(siglen, data, 2);
-	memcpy(data, signerhash.data(), signerhash.size());
-	data += signerhash.size();
-	data = ulong_to_nbo(signeridx, data, 4);
-	memcpy(data, signature, siglen);
-	data += siglen;
-	memcpy(data, payload.get(), payloadlen);
-	data += payloadlen;
+	WireWriter w(ret.get(), len);
+	w.Int<2>(static_cast<unsigned>(TXTypes::User));
+	w.Int<2>(siglen);
+	w.Hash(signerhash);
+	w.Int<4>(signeridx);
+	w.Bytes(signature, siglen);
+	w.Bytes(payload, payloadlen);
 	return std::make_pair(std::move(ret), len);
 }
 
@@ -89,46 +79,34 @@ nlohmann::json UserTX::JSONify() const {
 }
 
 void UserStatusDelegationTX::Extract(const unsigned char* data, unsigned len) {
-	if(len < 2){ // 16-bit signature length
-		throw TransactionException("no room for signature length");
-	}
-	siglen = nbo_to_ulong(data, 2);
-	data += 2;
-	len -= 2;
-	if(len < signerhash.size() + sizeof(signeridx)){
-		throw TransactionException("no room for signature spec");
-	}
-	memcpy(signerhash.data(), data, signerhash.size());
-	data += signerhash.size();
-	len -= signerhash.size();
-	signeridx = nbo_to_ulong(data, sizeof(signeridx));
-	data += sizeof(signeridx);
-	len -= sizeof(signeridx);
-	if(len < siglen || siglen > sizeof(signature)){
+	WireReader<TransactionException> r(data, len);
+	siglen = r.Int<2>("no room for signature length");
+	signerhash = r.Hash("no room for signature spec");
+	signeridx = r.Int<4>("no room for signature spec");
+	if(siglen > SIGLEN){
 		throw TransactionException("no room for signature");
 	}
-	memcpy(signature, data, siglen);
-	data += siglen;
-	len -= siglen;
-	if(len < signerhash.size() + sizeof(cmidx) + 4){
-		throw TransactionException("no room for cmspec + stype");
-	}
-	cmidx = nbo_to_ulong(data + signerhash.size(), 4);
-	statustype = nbo_to_ulong(data + signerhash.size() + 4, 4);
-	payload = std::unique_ptr<unsigned char[]>(new unsigned char[len]);
-	memcpy(payload.get(), data, len);
-	payloadlen = len;
+	signature = r.Bytes(siglen, "no room for signature");
+	cmidx = r.Peek<4>(signerhash.size(), "no room for cmspec + stype");
+	statustype = r.Peek<4>(signerhash.size() + 4, "no room for cmspec + stype");
+	payload = r.Data();
+	payloadlen = r.Left();
+}
+
+bool UserStatusDelegationTX::SignatureCheckable(SignatureCheck* sc) const {
+	*sc = {{signerhash, signeridx}, payload, payloadlen, signature, siglen};
+	return true;
 }
 
 bool UserStatusDelegationTX::Validate(TrustStore& tstore, LedgerMap& lmap) {
 	TXSpec uspec;
 	memcpy(uspec.first.data(), signerhash.data(), signerhash.size());
 	uspec.second = signeridx;
-	if(tstore.Verify(uspec, payload.get(), payloadlen, signature, siglen)){
+	if(VerifySignature(tstore, uspec, payload, payloadlen, signature, siglen)){
 		return true;
 	}
 	TXSpec cmspec;
-	memcpy(cmspec.first.data(), payload.get(), cmspec.first.size());
+	memcpy(cmspec.first.data(), payload, cmspec.first.size());
 	cmspec.second = cmidx;
 	lmap.AddDelegation({blockhash, txidx}, cmspec, uspec, statustype);
 	return false;
@@ -139,7 +117,7 @@ std::ostream& UserStatusDelegationTX::TXOStream(std::ostream& s) const {
 		<< siglen << "b signature, " << payloadlen << "b payload)\n";
 	s << " delegator: " << signerhash << "." << signeridx << "\n";
 	s << " delegate: ";
-	hashOStream(s, payload.get()) << "." << cmidx << "\n";
+	hashOStream(s, payload) << "." << cmidx << "\n";
 	s << " payload: ";
 	std::copy(GetJSONPayload(), GetJSONPayload() + GetJSONPayloadLength(), std::ostream_iterator<char>(s, ""));
 	return s;
@@ -149,15 +127,13 @@ std::pair<std::unique_ptr<unsigned char[]>, size_t>
 UserStatusDelegationTX::Serialize() const {
 	size_t len = 4 + signerhash.size() + sizeof(signeridx) + siglen + payloadlen;
 	std::unique_ptr<unsigned char[]> ret(new unsigned char[len]);
-	auto data = TXType_to_nbo(TXTypes::UserStatusDelegation, ret.get());
-	data = ulong_to_nbo(siglen, data, 2);
-	memcpy(data, signerhash.data(), signerhash.size());
-	data += signerhash.size();
-	data = ulong_to_nbo(signeridx, data, 4);
-	memcpy(data, signature, siglen);
-	data += siglen;
-	memcpy(data, payload.get(), payloadlen);
-	data += payloadlen;
+	WireWriter w(ret.get(), len);
+	w.Int<2>(static_cast<unsigned>(TXTypes::UserStatusDelegation));
+	w.Int<2>(siglen);
+	w.Hash(signerhash);
+	w.Int<4>(signeridx);
+	w.Bytes(signature, siglen);
+	w.Bytes(payload, payloadlen);
 	return std::make_pair(std::move(ret), len);
 }
 
@@ -168,7 +144,7 @@ nlohmann::json UserStatusDelegationTX::JSONify() const {
 	ss << signerhash << "." << signeridx;
 	ret["signerspec"] = ss.str();
 	ss.str(std::string());
-        hashOStream(ss, payload.get());
+        hashOStream(ss, payload);
         ss << "." << cmidx;
         ret["subjectspec"] = ss.str();
 	ret["subtype"] = statustype;
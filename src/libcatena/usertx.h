@@ -6,7 +6,7 @@
 
 namespace Catena {
 
-class UserTX : public Transaction {
+class UserTX final : public Transaction {
 public:
 UserTX() = default;
 UserTX(const CatenaHash& hash, unsigned idx) : Transaction(hash, idx) {}
@@ -15,24 +15,26 @@ bool Validate(TrustStore& tstore, LedgerMap& lmap) override;
 std::ostream& TXOStream(std::ostream& s) const override;
 std::pair<std::unique_ptr<unsigned char[]>, size_t> Serialize() const override;
 nlohmann::json JSONify() const override;
+bool SignatureCheckable(SignatureCheck* sc) const override;
+bool IntroducedKey(const unsigned char** key, size_t* keylen) const override;
 
 private:
-unsigned char signature[SIGLEN];
+const unsigned char* signature = nullptr; // within the lexed transaction
 CatenaHash signerhash;
 uint32_t signeridx;
 size_t siglen; // length of signature, up to SIGLEN
-std::unique_ptr<unsigned char[]> payload; // key + ciphertext
+const unsigned char* payload = nullptr; // key + ciphertext
 size_t keylen; // length of public key within payload
 size_t payloadlen; // total length of signed payload
 
 const unsigned char*
 GetPubKey() const {
-	return payload.get() + 2;
+	return payload + 2;
 }
 
 const unsigned char*
 GetPayload() const {
-	return payload.get() + 2 + keylen;
+	return payload + 2 + keylen;
 }
 
 size_t GetPayloadLength() const {
@@ -41,7 +43,7 @@ size_t GetPayloadLength() const {
 
 };
 
-class UserStatusDelegationTX : public Transaction {
+class UserStatusDelegationTX final : public Transaction {
 public:
 UserStatusDelegationTX() = default;
 UserStatusDelegationTX(const CatenaHash& hash, unsigned idx) : Transaction(hash, idx) {}
@@ -50,20 +52,21 @@ bool Validate(TrustStore& tstore, LedgerMap& lmap) override;
 std::ostream& TXOStream(std::ostream& s) const override;
 std::pair<std::unique_ptr<unsigned char[]>, size_t> Serialize() const override;
 nlohmann::json JSONify() const override;
+bool SignatureCheckable(SignatureCheck* sc) const override;
 
 private:
-unsigned char signature[SIGLEN];
+const unsigned char* signature = nullptr; // within the lexed transaction
 CatenaHash signerhash;
 uint32_t signeridx;
 size_t siglen; // length of signature, up to SIGLEN
-std::unique_ptr<unsigned char[]> payload; // key + ciphertext
+const unsigned char* payload = nullptr; // key + ciphertext
 uint32_t cmidx; // ConsortiumMember idx, from payload
 int statustype; // extracted from the payload
 size_t payloadlen; // total length of signed payload
 
 const unsigned char*
 GetJSONPayload() const {
-	return payload.get() + 4 + signerhash.size() + 4;
+	return payload + 4 + signerhash.size() + 4;
 }
 
 size_t GetJSONPayloadLength() const {
@@ -1,53 +1,41 @@
 #include <iostream>
 #include <libcatena/ustatus.h>
+#include <libcatena/wire.h>
 
 namespace Catena {
 
 void UserStatusTX::Extract(const unsigned char* data, unsigned len) {
-	if(len < 2){ // 16-bit signature length
-		throw TransactionException("no room for signature length");
-	}
-	siglen = nbo_to_ulong(data, 2);
-	data += 2;
-	len -= 2;
-	if(len < signerhash.size() + sizeof(signeridx)){
-		throw TransactionException("no room for signature spec");
-	}
-	memcpy(signerhash.data(), data, signerhash.size());
-	data += signerhash.size();
-	len -= signerhash.size();
-	signeridx = nbo_to_ulong(data, sizeof(signeridx));
-	data += sizeof(signeridx);
-	len -= sizeof(signeridx);
-	if(len < siglen || siglen > sizeof(signature)){
+	WireReader<TransactionException> r(data, len);
+	siglen = r.Int<2>("no room for signature length");
+	signerhash = r.Hash("no room for signature spec");
+	signeridx = r.Int<4>("no room for signature spec");
+	if(siglen > SIGLEN){
 		throw TransactionException("no room for signature");
 	}
-	memcpy(signature, data, siglen);
-	data += siglen;
-	len -= siglen;
-	if(len < signerhash.size() + 4){
-		throw TransactionException("no room for subject spec");
-	}
-	usdidx = nbo_to_ulong(data + signerhash.size(), 4);
+	signature = r.Bytes(siglen, "no room for signature");
+	usdidx = r.Peek<4>(signerhash.size(), "no room for subject spec");
 	// FIXME verify that subjectspec is valid? verify payload is valid JSON?
-	payload = std::unique_ptr<unsigned char[]>(new unsigned char[len]);
-	memcpy(payload.get(), data, len);
-	payloadlen = len;
+	payload = r.Data();
+	payloadlen = r.Left();
+}
+
+bool UserStatusTX::SignatureCheckable(SignatureCheck* sc) const {
+	*sc = {{signerhash, signeridx}, payload, payloadlen, signature, siglen};
+	return true;
 }
 
 bool UserStatusTX::Validate(TrustStore& tstore, LedgerMap& lmap) {
-	if(tstore.Verify({signerhash, signeridx}, payload.get(),
+	if(VerifySignature(tstore, {signerhash, signeridx}, payload,
 				payloadlen, signature, siglen)){
 		return true;
 	}
 	TXSpec usdspec;
-	memcpy(usdspec.first.data(), payload.get(), usdspec.first.size());
+	memcpy(usdspec.first.data(), payload, usdspec.first.size());
 	usdspec.second = usdidx;
-	auto& usd = lmap.LookupDelegation(usdspec);
-	const auto& uspec = usd.USpec();
-	auto& pat = lmap.LookupUser(uspec);
-	auto pload = std::string(reinterpret_cast<const char*>(GetJSONPayload()), GetJSONPayloadLength());
-	pat.SetStatus(usd.StatusType(), nlohmann::json::parse(pload));
+	auto pload = reinterpret_cast<const char*>(GetJSONPayload());
+	if(lmap.SetDelegatedStatus(usdspec, pload, GetJSONPayloadLength())){
+		throw TransactionException("status payload is not valid JSON");
+	}
 	return false;
 }
 
@@ -65,15 +53,13 @@ std::pair<std::unique_ptr<unsigned char[]>, size_t> UserStatusTX::Serialize() co
 	size_t len = 4 + siglen + signerhash.size() + sizeof(signeridx) +
 		payloadlen;
 	std::unique_ptr<unsigned char[]> ret(new unsigned char[len]);
-	auto data = TXType_to_nbo(TXTypes::UserStatus, ret.get());
-	data = ulong_to_nbo(siglen, data, 2);
-	memcpy(data, signerhash.data(), signerhash.size());
-	data += signerhash.size();
-	data = ulong_to_nbo(signeridx, data, 4);
-	memcpy(data, signature, siglen);
-	data += siglen;
-	memcpy(data, payload.get(), payloadlen);
-	data += payloadlen;
+	WireWriter w(ret.get(), len);
+	w.Int<2>(static_cast<unsigned>(TXTypes::UserStatus));
+	w.Int<2>(siglen);
+	w.Hash(signerhash);
+	w.Int<4>(signeridx);
+	w.Bytes(signature, siglen);
+	w.Bytes(payload, payloadlen);
 	return std::make_pair(std::move(ret), len);
 }
 
@@ -85,7 +71,7 @@ nlohmann::json UserStatusTX::JSONify() const {
 	ret["signerspec"] = ss.str();
 	// FIXME return referenced patient spec and status type
 	ss.str(std::string());
-        hashOStream(ss, payload.get());
+        hashOStream(ss, payload);
         ss << "." << usdidx;
         ret["subjectspec"] = ss.str();
 	auto pload = std::string(reinterpret_cast<const char*>(GetJSONPayload()), GetJSONPayloadLength());
@@ -5,7 +5,7 @@
 
 namespace Catena {
 
-class UserStatusTX : public Transaction {
+class UserStatusTX final : public Transaction {
 public:
 UserStatusTX() = default;
 UserStatusTX(const CatenaHash& hash, unsigned idx) : Transaction(hash, idx) {}
@@ -14,19 +14,20 @@ bool Validate(TrustStore& tstore, LedgerMap& lmap) override;
 std::ostream& TXOStream(std::ostream& s) const override;
 std::pair<std::unique_ptr<unsigned char[]>, size_t> Serialize() const override;
 nlohmann::json JSONify() const override;
+bool SignatureCheckable(SignatureCheck* sc) const override;
 
 private:
-unsigned char signature[SIGLEN];
+const unsigned char* signature = nullptr; // within the lexed transaction
 CatenaHash signerhash;
 uint32_t signeridx;
 uint32_t usdidx;
 size_t siglen; // length of signature, up to SIGLEN
-std::unique_ptr<unsigned char[]> payload;
+const unsigned char* payload = nullptr;
 size_t payloadlen; // total length of signed payload
 
 const unsigned char*
 GetJSONPayload() const {
-	return payload.get() + signerhash.size() + 4;
+	return payload + signerhash.size() + 4;
 }
 
 size_t GetJSONPayloadLength() const {
@@ -53,8 +53,48 @@ ReadBinaryFile(const std::string& fname, size_t *len){
 	return memblock;
 }
 
-// FIXME move to mmap() could make this single-copy. exposing the mmap()ed data
-// via RAII-managed structure could make this zero-copy. two right now.
+void ReplaceBinaryFile(const std::string& fname, const void* data, size_t len,
+			bool sync){
+	std::vector<char> tmpname(fname.begin(), fname.end());
+	const char tmpsuffix[] = ".XXXXXX";
+	tmpname.insert(tmpname.end(), tmpsuffix, tmpsuffix + sizeof(tmpsuffix));
+	int fd = mkstemp(tmpname.data());
+	if(fd < 0){
+		throw std::ofstream::failure("couldn't create temporary file");
+	}
+	auto d = static_cast<const char*>(data);
+	size_t written = 0;
+	while(written < len){
+		auto w = write(fd, d + written, len - written);
+		if(w < 0){
+			break;
+		}
+		written += w;
+	}
+	bool synced = !sync || fsync(fd) == 0;
+	if(close(fd) || written < len || !synced){
+		unlink(tmpname.data());
+		throw std::ofstream::failure("error writing file");
+	}
+	if(rename(tmpname.data(), fname.c_str())){
+		unlink(tmpname.data());
+		throw std::ofstream::failure("couldn't replace file");
+	}
+	if(sync){
+		auto slash = fname.rfind('/');
+		auto dir = slash == std::string::npos ? std::string(".") : fname.substr(0, slash + 1);
+		int dfd = open(dir.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+		bool failed = dfd < 0 || fsync(dfd);
+		if(dfd >= 0){
+			close(dfd);
+		}
+		if(failed){
+			throw std::ofstream::failure("couldn't sync directory");
+		}
+	}
+}
+
+// Two copies; MappedFile offers zero-copy access to entire files.
 std::unique_ptr<unsigned char[]>
 ReadBinaryBlob(const std::string& fname, off_t offset, size_t len){
 	int fd = open(fname.c_str(), O_RDONLY | O_CLOEXEC);
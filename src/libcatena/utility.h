@@ -17,8 +17,8 @@
 namespace Catena {
 
 // Simple extractor of network byte order unsigned integers, safe for all
-// alignment restrictions.
-// FIXME rewrite as template<bytes> atop std::array
+// alignment restrictions. Where the width is known at compile time, prefer
+// LoadNBO() and WireReader (wire.h).
 inline unsigned long nbo_to_ulong(const unsigned char* data, int bytes){
 	unsigned long ret = 0;
 	while(bytes-- > 0){
@@ -30,9 +30,8 @@ inline unsigned long nbo_to_ulong(const unsigned char* data, int bytes){
 
 // Write an unsigned integer into the specified bytes using network byte order,
 // zeroing out any unused leading bytes. Returns the memory following the
-// written bytes.
-// FIXME throw exception if hbo won't fit in bytes
-// FIXME rewrite as template<bytes> atop std::array
+// written bytes. Where the width is known at compile time, prefer StoreNBO()
+// and WireWriter (wire.h), which reject values that won't fit.
 inline unsigned char* ulong_to_nbo(unsigned long hbo, unsigned char* data, int bytes){
 	int offset = bytes;
 	while(offset-- > 0){
@@ -73,11 +72,18 @@ std::unique_ptr<unsigned char[]>
 ReadBinaryFile(const std::string& fname, size_t *len);
 
 // Returns nullptr if the specified region was not available in the file. Throws
-// exceptions on inability to open file or read error. Copies the data; we might
-// want to rewrite this in a zero-copy fashion.
+// exceptions on inability to open file or read error. Copies the data; see
+// MappedFile for a zero-copy alternative.
 std::unique_ptr<unsigned char[]>
 ReadBinaryBlob(const std::string& fname, off_t offset, size_t len);
 
+// Write len bytes to a temporary alongside fname, and rename it over fname,
+// so that readers see either the old contents or the new, never a mix. If sync
+// is set, both the new contents and the rename are durable once we return.
+// Throws std::ofstream::failure on error, leaving fname untouched.
+void ReplaceBinaryFile(const std::string& fname, const void* data, size_t len,
+			bool sync = false);
+
 // Split a line into whitespace-delimited tokens, supporting simple quoting
 // using single quotes, plus escaping using backslash.
 std::vector<std::string> SplitInput(const char* line);
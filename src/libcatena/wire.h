@@ -0,0 +1,188 @@
+#ifndef CATENA_LIBCATENA_WIRE
+#define CATENA_LIBCATENA_WIRE
+
+#include <cstdint>
+#include <cstring>
+#include <endian.h>
+#include <stdexcept>
+#include <libcatena/exceptions.h>
+#include <libcatena/hash.h>
+
+namespace Catena {
+
+// Load a BYTES-byte big-endian unsigned integer, safe for all alignment
+// restrictions. Widths of 2, 4, and 8 compile to a load and a byte swap;
+// others are assembled from those.
+template<unsigned BYTES>
+inline uint64_t LoadNBO(const unsigned char* data){
+	static_assert(BYTES >= 1 && BYTES <= 8, "unsupported integer width");
+	if constexpr(BYTES == 1){
+		return data[0];
+	}else if constexpr(BYTES == 2){
+		uint16_t v;
+		memcpy(&v, data, sizeof(v));
+		return be16toh(v);
+	}else if constexpr(BYTES == 4){
+		uint32_t v;
+		memcpy(&v, data, sizeof(v));
+		return be32toh(v);
+	}else if constexpr(BYTES == 8){
+		uint64_t v;
+		memcpy(&v, data, sizeof(v));
+		return be64toh(v);
+	}else{
+		constexpr unsigned HI = BYTES > 4 ? 4 : 2;
+		return (LoadNBO<HI>(data) << (8 * (BYTES - HI))) | LoadNBO<BYTES - HI>(data + HI);
+	}
+}
+
+// Store the low BYTES bytes of val in big-endian order. Returns the memory
+// following the written bytes.
+template<unsigned BYTES>
+inline unsigned char* StoreNBO(uint64_t val, unsigned char* data){
+	static_assert(BYTES >= 1 && BYTES <= 8, "unsupported integer width");
+	if constexpr(BYTES == 1){
+		data[0] = val;
+	}else if constexpr(BYTES == 2){
+		uint16_t v = htobe16(val);
+		memcpy(data, &v, sizeof(v));
+	}else if constexpr(BYTES == 4){
+		uint32_t v = htobe32(val);
+		memcpy(data, &v, sizeof(v));
+	}else if constexpr(BYTES == 8){
+		uint64_t v = htobe64(val);
+		memcpy(data, &v, sizeof(v));
+	}else{
+		constexpr unsigned HI = BYTES > 4 ? 4 : 2;
+		StoreNBO<HI>(val >> (8 * (BYTES - HI)), data);
+		StoreNBO<BYTES - HI>(val, data + HI);
+	}
+	return data + BYTES;
+}
+
+// Bounds-checked cursor over serialized data. Running off the end throws E,
+// described by the what argument of the offending call, or failing that by
+// truncmsg.
+template<typename E>
+class WireReader {
+public:
+WireReader(const unsigned char* data, size_t len,
+		const char* truncmsg = "truncated input") :
+  data(data),
+  left(len),
+  truncmsg(truncmsg) {}
+
+template<unsigned BYTES>
+uint64_t Int(const char* what = nullptr) {
+	Need(BYTES, what);
+	auto ret = LoadNBO<BYTES>(data);
+	Skip(BYTES);
+	return ret;
+}
+
+// A BYTES-byte integer off bytes ahead, without advancing
+template<unsigned BYTES>
+uint64_t Peek(size_t off, const char* what = nullptr) const {
+	Need(off + BYTES, what);
+	return LoadNBO<BYTES>(data + off);
+}
+
+// A view of the next len bytes
+const unsigned char* Bytes(size_t len, const char* what = nullptr) {
+	Need(len, what);
+	auto ret = data;
+	Skip(len);
+	return ret;
+}
+
+CatenaHash Hash(const char* what = nullptr) {
+	CatenaHash ret;
+	memcpy(ret.data(), Bytes(ret.size(), what), ret.size());
+	return ret;
+}
+
+// A hash followed by a 32-bit index
+TXSpec Spec(const char* what = nullptr) {
+	auto hash = Hash(what);
+	return TXSpec(hash, Int<4>(what));
+}
+
+void Need(size_t len, const char* what = nullptr) const {
+	if(len > left){
+		throw E(what ? what : truncmsg);
+	}
+}
+
+// The remaining bytes, which are not consumed
+const unsigned char* Data() const {
+	return data;
+}
+
+size_t Left() const {
+	return left;
+}
+
+private:
+const unsigned char* data;
+size_t left;
+const char* truncmsg;
+
+void Skip(size_t len) {
+	data += len;
+	left -= len;
+}
+};
+
+// Bounds-checked cursor over a buffer being serialized into. Overrunning the
+// buffer, or writing a value too large for its field, is a programming error,
+// and throws std::out_of_range.
+class WireWriter {
+public:
+WireWriter(unsigned char* data, size_t len) :
+  data(data),
+  left(len) {}
+
+template<unsigned BYTES>
+void Int(uint64_t val) {
+	if(BYTES < 8 && (val >> (BYTES * 8 % 64)) != 0){
+		throw std::out_of_range("value too large for field");
+	}
+	Need(BYTES);
+	data = StoreNBO<BYTES>(val, data);
+	left -= BYTES;
+}
+
+void Bytes(const void* src, size_t len) {
+	Need(len);
+	memcpy(data, src, len);
+	data += len;
+	left -= len;
+}
+
+void Hash(const CatenaHash& hash) {
+	Bytes(hash.data(), hash.size());
+}
+
+void Spec(const TXSpec& spec) {
+	Hash(spec.first);
+	Int<4>(spec.second);
+}
+
+size_t Left() const {
+	return left;
+}
+
+private:
+unsigned char* data;
+size_t left;
+
+void Need(size_t len) const {
+	if(len > left){
+		throw std::out_of_range("serialization overran buffer");
+	}
+}
+};
+
+}
+
+#endif
@@ -0,0 +1,72 @@
+#ifndef CATENA_LIBCATENA_WORKERS
+#define CATENA_LIBCATENA_WORKERS
+
+#include <mutex>
+#include <atomic>
+#include <thread>
+#include <vector>
+#include <exception>
+#include <system_error>
+
+namespace Catena {
+
+// One worker per hardware thread, or one if that can't be determined
+inline unsigned DefaultWorkerCount() {
+	auto hw = std::thread::hardware_concurrency();
+	return hw ? hw : 1;
+}
+
+// Invoke fxn(i) for each i in [0, n), spread across up to workers threads (the
+// calling thread being one of them). Indices are handed out dynamically, so
+// uneven work balances itself. fxn must be safe to call concurrently. If any
+// invocation throws, no further indices are handed out, and one such exception
+// is rethrown once all workers have finished.
+template<typename F>
+void ParallelFor(unsigned workers, size_t n, const F& fxn) {
+	if(workers > n){
+		workers = n;
+	}
+	if(workers <= 1){
+		for(size_t i = 0 ; i < n ; ++i){
+			fxn(i);
+		}
+		return;
+	}
+	std::atomic<size_t> next(0);
+	std::exception_ptr err;
+	std::mutex errlock;
+	auto work = [&](){
+		size_t i;
+		while((i = next++) < n){
+			try{
+				fxn(i);
+			}catch(...){
+				std::lock_guard<std::mutex> guard(errlock);
+				if(!err){
+					err = std::current_exception();
+				}
+				next = n;
+			}
+		}
+	};
+	std::vector<std::thread> threads;
+	threads.reserve(workers - 1);
+	try{
+		while(threads.size() < workers - 1){
+			threads.emplace_back(work);
+		}
+	}catch(const std::system_error&){
+		// make do with however many threads we got
+	}
+	work();
+	for(auto& t : threads){
+		t.join();
+	}
+	if(err){
+		std::rethrow_exception(err);
+	}
+}
+
+}
+
+#endif
@@ -1,5 +1,9 @@
+#include <thread>
 #include <fstream>
+#include <unistd.h>
+#include <sys/stat.h>
 #include <gtest/gtest.h>
+#include <libcatena/utility.h>
 #include <libcatena/block.h>
 #include <libcatena/builtin.h>
 #include <libcatena/truststore.h>
@@ -10,7 +14,7 @@ TEST(CatenaBlocks, BlocksGenesisBlock){
 	Catena::TrustStore tstore;
 	Catena::BuiltinKeys bkeys;
         bkeys.AddToTrustStore(tstore);
-	Catena::Blocks cbs;
+	Catena::Blocks cbs(FixtureOptions());
 	ASSERT_FALSE(cbs.LoadFile(GENESISBLOCK_EXTERNAL, lmap, tstore));
 	EXPECT_EQ(1, cbs.GetBlockCount());
 	EXPECT_EQ(1, cbs.TXCount());
@@ -21,7 +25,7 @@ TEST(CatenaBlocks, BlocksMockLedger){
 	Catena::TrustStore tstore;
 	Catena::BuiltinKeys bkeys;
         bkeys.AddToTrustStore(tstore);
-	Catena::Blocks cbs;
+	Catena::Blocks cbs(FixtureOptions());
 	ASSERT_FALSE(cbs.LoadFile(MOCKLEDGER, lmap, tstore));
 	EXPECT_EQ(MOCKLEDGER_BLOCKS, cbs.GetBlockCount());
 	EXPECT_EQ(MOCKLEDGER_TXS, cbs.TXCount());
@@ -122,6 +126,31 @@ TEST(CatenaBlocks, ChainGenerated){
 	EXPECT_EQ(2, cbs.GetBlockCount());
 }
 
+// Generate a longer chain, enough to spread hash verification across threads,
+// and then corrupt a block in the middle of it
+TEST(CatenaBlocks, ChainGeneratedCorrupted){
+	Catena::LedgerMap lmap;
+	Catena::TrustStore tstore;
+	Catena::CatenaHash prevhash;
+	memset(prevhash.data(), 0xff, prevhash.size());
+	std::vector<unsigned char> ledger;
+	std::vector<size_t> offsets;
+	for(int i = 0 ; i < 64 ; ++i){
+		Catena::Block blk;
+		auto b = blk.SerializeBlock(prevhash);
+		offsets.push_back(ledger.size());
+		ledger.insert(ledger.end(), b.first.get(), b.first.get() + b.second);
+	}
+	Catena::Blocks cbs;
+	EXPECT_FALSE(cbs.LoadData(ledger.data(), ledger.size(), lmap, tstore));
+	EXPECT_EQ(64, cbs.GetBlockCount());
+	ledger[offsets[40] + Catena::Block::BLOCKHEADERLEN - 20] ^= 0x01; // utc
+	Catena::Blocks corrupt;
+	EXPECT_THROW(corrupt.LoadData(ledger.data(), ledger.size(), lmap, tstore),
+			Catena::BlockHeaderException);
+	EXPECT_EQ(0, corrupt.GetBlockCount());
+}
+
 // Generate two simple blocks, and append the second using AppendData
 TEST(CatenaBlocks, BlockAppendBlock){
 	Catena::LedgerMap lmap;
@@ -150,7 +179,7 @@ TEST(CatenaBlocks, BlockInspectMockLedger){
 	Catena::TrustStore tstore;
 	Catena::BuiltinKeys bkeys;
         bkeys.AddToTrustStore(tstore);
-	Catena::Blocks cbs;
+	Catena::Blocks cbs(FixtureOptions());
 	ASSERT_FALSE(cbs.LoadFile(MOCKLEDGER, lmap, tstore));
 	EXPECT_EQ(MOCKLEDGER_BLOCKS, cbs.GetBlockCount());
 	auto i = cbs.Inspect(0, cbs.GetBlockCount());
@@ -158,3 +187,638 @@ TEST(CatenaBlocks, BlockInspectMockLedger){
 	EXPECT_EQ(1, i[0].transactions.size());
 	EXPECT_EQ(1, i[1].transactions.size());
 }
+
+// Transactions view their block, and must keep it alive after the block and
+// the ledger are gone
+TEST(CatenaBlocks, InspectTXOutlivesLedger){
+	std::shared_ptr<const Catena::Transaction> tx;
+	nlohmann::json expected;
+	{
+		Catena::LedgerMap lmap;
+		Catena::TrustStore tstore;
+		Catena::BuiltinKeys bkeys;
+		bkeys.AddToTrustStore(tstore);
+		Catena::Blocks cbs(FixtureOptions());
+		ASSERT_FALSE(cbs.LoadFile(MOCKLEDGER, lmap, tstore));
+		auto i = cbs.Inspect(1, 1);
+		ASSERT_EQ(1, i.size());
+		ASSERT_EQ(1, i[0].transactions.size());
+		tx = i[0].transactions[0];
+		expected = tx->JSONify();
+	}
+	EXPECT_EQ(expected, tx->JSONify());
+}
+
+// Reassemble all of the mock ledger's transactions into a single block, whose
+// body ought be exactly their cached serializations, in order
+TEST(CatenaBlocks, BlockSerializeMockTXs){
+	Catena::LedgerMap lmap;
+	Catena::TrustStore tstore;
+	Catena::BuiltinKeys bkeys;
+	bkeys.AddToTrustStore(tstore);
+	Catena::Blocks cbs(FixtureOptions());
+	ASSERT_FALSE(cbs.LoadFile(MOCKLEDGER, lmap, tstore));
+	Catena::Block blk;
+	std::vector<unsigned char> body;
+	for(const auto& b : cbs.Inspect(0, -1)){
+		for(const auto& tx : b.transactions){
+			auto ser = tx->Serialize();
+			body.insert(body.end(), ser.first.get(), ser.first.get() + ser.second);
+			std::shared_ptr<unsigned char> txbuf(ser.first.release(),
+						std::default_delete<unsigned char[]>());
+			auto lexed = Catena::Transaction::LexTX(txbuf.get(), ser.second,
+						b.bhdr.hash, 0, txbuf);
+			auto cached = lexed->Serialized();
+			EXPECT_EQ(cached.first, lexed->Serialized().first); // serialized once
+			EXPECT_EQ(cached.second, lexed->SerializedSize());
+			blk.AddTransaction(std::move(lexed));
+		}
+	}
+	ASSERT_EQ(MOCKLEDGER_TXS, blk.TransactionCount());
+	Catena::CatenaHash prevhash;
+	memset(prevhash.data(), 0xff, prevhash.size());
+	auto b = blk.SerializeBlock(prevhash);
+	ASSERT_EQ(Catena::Block::BLOCKHEADERLEN + 4 * MOCKLEDGER_TXS + body.size(), b.second);
+	EXPECT_EQ(0, memcmp(b.first.get() + b.second - body.size(), body.data(), body.size()));
+}
+
+// Look up every block of the mock ledger by hash and by timestamp
+TEST(CatenaBlocks, BlockLookupMockLedger){
+	Catena::LedgerMap lmap;
+	Catena::TrustStore tstore;
+	Catena::BuiltinKeys bkeys;
+        bkeys.AddToTrustStore(tstore);
+	Catena::Blocks cbs(FixtureOptions());
+	ASSERT_FALSE(cbs.LoadFile(MOCKLEDGER, lmap, tstore));
+	auto i = cbs.Inspect(0, -1);
+	ASSERT_EQ(MOCKLEDGER_BLOCKS, i.size());
+	for(unsigned b = 0 ; b < i.size() ; ++b){
+		EXPECT_EQ(b, cbs.IdxByHash(i[b].bhdr.hash));
+		auto t = cbs.IdxByUTC(i[b].bhdr.utc);
+		EXPECT_GE(b, t);
+		EXPECT_EQ(i[b].bhdr.utc, i[t].bhdr.utc);
+		if(t){
+			EXPECT_GT(i[b].bhdr.utc, i[t - 1].bhdr.utc);
+		}
+	}
+	EXPECT_EQ(0, cbs.IdxByUTC(0));
+	EXPECT_EQ(cbs.GetBlockCount(), cbs.IdxByUTC(i.back().bhdr.utc + 1));
+	Catena::CatenaHash hash;
+	hash.fill(0x5a);
+	EXPECT_THROW(cbs.IdxByHash(hash), std::out_of_range);
+	// reloading must not retain stale entries
+	Catena::LedgerMap lmap2;
+	Catena::TrustStore tstore2;
+        bkeys.AddToTrustStore(tstore2);
+	ASSERT_FALSE(cbs.LoadFile(GENESISBLOCK_EXTERNAL, lmap2, tstore2));
+	EXPECT_THROW(cbs.IdxByHash(i[1].bhdr.hash), std::out_of_range);
+	EXPECT_EQ(0, cbs.IdxByHash(cbs.HashByIdx(0)));
+}
+
+// Repeated inspection is served from the cache, sharing transactions
+TEST(CatenaBlocks, InspectCache){
+	Catena::LedgerMap lmap;
+	Catena::TrustStore tstore;
+	Catena::BuiltinKeys bkeys;
+        bkeys.AddToTrustStore(tstore);
+	Catena::Blocks cbs(FixtureOptions());
+	ASSERT_FALSE(cbs.LoadFile(MOCKLEDGER, lmap, tstore));
+	auto i1 = cbs.Inspect(0, -1);
+	auto stats = cbs.CacheStats();
+	EXPECT_EQ(0, stats.hits);
+	EXPECT_EQ(MOCKLEDGER_BLOCKS, stats.misses);
+	EXPECT_EQ(MOCKLEDGER_BLOCKS, stats.entries);
+	auto i2 = cbs.Inspect(0, -1);
+	stats = cbs.CacheStats();
+	EXPECT_EQ(MOCKLEDGER_BLOCKS, stats.hits);
+	ASSERT_EQ(i1.size(), i2.size());
+	for(size_t b = 0 ; b < i1.size() ; ++b){
+		ASSERT_EQ(i1[b].transactions.size(), i2[b].transactions.size());
+		EXPECT_EQ(i1[b].transactions[0].get(), i2[b].transactions[0].get());
+	}
+	auto opts = FixtureOptions();
+	opts.cache_bytes = 0;
+	Catena::Blocks uncached(opts);
+	ASSERT_FALSE(uncached.LoadFile(MOCKLEDGER, lmap, tstore));
+	uncached.Inspect(0, -1);
+	EXPECT_EQ(0, uncached.CacheStats().entries);
+}
+
+// A BlockRange yields the same blocks as Inspect(), without filling the cache
+TEST(CatenaBlocks, InspectRange){
+	Catena::LedgerMap lmap;
+	Catena::TrustStore tstore;
+	Catena::BuiltinKeys bkeys;
+        bkeys.AddToTrustStore(tstore);
+	Catena::Blocks cbs(FixtureOptions());
+	ASSERT_FALSE(cbs.LoadFile(MOCKLEDGER, lmap, tstore));
+	auto range = cbs.InspectRange(2, -1);
+	EXPECT_EQ(MOCKLEDGER_BLOCKS - 2, range.size());
+	EXPECT_EQ(range.size(), std::distance(range.begin(), range.end()));
+	EXPECT_EQ(0, cbs.CacheStats().misses); // nothing parsed yet
+	unsigned idx = 2;
+	for(const auto& b : range){
+		EXPECT_EQ(cbs.HashByIdx(idx), b.bhdr.hash);
+		++idx;
+	}
+	EXPECT_EQ(MOCKLEDGER_BLOCKS, idx);
+	EXPECT_EQ(0, cbs.CacheStats().entries);
+	auto all = cbs.Inspect(0, -1);
+	auto it = cbs.InspectRange(0, -1).begin();
+	for(const auto& b : all){
+		EXPECT_EQ(b.offset, (it++)->offset);
+	}
+	EXPECT_EQ(1, cbs.InspectRange(3, 3).size());
+	EXPECT_TRUE(cbs.InspectRange(MOCKLEDGER_BLOCKS + 1, -1).empty());
+	EXPECT_TRUE(cbs.InspectRange(-1, -1).empty());
+	EXPECT_TRUE(cbs.InspectRange(5, 2).empty());
+}
+
+// Least recently used entries are evicted to stay within the budget
+// Ranges may be walked while blocks are appended, the in-memory ledger being
+// reallocated beneath them
+TEST(CatenaBlocks, InspectWhileAppending){
+	Catena::LedgerMap lmap;
+	Catena::TrustStore tstore;
+	Catena::CatenaHash prevhash;
+	memset(prevhash.data(), 0xff, prevhash.size());
+	Catena::Block blk;
+	auto b = blk.SerializeBlock(prevhash);
+	Catena::Blocks cbs;
+	ASSERT_FALSE(cbs.LoadData(b.first.get(), b.second, lmap, tstore));
+	constexpr unsigned APPENDS = 200;
+	std::thread appender([&](){
+		for(unsigned i = 0 ; i < APPENDS ; ++i){
+			auto nb = blk.SerializeBlock(prevhash);
+			EXPECT_FALSE(cbs.AppendBlock(nb.first.get(), nb.second, lmap, tstore));
+		}
+	});
+	size_t walked = 0;
+	while(walked < APPENDS + 1){
+		auto range = cbs.InspectRange(0, -1);
+		walked = 0;
+		for(const auto& bd : range){
+			EXPECT_EQ(walked, bd.bhdr.txidx);
+			++walked;
+		}
+		EXPECT_EQ(range.size(), walked);
+	}
+	appender.join();
+}
+
+TEST(CatenaBlocks, BlockCacheEviction){
+	Catena::BlockCache cache(25);
+	auto detail = [](){
+		return std::make_shared<const Catena::BlockDetail>(Catena::BlockHeader(), 0,
+			nullptr, std::vector<std::unique_ptr<Catena::Transaction>>());
+	};
+	cache.Put(0, detail(), 10);
+	cache.Put(1, detail(), 10);
+	EXPECT_TRUE(cache.Get(0) != nullptr); // 1 is now least recently used
+	cache.Put(2, detail(), 10);
+	EXPECT_TRUE(cache.Get(1) == nullptr);
+	EXPECT_TRUE(cache.Get(0) != nullptr);
+	EXPECT_TRUE(cache.Get(2) != nullptr);
+	cache.Put(3, detail(), 26); // too large to ever cache
+	EXPECT_TRUE(cache.Get(3) == nullptr);
+	auto stats = cache.Stats();
+	EXPECT_EQ(2, stats.entries);
+	EXPECT_EQ(20, stats.bytes);
+	EXPECT_EQ(3, stats.hits);
+	EXPECT_EQ(2, stats.misses);
+	// truncation must forget indices which might be reused
+	cache.Put(1, detail(), 5);
+	cache.EraseFrom(1);
+	EXPECT_TRUE(cache.Get(2) == nullptr);
+	EXPECT_TRUE(cache.Get(1) == nullptr);
+	EXPECT_TRUE(cache.Get(0) != nullptr);
+	stats = cache.Stats();
+	EXPECT_EQ(1, stats.entries);
+	EXPECT_EQ(10, stats.bytes);
+	cache.Clear();
+	EXPECT_EQ(0, cache.Stats().entries);
+}
+
+// Append a block to a file-backed ledger, and inspect it via the mapping.
+// Views handed out prior to the append must remain valid.
+TEST(CatenaBlocks, BlockAppendMapped){
+	size_t len;
+	auto ledger = Catena::ReadBinaryFile(MOCKLEDGER, &len);
+	char fname[] = "catenatest-ledger-XXXXXX";
+	int fd = mkstemp(fname);
+	ASSERT_LE(0, fd);
+	ASSERT_EQ(len, write(fd, ledger.get(), len));
+	close(fd);
+	Catena::LedgerMap lmap;
+	Catena::TrustStore tstore;
+	Catena::BuiltinKeys bkeys;
+        bkeys.AddToTrustStore(tstore);
+	Catena::Blocks cbs;
+	ASSERT_FALSE(cbs.LoadFile(fname, lmap, tstore));
+	auto before = cbs.Inspect(0, 0);
+	ASSERT_EQ(1, before.size());
+	Catena::CatenaHash prevhash;
+	cbs.GetLastHash(prevhash);
+	std::unique_ptr<const unsigned char[]> b;
+	size_t s;
+	Catena::Block blk;
+	std::tie(b, s) = blk.SerializeBlock(prevhash);
+	EXPECT_FALSE(cbs.AppendBlock(b.get(), s, lmap, tstore));
+	EXPECT_EQ(MOCKLEDGER_BLOCKS + 1, cbs.GetBlockCount());
+	EXPECT_EQ(len + s, cbs.Size());
+	auto after = cbs.Inspect(MOCKLEDGER_BLOCKS, -1);
+	ASSERT_EQ(1, after.size());
+	EXPECT_EQ(len, after[0].offset);
+	EXPECT_EQ(0, memcmp(b.get(), after[0].bytes.get(), s));
+	EXPECT_EQ(0, memcmp(ledger.get(), before[0].bytes.get(), before[0].bhdr.totlen));
+	Catena::LedgerMap lmap2;
+	Catena::TrustStore tstore2;
+        bkeys.AddToTrustStore(tstore2);
+	ASSERT_FALSE(cbs.SaveIndex());
+	Catena::Blocks reloaded;
+	ASSERT_FALSE(reloaded.LoadFile(fname, lmap2, tstore2));
+	EXPECT_EQ(MOCKLEDGER_BLOCKS + 1, reloaded.GetBlockCount());
+	unlink(fname);
+	unlink(Catena::Blocks::IndexName(fname, false).c_str());
+}
+
+// Appends to a file-backed ledger are synced (unless disabled) and counted
+TEST(CatenaBlocks, BlockAppendDurable){
+	for(bool durable : {true, false}){
+		char fname[] = "catenatest-ledger-XXXXXX";
+		int fd = mkstemp(fname);
+		ASSERT_LE(0, fd);
+		close(fd);
+		Catena::LedgerOptions opts;
+		opts.durable = durable;
+		Catena::LedgerMap lmap;
+		Catena::TrustStore tstore;
+		Catena::Blocks cbs(opts);
+		ASSERT_FALSE(cbs.LoadFile(fname, lmap, tstore));
+		size_t total = 0;
+		Catena::CatenaHash prevhash;
+		cbs.GetLastHash(prevhash);
+		for(int i = 0 ; i < 3 ; ++i){
+			std::unique_ptr<const unsigned char[]> b;
+			size_t s;
+			Catena::Block blk;
+			std::tie(b, s) = blk.SerializeBlock(prevhash);
+			EXPECT_FALSE(cbs.AppendBlock(b.get(), s, lmap, tstore));
+			total += s;
+		}
+		// a block which doesn't chain leaves everything untouched
+		Catena::CatenaHash badhash;
+		badhash.fill(0);
+		std::unique_ptr<const unsigned char[]> b;
+		size_t s;
+		Catena::Block blk;
+		std::tie(b, s) = blk.SerializeBlock(badhash);
+		EXPECT_THROW(cbs.AppendBlock(b.get(), s, lmap, tstore), Catena::BlockHeaderException);
+		EXPECT_EQ(3, cbs.GetBlockCount());
+		EXPECT_EQ(total, cbs.Size());
+		auto stats = cbs.CommitStats();
+		EXPECT_EQ(3, stats.commits);
+		EXPECT_EQ(total, stats.bytes);
+		EXPECT_EQ(durable ? 3 : 0, stats.syncs);
+		EXPECT_LE(stats.max_us, stats.total_us);
+		struct stat st;
+		ASSERT_EQ(0, stat(fname, &st));
+		EXPECT_EQ(total, st.st_size);
+		ASSERT_FALSE(cbs.SaveIndex());
+		unlink(fname);
+		unlink(Catena::Blocks::IndexName(fname, false).c_str());
+	}
+}
+
+// Load a ledger file with fresh metadata, returning the number of blocks
+static unsigned LoadLedgerFile(const std::string& fname){
+	Catena::LedgerMap lmap;
+	Catena::TrustStore tstore;
+	Catena::BuiltinKeys bkeys;
+        bkeys.AddToTrustStore(tstore);
+	Catena::Blocks cbs;
+	if(cbs.LoadFile(fname, lmap, tstore)){
+		return 0;
+	}
+	return cbs.GetBlockCount();
+}
+
+// The sidecar index is trusted in lieu of lexing and hashing the blocks it
+// covers, is extended as the ledger grows, and is ignored when corrupt
+TEST(CatenaBlocks, LedgerIndex){
+	size_t len;
+	auto ledger = Catena::ReadBinaryFile(MOCKLEDGER, &len);
+	char fname[] = "catenatest-ledger-XXXXXX";
+	int fd = mkstemp(fname);
+	ASSERT_LE(0, fd);
+	ASSERT_EQ(len, write(fd, ledger.get(), len));
+	close(fd);
+	auto iname = Catena::Blocks::IndexName(fname, false);
+	struct stat st;
+	{
+		Catena::LedgerMap lmap;
+		Catena::TrustStore tstore;
+		Catena::BuiltinKeys bkeys;
+		bkeys.AddToTrustStore(tstore);
+		Catena::Blocks cbs(FixtureOptions());
+		ASSERT_FALSE(cbs.LoadFile(fname, lmap, tstore));
+	}
+	EXPECT_NE(0, stat(iname.c_str(), &st)); // disabled, so never written
+	size_t off10;
+	{
+		Catena::LedgerMap lmap;
+		Catena::TrustStore tstore;
+		Catena::BuiltinKeys bkeys;
+		bkeys.AddToTrustStore(tstore);
+		Catena::Blocks cbs;
+		ASSERT_FALSE(cbs.LoadFile(fname, lmap, tstore));
+		off10 = cbs.Inspect(10, 10).at(0).offset;
+	}
+	ASSERT_EQ(0, stat(iname.c_str(), &st));
+	EXPECT_LT(MOCKLEDGER_BLOCKS * (Catena::HASHLEN + 16), st.st_size);
+	// Damage block 10's stored hash. Only the index can save us now.
+	std::fstream fs(fname, std::ios::in | std::ios::out | std::ios::binary);
+	fs.seekp(off10);
+	fs.put(~ledger[off10]);
+	fs.close();
+	{
+		Catena::LedgerMap lmap;
+		Catena::TrustStore tstore;
+		Catena::BuiltinKeys bkeys;
+		bkeys.AddToTrustStore(tstore);
+		Catena::Blocks cbs;
+		ASSERT_FALSE(cbs.LoadFile(fname, lmap, tstore));
+		EXPECT_EQ(MOCKLEDGER_BLOCKS, cbs.GetBlockCount());
+		EXPECT_EQ(MOCKLEDGER_PUBKEYS, tstore.PubkeyCount());
+		Catena::CatenaHash prevhash;
+		cbs.GetLastHash(prevhash);
+		Catena::Block blk;
+		auto b = blk.SerializeBlock(prevhash);
+		ASSERT_FALSE(cbs.AppendBlock(b.first.get(), b.second, lmap, tstore));
+	} // index is brought up to date here
+	EXPECT_EQ(MOCKLEDGER_BLOCKS + 1, LoadLedgerFile(fname));
+	// A corrupt index is ignored, exposing the damage
+	fs.open(iname, std::ios::in | std::ios::out | std::ios::binary);
+	fs.seekp(st.st_size / 2);
+	fs.put(0x5a);
+	fs.close();
+	EXPECT_THROW(LoadLedgerFile(fname), Catena::BlockHeaderException);
+	unlink(fname);
+	unlink(iname.c_str());
+}
+
+// Given the index and an anchor at its last block (as when restoring a
+// snapshot), blocks up through the anchor are never read, so damage to their
+// bodies goes unnoticed
+TEST(CatenaBlocks, LedgerIndexAnchored){
+	size_t len;
+	auto ledger = Catena::ReadBinaryFile(MOCKLEDGER, &len);
+	char fname[] = "catenatest-ledger-XXXXXX";
+	int fd = mkstemp(fname);
+	ASSERT_LE(0, fd);
+	ASSERT_EQ(len, write(fd, ledger.get(), len));
+	close(fd);
+	auto iname = Catena::Blocks::IndexName(fname, false);
+	Catena::LedgerMap lmap;
+	Catena::TrustStore tstore;
+	Catena::BuiltinKeys bkeys;
+	bkeys.AddToTrustStore(tstore);
+	Catena::LedgerAnchor anchor;
+	std::array<unsigned, Catena::TXTYPELIMIT> types;
+	Catena::BlockHeader victim{};
+	size_t voff = 0;
+	{
+		Catena::Blocks cbs;
+		ASSERT_FALSE(cbs.LoadFile(fname, lmap, tstore));
+		anchor = {cbs.GetBlockCount(), cbs.HashByIdx(cbs.GetBlockCount() - 1)};
+		types = cbs.TXTypeCounts();
+		for(auto& b : cbs.Inspect(0, MOCKLEDGER_BLOCKS - 2)){
+			if(b.bhdr.txcount){
+				victim = b.bhdr;
+				voff = b.offset;
+				break;
+			}
+		}
+	}
+	ASSERT_LT(0, victim.txcount);
+	// Wipe the victim's offset table and transactions
+	std::vector<char> junk(victim.totlen - Catena::Block::BLOCKHEADERLEN, '\xff');
+	std::fstream fs(fname, std::ios::in | std::ios::out | std::ios::binary);
+	fs.seekp(voff + Catena::Block::BLOCKHEADERLEN);
+	fs.write(junk.data(), junk.size());
+	fs.close();
+	{
+		Catena::Blocks cbs;
+		ASSERT_FALSE(cbs.LoadFile(fname, lmap, tstore, &anchor));
+		EXPECT_EQ(MOCKLEDGER_BLOCKS, cbs.GetBlockCount());
+		EXPECT_EQ(MOCKLEDGER_TXS, cbs.TXCount());
+		EXPECT_EQ(types, cbs.TXTypeCounts());
+	}
+	// without the index, the damage is found
+	unlink(iname.c_str());
+	EXPECT_THROW(LoadLedgerFile(fname), Catena::BlockHeaderException);
+	unlink(fname);
+	unlink(iname.c_str());
+}
+
+static void LoadMockLedgerWorkers(const unsigned char* data, size_t len,
+			unsigned workers, bool expectfail){
+	Catena::LedgerMap lmap;
+	Catena::TrustStore tstore;
+	Catena::BuiltinKeys bkeys;
+        bkeys.AddToTrustStore(tstore);
+	Catena::LedgerOptions opts;
+	opts.workers = workers;
+	Catena::Blocks cbs(opts);
+	EXPECT_EQ(expectfail, cbs.LoadData(data, len, lmap, tstore));
+	if(!expectfail){
+		EXPECT_EQ(MOCKLEDGER_BLOCKS, cbs.GetBlockCount());
+		EXPECT_EQ(MOCKLEDGER_PUBKEYS, tstore.PubkeyCount());
+		EXPECT_EQ(MOCKLEDGER_TXS, cbs.TXCount());
+	}else{ // everything applied prior to the failure must be rolled back
+		EXPECT_EQ(bkeys.Count(), tstore.PubkeyCount());
+		EXPECT_EQ(0, lmap.ConsortiumMemberCount());
+		EXPECT_EQ(0, lmap.UserCount());
+		EXPECT_EQ(0, lmap.LookupRequestCount());
+	}
+}
+
+// Signature checks are batched out to workers. Results ought be the same as
+// when verified serially, both for good and bad signatures.
+TEST(CatenaBlocks, BlocksParallelSignatures){
+	size_t len;
+	auto ledger = Catena::ReadBinaryFile(MOCKLEDGER, &len);
+	for(unsigned workers : { 1, 2, 8 }){
+		LoadMockLedgerWorkers(ledger.get(), len, workers, false);
+	}
+	// Corrupt the first signature of the last block, and rehash the block
+	Catena::LedgerMap lmap;
+	Catena::TrustStore tstore;
+	Catena::BuiltinKeys bkeys;
+        bkeys.AddToTrustStore(tstore);
+	Catena::Blocks cbs;
+	ASSERT_FALSE(cbs.LoadData(ledger.get(), len, lmap, tstore));
+	auto last = cbs.Inspect(MOCKLEDGER_BLOCKS - 1, -1);
+	ASSERT_EQ(1, last.size());
+	auto blk = ledger.get() + last[0].offset;
+	auto tx = blk + Catena::Block::BLOCKHEADERLEN + 4 * last[0].bhdr.txcount;
+	tx[44] ^= 0x01; // within the signature for all transaction types
+	Catena::catenaHash(blk + Catena::HASHLEN, last[0].bhdr.totlen - Catena::HASHLEN, blk);
+	for(unsigned workers : { 1, 2, 8 }){
+		LoadMockLedgerWorkers(ledger.get(), len, workers, true);
+	}
+}
+
+static void RemoveLedgerDir(const std::string& dir, unsigned segments){
+	for(unsigned i = 0 ; i < segments ; ++i){
+		auto sname = Catena::Blocks::SegmentName(dir, i);
+		unlink(sname.c_str());
+		unlink(sname.replace(sname.size() - 4, 4, Catena::Blocks::ARCHIVESUFFIX).c_str());
+	}
+	unlink(Catena::Blocks::IndexName(dir, true).c_str());
+	rmdir(dir.c_str());
+}
+
+// Split the mock ledger into one segment per block, and load the directory
+TEST(CatenaBlocks, SegmentedMockLedger){
+	size_t len;
+	auto ledger = Catena::ReadBinaryFile(MOCKLEDGER, &len);
+	Catena::LedgerMap lmap;
+	Catena::TrustStore tstore;
+	Catena::BuiltinKeys bkeys;
+        bkeys.AddToTrustStore(tstore);
+	Catena::Blocks cbs;
+	ASSERT_FALSE(cbs.LoadData(ledger.get(), len, lmap, tstore));
+	char dtemplate[] = "catenatest-segments-XXXXXX";
+	ASSERT_NE(nullptr, mkdtemp(dtemplate));
+	std::string dir = dtemplate;
+	auto blocks = cbs.Inspect(0, -1);
+	ASSERT_EQ(MOCKLEDGER_BLOCKS, blocks.size());
+	for(unsigned i = 0 ; i < blocks.size() ; ++i){
+		std::ofstream ofs(Catena::Blocks::SegmentName(dir, i), std::ios::binary);
+		ofs.write(reinterpret_cast<const char*>(blocks[i].bytes.get()),
+				blocks[i].bhdr.totlen);
+	}
+	Catena::LedgerMap lmap2;
+	Catena::TrustStore tstore2;
+        bkeys.AddToTrustStore(tstore2);
+	Catena::Blocks segmented;
+	ASSERT_FALSE(segmented.LoadFile(dir, lmap2, tstore2));
+	EXPECT_EQ(MOCKLEDGER_BLOCKS, segmented.GetBlockCount());
+	EXPECT_EQ(MOCKLEDGER_TXS, segmented.TXCount());
+	EXPECT_EQ(MOCKLEDGER_PUBKEYS, tstore2.PubkeyCount());
+	EXPECT_EQ(len, segmented.Size());
+	auto i = segmented.Inspect(5, 5);
+	ASSERT_EQ(1, i.size());
+	EXPECT_EQ(0, memcmp(blocks[5].bytes.get(), i[0].bytes.get(), blocks[5].bhdr.totlen));
+	// a missing segment must be detected
+	unlink(Catena::Blocks::SegmentName(dir, 7).c_str());
+	Catena::Blocks missing;
+	EXPECT_THROW(missing.LoadFile(dir, lmap2, tstore2), Catena::BlockValidationException);
+	RemoveLedgerDir(dir, blocks.size());
+}
+
+// Append to an empty ledger directory, rolling over with each block, and
+// then check that out-of-order segments are detected at their boundaries
+TEST(CatenaBlocks, SegmentedAppendRollover){
+	char dtemplate[] = "catenatest-segments-XXXXXX";
+	ASSERT_NE(nullptr, mkdtemp(dtemplate));
+	std::string dir = dtemplate;
+	Catena::LedgerOptions opts;
+	opts.segment_size = 1;
+	Catena::LedgerMap lmap;
+	Catena::TrustStore tstore;
+	Catena::Blocks cbs(opts);
+	ASSERT_FALSE(cbs.LoadFile(dir, lmap, tstore));
+	EXPECT_EQ(0, cbs.GetBlockCount());
+	for(int i = 0 ; i < 3 ; ++i){
+		Catena::CatenaHash prevhash;
+		cbs.GetLastHash(prevhash);
+		Catena::Block blk;
+		auto b = blk.SerializeBlock(prevhash);
+		ASSERT_FALSE(cbs.AppendBlock(b.first.get(), b.second, lmap, tstore));
+	}
+	EXPECT_EQ(3, cbs.GetBlockCount());
+	ASSERT_FALSE(cbs.SaveIndex());
+	auto i = cbs.Inspect(2, 2);
+	ASSERT_EQ(1, i.size());
+	struct stat st;
+	for(unsigned s = 0 ; s < 3 ; ++s){
+		ASSERT_EQ(0, stat(Catena::Blocks::SegmentName(dir, s).c_str(), &st));
+		EXPECT_EQ(i[0].bhdr.totlen, st.st_size);
+	}
+	Catena::Blocks reloaded(opts);
+	ASSERT_FALSE(reloaded.LoadFile(dir, lmap, tstore));
+	EXPECT_EQ(3, reloaded.GetBlockCount());
+	ASSERT_EQ(0, rename(Catena::Blocks::SegmentName(dir, 1).c_str(),
+				(dir + "/tmp").c_str()));
+	ASSERT_EQ(0, rename(Catena::Blocks::SegmentName(dir, 2).c_str(),
+				Catena::Blocks::SegmentName(dir, 1).c_str()));
+	ASSERT_EQ(0, rename((dir + "/tmp").c_str(),
+				Catena::Blocks::SegmentName(dir, 2).c_str()));
+	Catena::Blocks swapped(opts);
+	EXPECT_THROW(swapped.LoadFile(dir, lmap, tstore), Catena::BlockHeaderException);
+	RemoveLedgerDir(dir, 3);
+}
+
+// Split the mock ledger into four segments, and load it with archiving
+// enabled, compressing all but the last. Blocks and transactions must be
+// unchanged, both immediately and when loaded from the archives, with and
+// without the sidecar index.
+TEST(CatenaBlocks, SegmentArchives){
+	size_t len;
+	auto ledger = Catena::ReadBinaryFile(MOCKLEDGER, &len);
+	Catena::LedgerMap lmap;
+	Catena::TrustStore tstore;
+	Catena::BuiltinKeys bkeys;
+	bkeys.AddToTrustStore(tstore);
+	Catena::Blocks cbs;
+	ASSERT_FALSE(cbs.LoadData(ledger.get(), len, lmap, tstore));
+	char dtemplate[] = "catenatest-segments-XXXXXX";
+	ASSERT_NE(nullptr, mkdtemp(dtemplate));
+	std::string dir = dtemplate;
+	auto blocks = cbs.Inspect(0, -1);
+	ASSERT_EQ(MOCKLEDGER_BLOCKS, blocks.size());
+	for(unsigned i = 0 ; i < blocks.size() ; ++i){
+		std::ofstream ofs(Catena::Blocks::SegmentName(dir, i / 5),
+				std::ios::binary | std::ios::app);
+		ofs.write(reinterpret_cast<const char*>(blocks[i].bytes.get()),
+				blocks[i].bhdr.totlen);
+	}
+	Catena::LedgerOptions opts;
+	opts.archive = true;
+	opts.archive_chunk = 1; // one block per chunk
+	auto check = [&](const Catena::Blocks& b){
+		EXPECT_EQ(MOCKLEDGER_BLOCKS, b.GetBlockCount());
+		EXPECT_EQ(MOCKLEDGER_TXS, b.TXCount());
+		EXPECT_EQ(len, b.Size());
+		auto i = b.Inspect(0, -1);
+		ASSERT_EQ(blocks.size(), i.size());
+		for(unsigned n = 0 ; n < i.size() ; ++n){
+			ASSERT_EQ(blocks[n].bhdr.totlen, i[n].bhdr.totlen);
+			EXPECT_EQ(0, memcmp(blocks[n].bytes.get(), i[n].bytes.get(), blocks[n].bhdr.totlen));
+		}
+		Catena::TXSpec spec(blocks[7].bhdr.hash, 0);
+		EXPECT_EQ(cbs.InspectTX(spec)->JSONify(), b.InspectTX(spec)->JSONify());
+	};
+	for(int pass = 0 ; pass < 3 ; ++pass){
+		Catena::LedgerMap lmap2;
+		Catena::TrustStore tstore2;
+		bkeys.AddToTrustStore(tstore2);
+		opts.sidecar_index = pass < 2;
+		Catena::Blocks archived(opts);
+		ASSERT_FALSE(archived.LoadFile(dir, lmap2, tstore2));
+		EXPECT_EQ(MOCKLEDGER_PUBKEYS, tstore2.PubkeyCount());
+		check(archived);
+		EXPECT_EQ(0, archived.ArchiveSegments()); // nothing left to archive
+	}
+	struct stat st;
+	for(unsigned s = 0 ; s < 3 ; ++s){
+		auto sname = Catena::Blocks::SegmentName(dir, s);
+		EXPECT_NE(0, stat(sname.c_str(), &st));
+		sname.replace(sname.size() - 4, 4, Catena::Blocks::ARCHIVESUFFIX);
+		EXPECT_EQ(0, stat(sname.c_str(), &st));
+	}
+	EXPECT_EQ(0, stat(Catena::Blocks::SegmentName(dir, 3).c_str(), &st));
+	RemoveLedgerDir(dir, 4);
+}
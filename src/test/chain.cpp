@@ -1,3 +1,5 @@
+#include <map>
+#include <cstring>
 #include <gtest/gtest.h>
 #include <libcatena/externallookuptx.h>
 #include <libcatena/keypair.h>
@@ -5,7 +7,7 @@
 #include "test/defs.h"
 
 TEST(CatenaChain, ChainGenesisBlock){
-	Catena::Chain chain(GENESISBLOCK_EXTERNAL);
+	Catena::Chain chain(GENESISBLOCK_EXTERNAL, FixtureOptions());
 	EXPECT_EQ(2, chain.PubkeyCount());
 	EXPECT_EQ(1, chain.GetBlockCount());
 	EXPECT_EQ(1, chain.TXCount());
@@ -14,7 +16,7 @@ TEST(CatenaChain, ChainGenesisBlock){
 }
 
 TEST(CatenaChain, ChainGenesisMock){
-	Catena::Chain chain(MOCKLEDGER);
+	Catena::Chain chain(MOCKLEDGER, FixtureOptions());
 	EXPECT_EQ(MOCKLEDGER_PUBKEYS, chain.PubkeyCount());
 	EXPECT_EQ(MOCKLEDGER_BLOCKS, chain.GetBlockCount());
 	EXPECT_EQ(MOCKLEDGER_TXS, chain.TXCount());
@@ -25,6 +27,102 @@ TEST(CatenaChain, ChainGenesisMock){
 	EXPECT_GE(chain.LookupRequestCount(false), 0);
 }
 
+// The maintained statistics ought agree with a walk over the whole ledger
+TEST(CatenaChain, Stats){
+	Catena::Chain chain(MOCKLEDGER, FixtureOptions());
+	auto stats = chain.Stats();
+	EXPECT_EQ(MOCKLEDGER_BLOCKS, stats.blocks);
+	EXPECT_EQ(MOCKLEDGER_TXS, stats.transactions);
+	EXPECT_EQ(MOCKLEDGER_PUBKEYS, stats.pubkeys);
+	EXPECT_EQ(chain.Size(), stats.bytes);
+	std::map<std::string, uint64_t> walked;
+	for(const auto& b : chain.Inspect(0, -1)){
+		for(const auto& tx : b.transactions){
+			++walked[tx->JSONify()["type"].get<std::string>()];
+		}
+	}
+	uint64_t total = 0;
+	for(unsigned t = 0 ; t < stats.txtypes.size() ; ++t){
+		EXPECT_EQ(walked[Catena::TXTypeName(t)], stats.txtypes[t]);
+		total += stats.txtypes[t];
+	}
+	EXPECT_EQ(0, stats.txtypes[0]);
+	EXPECT_EQ(stats.transactions, total);
+	EXPECT_EQ(walked["ConsortiumMember"], stats.members);
+	EXPECT_EQ(walked["User"], stats.users);
+	EXPECT_EQ(walked["LookupAuthReq"], stats.lookupreqs);
+	EXPECT_EQ(walked["UserStatusDelegation"], stats.delegations);
+	EXPECT_LE(stats.authorizedlookups, stats.lookupreqs);
+}
+
+TEST(CatenaChain, InspectByHashAndTime){
+	Catena::Chain chain(MOCKLEDGER, FixtureOptions());
+	auto all = chain.Inspect(0, -1);
+	ASSERT_EQ(MOCKLEDGER_BLOCKS, all.size());
+	auto blk = chain.Inspect(all[2].bhdr.hash);
+	EXPECT_EQ(all[2].offset, blk.offset);
+	EXPECT_EQ(all[2].transactions.size(), blk.transactions.size());
+	EXPECT_EQ(0, chain.FirstBlockSince(0));
+	EXPECT_EQ(chain.GetBlockCount(), chain.FirstBlockSince(chain.MostRecentBlock() + 1));
+	auto since = chain.Inspect(chain.FirstBlockSince(chain.MostRecentBlock()), -1);
+	ASSERT_LE(1, since.size());
+	EXPECT_EQ(all.back().bhdr.hash, since.back().bhdr.hash);
+}
+
+// Single transactions fetched by TXSpec or by hash match those of Inspect()
+TEST(CatenaChain, InspectTX){
+	Catena::Chain chain(MOCKLEDGER, FixtureOptions());
+	auto all = chain.Inspect(0, -1);
+	unsigned count = 0;
+	for(const auto& blk : all){
+		for(unsigned i = 0 ; i < blk.transactions.size() ; ++i){
+			Catena::TXSpec spec(blk.bhdr.hash, i);
+			auto tx = chain.InspectTX(spec);
+			ASSERT_NE(nullptr, tx);
+			EXPECT_EQ(blk.transactions[i]->JSONify(), tx->JSONify());
+			auto ser = tx->Serialize();
+			Catena::CatenaHash txhash;
+			Catena::catenaHash(ser.first.get(), ser.second, txhash);
+			auto found = chain.TXSpecByHash(txhash);
+			auto fser = chain.InspectTX(found)->Serialize();
+			ASSERT_EQ(ser.second, fser.second);
+			EXPECT_EQ(0, memcmp(ser.first.get(), fser.first.get(), ser.second));
+			++count;
+		}
+		Catena::TXSpec past(blk.bhdr.hash, blk.transactions.size());
+		EXPECT_THROW(chain.InspectTX(past), Catena::InvalidTXSpecException);
+	}
+	EXPECT_EQ(MOCKLEDGER_TXS, count);
+	Catena::CatenaHash nohash;
+	nohash.fill(0);
+	EXPECT_THROW(chain.TXSpecByHash(nohash), Catena::InvalidTXSpecException);
+	EXPECT_THROW(chain.InspectTX(Catena::TXSpec(nohash, 0)), Catena::InvalidTXSpecException);
+}
+
+// The hash index, once built, takes in transactions committed afterwards
+TEST(CatenaChain, TXSpecByHashAfterCommit){
+	Catena::Keypair kp(ECDSAKEY);
+	Catena::TXSpec cm1(CM1_TEST_TX);
+	Catena::Keypair newkp;
+	newkp.Generate();
+	auto pem = newkp.PubkeyPEM();
+	Catena::Chain chain("", 0);
+	chain.AddPrivateKey(cm1, kp);
+	Catena::CatenaHash nohash;
+	nohash.fill(0);
+	EXPECT_THROW(chain.TXSpecByHash(nohash), Catena::InvalidTXSpecException);
+	nlohmann::json j = nlohmann::json::parse("{ \"Entity\": \"Test entity\" }");
+	chain.AddConsortiumMember(cm1, reinterpret_cast<const unsigned char*>(pem.c_str()),
+					pem.length(), j);
+	chain.CommitOutstanding();
+	ASSERT_EQ(1, chain.GetBlockCount());
+	Catena::TXSpec spec(chain.Inspect(0, 0)[0].bhdr.hash, 0);
+	auto ser = chain.InspectTX(spec)->Serialize();
+	Catena::CatenaHash txhash;
+	Catena::catenaHash(ser.first.get(), ser.second, txhash);
+	EXPECT_EQ(spec, chain.TXSpecByHash(txhash));
+}
+
 TEST(CatenaChain, AddConsortiumMember){
 	Catena::Keypair kp(ECDSAKEY);
 	Catena::TXSpec cm1(CM1_TEST_TX);
@@ -48,13 +146,16 @@ TEST(CatenaChain, AddConsortiumMember){
 	EXPECT_LT(origsize, chain.Size());
 	EXPECT_EQ(1, chain.TXCount());
 	EXPECT_EQ(1, chain.GetBlockCount());
+	auto stats = chain.Stats();
+	EXPECT_EQ(1, stats.txtypes[static_cast<unsigned>(Catena::TXTypes::ConsortiumMember)]);
+	EXPECT_EQ(1, stats.members);
 }
 
 TEST(CatenaChain, AddConsortiumMemberKeySupplied){
   size_t len;
   auto res = Catena::ReadBinaryFile(ECDSAKEY, &len);
   ASSERT_NE(res.get(), nullptr);
-	Catena::Chain chain(MOCKLEDGER);
+	Catena::Chain chain(MOCKLEDGER, FixtureOptions());
 	Catena::TXSpec cm1(CM1_TEST_TX);
 	Catena::Keypair newkp;
 	newkp.Generate();
@@ -335,6 +436,9 @@ TEST(CatenaChain, AddUserStatus){
   chain.CommitOutstanding();
 	EXPECT_EQ(4, chain.TXCount());
 	EXPECT_EQ(4, chain.GetBlockCount());
+	EXPECT_EQ(usj.dump(), chain.UserStatusJSON(uspec, 0));
+	EXPECT_EQ(usj, chain.UserStatus(uspec, 0));
+	EXPECT_THROW(chain.UserStatusJSON(uspec, 1), Catena::UserStatusException);
 }
 
 TEST(CatenaChain, AddUserStatusBadUSD){
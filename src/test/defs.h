@@ -1,6 +1,8 @@
 #ifndef CATENA_TEST_DEFS
 #define CATENA_TEST_DEFS
 
+#include <libcatena/block.h>
+
 #define GENESISBLOCK_EXTERNAL "genesisblock"
 #define MOCKLEDGER "test/ledger-test"
 #define MOCKLEDGER_BLOCKS 19
@@ -33,4 +35,12 @@
 
 static const char TEST_X509_CHAIN[] = "test/node1chain.pem";
 
+// Ledgers within the source tree are loaded without their sidecar index, so
+// that running the tests writes nothing there
+inline Catena::LedgerOptions FixtureOptions(){
+	Catena::LedgerOptions opts;
+	opts.sidecar_index = false;
+	return opts;
+}
+
 #endif
@@ -0,0 +1,51 @@
+#include <thread>
+#include <vector>
+#include <unistd.h>
+#include <gtest/gtest.h>
+#include <libcatena/groupcommit.h>
+
+// Concurrent writers are all made durable, by no more syncs than writers
+TEST(CatenaGroupCommit, SharedSyncs){
+	char fname[] = "catenatest-gcommit-XXXXXX";
+	int fd = mkstemp(fname);
+	ASSERT_LE(0, fd);
+	Catena::GroupCommit gc(std::chrono::microseconds(1000));
+	const int WRITERS = 8;
+	std::vector<std::thread> writers;
+	std::vector<int> failed(WRITERS, 1);
+	for(int i = 0 ; i < WRITERS ; ++i){
+		writers.emplace_back([&, i](){
+			auto start = std::chrono::steady_clock::now();
+			char c = i;
+			ASSERT_EQ(1, pwrite(fd, &c, 1, i));
+			auto ticket = gc.Written(1);
+			failed[i] = gc.Wait(fd, ticket);
+			gc.Committed(start);
+		});
+	}
+	for(auto& t : writers){
+		t.join();
+	}
+	for(auto f : failed){
+		EXPECT_FALSE(f);
+	}
+	EXPECT_FALSE(gc.Drain(fd)); // nothing outstanding
+	auto stats = gc.Stats();
+	EXPECT_EQ(WRITERS, stats.commits);
+	EXPECT_EQ(WRITERS, stats.bytes);
+	EXPECT_LE(1, stats.syncs);
+	EXPECT_GE(WRITERS, stats.syncs);
+	EXPECT_LE(1000, stats.max_us);
+	close(fd);
+	unlink(fname);
+}
+
+// A failed sync is reported to every waiter, and sticks
+TEST(CatenaGroupCommit, SyncFailure){
+	Catena::GroupCommit gc(std::chrono::microseconds(0));
+	auto ticket = gc.Written(1);
+	EXPECT_TRUE(gc.Wait(-1, ticket));
+	EXPECT_TRUE(gc.Failed());
+	EXPECT_TRUE(gc.Wait(-1, ticket));
+	EXPECT_EQ(0, gc.Stats().syncs);
+}
@@ -1,3 +1,4 @@
+#include <vector>
 #include <gtest/gtest.h>
 #include <libcatena/hash.h>
 
@@ -27,6 +28,31 @@ TEST(CatenaHash, SHA256Vectors){
 	}
 }
 
+// Batched hashes match those computed singly, however the buffers' lengths
+// fall against the block size, and however many there are
+TEST(CatenaHash, SHA256Batch){
+	std::vector<unsigned char> data(4096);
+	for(size_t i = 0 ; i < data.size() ; ++i){
+		data[i] = i * 131 + (i >> 8);
+	}
+	std::vector<Catena::HashInput> in;
+	for(size_t len = 0 ; len <= 200 ; ++len){
+		in.push_back({data.data() + len, len});
+	}
+	in.push_back({data.data(), data.size()});
+	in.push_back({data.data() + 1, 1000});
+	for(size_t count : { in.size(), static_cast<size_t>(17), static_cast<size_t>(3)}){
+		std::vector<Catena::CatenaHash> out(count);
+		Catena::catenaHashBatch(in.data(), count, out.data());
+		for(size_t i = 0 ; i < count ; ++i){
+			Catena::CatenaHash h;
+			Catena::catenaHash(in[i].data, in[i].len, h);
+			EXPECT_EQ(h, out[i]) << "length " << in[i].len;
+		}
+	}
+	Catena::catenaHashBatch(nullptr, 0, nullptr); // ought be a no-op
+}
+
 TEST(CatenaHash, SHA256Serialize){
 	static const struct {
 		const char *hash;
@@ -1,5 +1,11 @@
+#include <map>
+#include <cstring>
+#include <set>
+#include <random>
 #include <gtest/gtest.h>
+#include <libcatena/exceptions.h>
 #include <libcatena/ledgermap.h>
+#include <libcatena/flatmap.h>
 
 // Transactions for the same block/idx ought hash equally
 TEST(CatenaLedgerMap, TXSpecHashReflexivity){
@@ -32,3 +38,167 @@ TEST(CatenaLedgerMap, TXSpecHashBlock){
 	auto h2 = std::hash<Catena::TXSpec>{}(tx2);
 	EXPECT_NE(h1, h2);
 }
+
+// Nearby transactions of the same block ought differ in the table index bits
+TEST(CatenaLedgerMap, TXSpecHashSpread){
+	Catena::CatenaHash ch;
+	ch.fill(0);
+	std::set<size_t> buckets;
+	for(unsigned i = 0 ; i < 64 ; ++i){
+		buckets.insert(std::hash<Catena::TXSpec>{}({ch, i}) & 0xfff);
+	}
+	EXPECT_LT(56, buckets.size());
+}
+
+// Random inserts and erases ought leave a FlatMap agreeing with std::map,
+// through rehashes and the backward shifts of erasure
+TEST(CatenaLedgerMap, FlatMapChurn){
+	Catena::FlatMap<Catena::TXSpec, unsigned> fm;
+	std::map<Catena::TXSpec, unsigned> m;
+	std::mt19937 rng(0);
+	Catena::CatenaHash ch;
+	ch.fill(0);
+	for(unsigned i = 0 ; i < 20000 ; ++i){
+		ch[31] = rng() % 4;
+		Catena::TXSpec spec(ch, rng() % 512);
+		if(rng() % 3){
+			EXPECT_EQ(m.emplace(spec, i).second, fm.emplace(spec, i).second);
+		}else{
+			EXPECT_EQ(m.erase(spec), fm.erase(spec));
+		}
+	}
+	ASSERT_EQ(m.size(), fm.size());
+	for(const auto& kv : m){
+		auto it = fm.find(kv.first);
+		ASSERT_NE(fm.end(), it);
+		EXPECT_EQ(kv.second, it->second);
+	}
+	size_t seen = 0;
+	for(const auto& kv : fm){
+		EXPECT_EQ(1, m.count(kv.first));
+		++seen;
+	}
+	EXPECT_EQ(m.size(), seen);
+	auto copy = fm;
+	fm.clear();
+	EXPECT_EQ(fm.end(), fm.find(m.begin()->first));
+	EXPECT_EQ(m.size(), copy.size());
+	EXPECT_NE(copy.end(), copy.find(m.begin()->first));
+}
+
+// Ids are issued densely in order of first appearance, records stay with their
+// specs as the index grows, and PopLast() forgets exactly the last, however the
+// index's probe runs were arranged
+TEST(CatenaLedgerMap, TXSpecTable){
+	Catena::TXSpecTable<unsigned> specs;
+	Catena::CatenaHash ch;
+	ch.fill(0);
+	std::vector<Catena::TXSpec> interned;
+	for(unsigned i = 0 ; i < 5000 ; ++i){
+		ch[31] = i % 7;
+		interned.emplace_back(ch, i);
+		bool added;
+		EXPECT_EQ(i, specs.Intern(interned.back(), &added));
+		EXPECT_TRUE(added);
+		EXPECT_EQ(0, specs.Record(i));
+		specs.Record(i) = i * 3;
+		EXPECT_EQ(i, specs.Intern(interned.back(), &added));
+		EXPECT_FALSE(added);
+	}
+	while(interned.size() > 100){
+		specs.PopLast();
+		EXPECT_EQ(nullptr, specs.Find(interned.back()));
+		interned.pop_back();
+	}
+	ASSERT_EQ(interned.size(), specs.size());
+	for(Catena::TXId i = 0 ; i < interned.size() ; ++i){
+		Catena::TXId id;
+		ASSERT_NE(nullptr, specs.Find(interned[i], &id));
+		EXPECT_EQ(i, id);
+		EXPECT_EQ(interned[i], specs.Spec(id));
+		EXPECT_EQ(i * 3, specs.Record(id));
+	}
+	// copies and moves must find specs in their own entries
+	auto copy = specs;
+	specs.PopLast();
+	EXPECT_EQ(nullptr, specs.Find(interned.back()));
+	EXPECT_NE(nullptr, copy.Find(interned.back()));
+	auto moved = std::move(copy);
+	copy = moved;
+	moved.PopLast();
+	EXPECT_EQ(nullptr, moved.Find(interned.back()));
+	EXPECT_EQ(interned.size(), copy.size());
+	for(const auto& spec : interned){
+		EXPECT_NE(nullptr, copy.Find(spec));
+	}
+}
+
+// Everything since Begin() is reverted by Rollback(), and kept by Commit()
+TEST(CatenaLedgerMap, Rollback){
+	Catena::LedgerMap lmap;
+	Catena::CatenaHash ch;
+	ch.fill(0);
+	Catena::TXSpec cm{ch, 0}, u1{ch, 1}, u2{ch, 2}, el{ch, 3}, lar{ch, 4}, usd{ch, 5};
+	lmap.AddConsortiumMember(cm, nlohmann::json({}));
+	lmap.AddUser(u1, cm);
+	lmap.SetUserStatus(u1, 0, nlohmann::json(1));
+	auto specs = lmap.TXSpecCount();
+	lmap.Begin();
+	lmap.AddUser(u2, cm);
+	lmap.AddExtLookup(el);
+	lmap.AddLookupReq(lar, el, cm);
+	lmap.AuthorizeLookupReq(lar);
+	lmap.AddDelegation(usd, cm, u1, 1);
+	lmap.SetUserStatus(u1, 0, nlohmann::json(2));
+	lmap.SetUserStatus(u1, 1, nlohmann::json(3));
+	EXPECT_EQ(2, lmap.UserCount());
+	EXPECT_EQ(2, lmap.ConsortiumMember(cm).users);
+	EXPECT_EQ(1, lmap.LookupRequestCount(true));
+	lmap.Rollback();
+	EXPECT_EQ(specs, lmap.TXSpecCount());
+	EXPECT_EQ(1, lmap.UserCount());
+	EXPECT_EQ(1, lmap.ConsortiumMember(cm).users);
+	EXPECT_EQ(0, lmap.ExternalLookupCount());
+	EXPECT_EQ(0, lmap.LookupRequestCount());
+	EXPECT_EQ(0, lmap.StatusDelegationCount());
+	EXPECT_EQ(nlohmann::json(1), lmap.LookupUser(u1).Status(0));
+	EXPECT_THROW(lmap.LookupUser(u1).Status(1), Catena::UserStatusException);
+	lmap.Begin();
+	lmap.AddLookupReq(lar, el, cm);
+	lmap.Commit();
+	lmap.Rollback(); // nothing left to undo
+	EXPECT_EQ(1, lmap.LookupRequestCount(false));
+	// an inner Commit() leaves its changes to the outer scope
+	lmap.Begin();
+	lmap.AddExtLookup(el);
+	lmap.Begin();
+	lmap.AddUser(u2, cm);
+	lmap.Commit();
+	lmap.Begin();
+	lmap.AuthorizeLookupReq(lar);
+	lmap.Rollback();
+	EXPECT_EQ(0, lmap.LookupRequestCount(true));
+	EXPECT_EQ(2, lmap.UserCount());
+	lmap.Rollback();
+	EXPECT_EQ(1, lmap.UserCount());
+	EXPECT_EQ(0, lmap.ExternalLookupCount());
+}
+
+// Unknown delegations and users are reported before a bad payload, which
+// leaves the status untouched
+TEST(CatenaLedgerMap, SetDelegatedStatus){
+	Catena::LedgerMap lmap;
+	Catena::CatenaHash ch;
+	ch.fill(0);
+	Catena::TXSpec cm{ch, 0}, u{ch, 1}, usd{ch, 2}, usd2{ch, 3};
+	const char good[] = "{\"a\": 1}", bad[] = "{\"a\": }";
+	lmap.AddConsortiumMember(cm, nlohmann::json({}));
+	lmap.AddDelegation(usd2, cm, {ch, 4}, 0);
+	EXPECT_THROW(lmap.SetDelegatedStatus(usd, bad, strlen(bad)), Catena::InvalidTXSpecException);
+	EXPECT_THROW(lmap.SetDelegatedStatus(usd2, bad, strlen(bad)), Catena::InvalidTXSpecException);
+	lmap.AddUser(u, cm);
+	lmap.AddDelegation(usd, cm, u, 0);
+	EXPECT_FALSE(lmap.SetDelegatedStatus(usd, good, strlen(good)));
+	EXPECT_TRUE(lmap.SetDelegatedStatus(usd, bad, strlen(bad)));
+	EXPECT_EQ(good, lmap.LookupUser(u).StatusJSON(0));
+}
@@ -0,0 +1,43 @@
+#include <cstdlib>
+#include <cstring>
+#include <unistd.h>
+#include <gtest/gtest.h>
+#include <libcatena/utility.h>
+#include <libcatena/mmap.h>
+#include "test/defs.h"
+
+// Try to map a directory and device (expect an exception)
+TEST(CatenaMappedFile, Irregulars){
+	EXPECT_THROW(Catena::MappedFile("/"), std::ifstream::failure);
+	EXPECT_THROW(Catena::MappedFile("/dev/null"), std::ifstream::failure);
+	EXPECT_THROW(Catena::MappedFile(""), std::ifstream::failure);
+}
+
+// The mapping ought match a plain read of the file
+TEST(CatenaMappedFile, MatchesRead){
+	size_t len;
+	auto memblock = Catena::ReadBinaryFile(MOCKLEDGER, &len);
+	Catena::MappedFile mf(MOCKLEDGER);
+	ASSERT_EQ(len, mf.Size());
+	EXPECT_LT(len, mf.Capacity());
+	EXPECT_EQ(0, memcmp(memblock.get(), mf.Data(), len));
+}
+
+// Data appended to the file is visible following Extend(), without remapping
+TEST(CatenaMappedFile, ExtendAfterAppend){
+	char fname[] = "catenatest-mmap-XXXXXX";
+	int fd = mkstemp(fname);
+	ASSERT_LE(0, fd);
+	Catena::MappedFile mf(fname);
+	EXPECT_EQ(0, mf.Size());
+	const unsigned char* data = mf.Data();
+	const char buf[] = "appended";
+	ASSERT_EQ(sizeof(buf), write(fd, buf, sizeof(buf)));
+	close(fd);
+	EXPECT_TRUE(mf.Extend(sizeof(buf)));
+	EXPECT_EQ(sizeof(buf), mf.Size());
+	EXPECT_EQ(data, mf.Data());
+	EXPECT_EQ(0, memcmp(buf, mf.Data(), sizeof(buf)));
+	EXPECT_FALSE(mf.Extend(mf.Capacity() + 1));
+	unlink(fname);
+}
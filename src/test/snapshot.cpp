@@ -0,0 +1,155 @@
+#include <cstring>
+#include <unistd.h>
+#include <gtest/gtest.h>
+#include <libcatena/snapshot.h>
+#include <libcatena/builtin.h>
+#include <libcatena/utility.h>
+#include <libcatena/chain.h>
+#include "test/defs.h"
+
+// Copy the mock ledger to a temporary file, returning its name
+static std::string MockLedgerCopy(){
+	size_t len;
+	auto ledger = Catena::ReadBinaryFile(MOCKLEDGER, &len);
+	char fname[] = "catenatest-snapshot-XXXXXX";
+	int fd = mkstemp(fname);
+	EXPECT_LE(0, fd);
+	EXPECT_EQ(len, write(fd, ledger.get(), len));
+	close(fd);
+	return fname;
+}
+
+static void RemoveLedgerCopy(const std::string& fname){
+	for(unsigned i = 0 ; i < Catena::Snapshot::SLOTS ; ++i){
+		unlink(Catena::Snapshot::FileName(fname, i).c_str());
+	}
+	unlink(Catena::Blocks::IndexName(fname, false).c_str());
+	unlink(fname.c_str());
+}
+
+static void ExpectSameLedgerMap(const Catena::LedgerMap& l1, const Catena::LedgerMap& l2){
+	EXPECT_EQ(l1.ExternalLookupCount(), l2.ExternalLookupCount());
+	EXPECT_EQ(l1.ConsortiumMemberCount(), l2.ConsortiumMemberCount());
+	EXPECT_EQ(l1.UserCount(), l2.UserCount());
+	EXPECT_EQ(l1.StatusDelegationCount(), l2.StatusDelegationCount());
+	EXPECT_EQ(l1.LookupRequestCount(true), l2.LookupRequestCount(true));
+	EXPECT_EQ(l1.LookupRequestCount(false), l2.LookupRequestCount(false));
+	auto cms1 = l1.ConsortiumMembers();
+	auto cms2 = l2.ConsortiumMembers();
+	ASSERT_EQ(cms1.size(), cms2.size());
+	for(size_t i = 0 ; i < cms1.size() ; ++i){
+		EXPECT_EQ(cms1[i].cmspec, cms2[i].cmspec);
+		EXPECT_EQ(cms1[i].users, cms2[i].users);
+		EXPECT_EQ(cms1[i].payload, cms2[i].payload);
+	}
+}
+
+// Write out the mock ledger's state, and read it back into fresh structures
+TEST(CatenaSnapshot, RoundTrip){
+	Catena::LedgerMap lmap;
+	Catena::TrustStore tstore;
+	Catena::BuiltinKeys bkeys;
+	bkeys.AddToTrustStore(tstore);
+	Catena::Blocks cbs;
+	size_t len;
+	auto ledger = Catena::ReadBinaryFile(MOCKLEDGER, &len);
+	ASSERT_FALSE(cbs.LoadData(ledger.get(), len, lmap, tstore));
+	auto fname = MockLedgerCopy();
+	auto sname = Catena::Snapshot::FileName(fname, 0);
+	Catena::LedgerAnchor anchor{cbs.GetBlockCount(), cbs.HashByIdx(cbs.GetBlockCount() - 1)};
+	Catena::Snapshot::Write(sname, anchor, lmap, tstore);
+	Catena::LedgerMap lmap2;
+	Catena::TrustStore tstore2;
+	Catena::LedgerAnchor anchor2;
+	ASSERT_FALSE(Catena::Snapshot::Read(sname, &anchor2, lmap2, tstore2));
+	EXPECT_EQ(anchor.height, anchor2.height);
+	EXPECT_EQ(anchor.hash, anchor2.hash);
+	EXPECT_EQ(MOCKLEDGER_PUBKEYS, tstore2.PubkeyCount());
+	ExpectSameLedgerMap(lmap, lmap2);
+	RemoveLedgerCopy(fname);
+}
+
+// A damaged or absent snapshot is rejected, leaving the state untouched
+TEST(CatenaSnapshot, Corrupt){
+	Catena::LedgerMap lmap;
+	Catena::TrustStore tstore;
+	Catena::BuiltinKeys bkeys;
+	bkeys.AddToTrustStore(tstore);
+	Catena::LedgerAnchor anchor;
+	auto fname = MockLedgerCopy();
+	auto sname = Catena::Snapshot::FileName(fname, 0);
+	EXPECT_TRUE(Catena::Snapshot::Read(sname, &anchor, lmap, tstore));
+	anchor.height = 1;
+	anchor.hash.fill(0);
+	Catena::Snapshot::Write(sname, anchor, lmap, tstore);
+	std::fstream fs(sname, std::ios::in | std::ios::out | std::ios::binary);
+	fs.seekp(12);
+	fs.put(0x7f);
+	fs.close();
+	Catena::TrustStore tstore2;
+	EXPECT_TRUE(Catena::Snapshot::Read(sname, &anchor, lmap, tstore2));
+	EXPECT_EQ(0, tstore2.PubkeyCount());
+	RemoveLedgerCopy(fname);
+}
+
+// A Chain writes snapshots as it loads and grows, and restores from them
+TEST(CatenaSnapshot, ChainRestart){
+	auto fname = MockLedgerCopy();
+	Catena::LedgerOptions opts;
+	opts.snapshot_interval = 1;
+	Catena::CatenaHash lasthash;
+	{
+		Catena::Chain chain(fname, opts);
+		lasthash = chain.MostRecentBlockHash();
+		chain.CommitOutstanding();
+	}
+	Catena::LedgerMap lmap;
+	Catena::TrustStore tstore;
+	Catena::LedgerAnchor anchor;
+	ASSERT_FALSE(Catena::Snapshot::Read(Catena::Snapshot::FileName(fname, 0),
+				&anchor, lmap, tstore));
+	EXPECT_EQ(MOCKLEDGER_BLOCKS, anchor.height);
+	EXPECT_EQ(lasthash, anchor.hash);
+	ASSERT_FALSE(Catena::Snapshot::Read(Catena::Snapshot::FileName(fname, 1),
+				&anchor, lmap, tstore));
+	EXPECT_EQ(MOCKLEDGER_BLOCKS + 1, anchor.height);
+	Catena::Chain chain(fname, opts);
+	EXPECT_EQ(MOCKLEDGER_BLOCKS + 1, chain.GetBlockCount());
+	EXPECT_EQ(MOCKLEDGER_TXS, chain.TXCount());
+	EXPECT_EQ(MOCKLEDGER_PUBKEYS, chain.PubkeyCount());
+	RemoveLedgerCopy(fname);
+}
+
+// State comes from the snapshot rather than replay, unless the snapshot
+// doesn't match the ledger
+TEST(CatenaSnapshot, ChainAnchor){
+	auto fname = MockLedgerCopy();
+	Catena::LedgerOptions opts;
+	opts.snapshot_interval = 0;
+	Catena::LedgerAnchor anchor;
+	int users;
+	{
+		Catena::Chain chain(fname, opts);
+		users = chain.UserCount();
+		anchor.height = chain.GetBlockCount();
+		anchor.hash = chain.MostRecentBlockHash();
+	}
+	ASSERT_LT(0, users);
+	Catena::LedgerMap empty;
+	Catena::TrustStore tstore;
+	Catena::Snapshot::Write(Catena::Snapshot::FileName(fname, 0), anchor, empty, tstore);
+	opts.snapshot_interval = 1024;
+	{
+		Catena::Chain chain(fname, opts);
+		EXPECT_EQ(MOCKLEDGER_BLOCKS, chain.GetBlockCount());
+		EXPECT_EQ(0, chain.UserCount());
+	}
+	anchor.hash[0] ^= 0xff;
+	Catena::Snapshot::Write(Catena::Snapshot::FileName(fname, 0), anchor, empty, tstore);
+	{
+		Catena::Chain chain(fname, opts);
+		EXPECT_EQ(MOCKLEDGER_BLOCKS, chain.GetBlockCount());
+		EXPECT_EQ(users, chain.UserCount());
+	}
+	RemoveLedgerCopy(fname);
+}
@@ -194,3 +194,133 @@ TEST(CatenaTrustStore, SignSuppliedKey){
 					strlen(*t), sig.first.get(), sig.second));
 	}
 }
+
+// Keys added since Begin() are dropped by Rollback()
+// Our own signatures are cached as good; others are verified once, and only
+// successes are remembered
+TEST(CatenaTrustStore, SignatureCache){
+	Catena::TrustStore tstore;
+	Catena::Keypair kp(ECDSAKEY);
+	Catena::KeyLookup kl;
+	RAND_bytes(kl.first.data(), kl.first.size());
+	kl.second = 5;
+	tstore.AddKey(&kp, kl);
+	const unsigned char data[] = "signed";
+	auto sig = tstore.Sign(data, sizeof(data), kl);
+	EXPECT_EQ(1, tstore.SignatureCacheStats().entries);
+	EXPECT_FALSE(tstore.Verify(kl, data, sizeof(data), sig.first.get(), sig.second));
+	EXPECT_EQ(1, tstore.SignatureCacheStats().hits);
+	++sig.first[sig.second - 1];
+	EXPECT_TRUE(tstore.Verify(kl, data, sizeof(data), sig.first.get(), sig.second));
+	EXPECT_TRUE(tstore.Verify(kl, data, sizeof(data), sig.first.get(), sig.second));
+	EXPECT_EQ(2, tstore.SignatureCacheStats().misses);
+	EXPECT_EQ(1, tstore.SignatureCacheStats().entries);
+	// the same signature by a different signer is a different check
+	auto other = kl;
+	++other.second;
+	--sig.first[sig.second - 1];
+	EXPECT_TRUE(tstore.Verify(other, data, sizeof(data), sig.first.get(), sig.second));
+	Catena::TrustStore copy(tstore);
+	EXPECT_EQ(1, copy.SignatureCacheStats().entries);
+}
+
+TEST(CatenaTrustStore, SignatureCacheEviction){
+	Catena::SigCache sc(2);
+	Catena::CatenaHash h[3];
+	for(int i = 0 ; i < 3 ; ++i){
+		h[i].fill(i);
+		sc.Insert(h[i]);
+	}
+	EXPECT_EQ(2, sc.Stats().entries);
+	EXPECT_FALSE(sc.Contains(h[0]));
+	EXPECT_TRUE(sc.Contains(h[1]));
+	EXPECT_TRUE(sc.Contains(h[2]));
+	sc.Clear();
+	EXPECT_FALSE(sc.Contains(h[2]));
+}
+
+// Prepared keys reach the same verdicts as their Keypairs
+TEST(CatenaTrustStore, HotKeys){
+	Catena::Keypair kp(ECDSAKEY);
+	Catena::KeyLookup kl;
+	RAND_bytes(kl.first.data(), kl.first.size());
+	kl.second = 0;
+	Catena::HotKeys hk(1);
+	for(auto t = tests ; *t ; ++t){
+		auto data = reinterpret_cast<const unsigned char*>(*t);
+		auto sig = kp.Sign(data, strlen(*t));
+		EXPECT_FALSE(hk.Verify(kl, kp, data, strlen(*t), sig.first.get(), sig.second));
+		EXPECT_EQ(kp.Verify(data, strlen(*t) / 2, sig.first.get(), sig.second),
+				hk.Verify(kl, kp, data, strlen(*t) / 2, sig.first.get(), sig.second));
+		++sig.first[sig.second / 2];
+		EXPECT_TRUE(hk.Verify(kl, kp, data, strlen(*t), sig.first.get(), sig.second));
+		EXPECT_TRUE(kp.Verify(data, strlen(*t), sig.first.get(), sig.second));
+	}
+	auto stats = hk.Stats();
+	EXPECT_EQ(1, stats.misses);
+	EXPECT_EQ(1, stats.entries);
+	auto other = kl;
+	++other.second;
+	hk.Verify(other, kp, nullptr, 0, nullptr, 0); // evicts kl
+	EXPECT_EQ(1, hk.Stats().entries);
+	EXPECT_EQ(2, hk.Stats().misses);
+	hk.Erase(other);
+	EXPECT_EQ(0, hk.Stats().entries);
+}
+
+// Encoded keys are validated on AddKey(), but not on RestoreKey(), and in
+// either case decoded only when used
+TEST(CatenaTrustStore, EncodedKeys){
+	Catena::TrustStore tstore(1);
+	Catena::Keypair kp(ECDSAKEY);
+	auto pem = kp.PubkeyPEM();
+	auto pemdata = reinterpret_cast<const unsigned char*>(pem.data());
+	Catena::CatenaHash ch;
+	ch.fill(0);
+	const unsigned char bad[] = "not a key";
+	EXPECT_THROW(tstore.AddKey(bad, sizeof(bad), {ch, 0}), Catena::KeypairException);
+	EXPECT_FALSE(tstore.HasKey({ch, 0}));
+	tstore.AddKey(pemdata, pem.size(), {ch, 0});
+	tstore.RestoreKey(pemdata, pem.size(), {ch, 1});
+	tstore.RestoreKey(bad, sizeof(bad), {ch, 2});
+	EXPECT_EQ(3, tstore.PubkeyCount());
+	auto k1 = tstore.LookupKey({ch, 1}); // evicts {ch, 0}
+	ASSERT_NE(nullptr, k1);
+	EXPECT_EQ(kp, *k1);
+	EXPECT_EQ(1, tstore.DecodedKeyStats().entries);
+	auto k0 = tstore.LookupKey({ch, 0});
+	ASSERT_NE(nullptr, k0);
+	EXPECT_EQ(kp, *k0);
+	EXPECT_EQ(nullptr, tstore.LookupKey({ch, 2}));
+	const unsigned char data[] = "signed";
+	auto sig = kp.Sign(data, sizeof(data));
+	EXPECT_FALSE(tstore.Verify({ch, 1}, data, sizeof(data), sig.first.get(), sig.second));
+	EXPECT_TRUE(tstore.Verify({ch, 2}, data, sizeof(data), sig.first.get(), sig.second));
+	// merging in the private key yields a decoded key, which can sign
+	tstore.Begin();
+	tstore.AddKey(&kp, {ch, 1});
+	EXPECT_NO_THROW(tstore.Sign(data, sizeof(data), {ch, 1}));
+	tstore.Rollback();
+	EXPECT_THROW(tstore.Sign(data, sizeof(data), {ch, 1}), Catena::SigningException);
+	Catena::TrustStore copy(tstore);
+	EXPECT_NE(nullptr, copy.LookupKey({ch, 0}));
+}
+
+TEST(CatenaTrustStore, Rollback){
+	Catena::BuiltinKeys bkeys;
+	Catena::TrustStore tstore;
+	bkeys.AddToTrustStore(tstore);
+	Catena::Keypair kp(ECDSAKEY);
+	Catena::CatenaHash ch;
+	ch.fill(0);
+	tstore.Begin();
+	tstore.AddKey(&kp, {ch, 0});
+	EXPECT_EQ(bkeys.Count() + 1, tstore.PubkeyCount());
+	tstore.Rollback();
+	EXPECT_EQ(bkeys.Count(), tstore.PubkeyCount());
+	EXPECT_FALSE(tstore.HasKey({ch, 0}));
+	tstore.Begin();
+	tstore.AddKey(&kp, {ch, 0});
+	tstore.Commit();
+	EXPECT_TRUE(tstore.HasKey({ch, 0}));
+}
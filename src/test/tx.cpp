@@ -1,6 +1,7 @@
 #include <cstring>
 #include <gtest/gtest.h>
 #include <libcatena/utility.h>
+#include <libcatena/txvalue.h>
 #include <libcatena/hash.h>
 #include <libcatena/tx.h>
 
@@ -11,6 +12,17 @@ TEST(CatenaTransactions, EmptyTX){
 	EXPECT_THROW(Catena::Transaction::LexTX(buf, 1, hash, 0), Catena::TransactionException);
 }
 
+// A failed lex leaves the vector as it was
+TEST(CatenaTransactions, EmptyTXValue){
+	Catena::CatenaHash hash;
+	unsigned char buf[4] = {0, 1, 0, 0}; // ConsortiumMember, truncated
+	std::vector<Catena::TXValue> txs;
+	EXPECT_THROW(Catena::LexTXValue(txs, buf, 0, hash, 0), Catena::TransactionException);
+	EXPECT_THROW(Catena::LexTXValue(txs, buf, 1, hash, 0), Catena::TransactionException);
+	EXPECT_THROW(Catena::LexTXValue(txs, buf, sizeof(buf), hash, 0), Catena::TransactionException);
+	EXPECT_TRUE(txs.empty());
+}
+
 TEST(CatenaTransactions, StrToTXSpec){
 	auto tx = Catena::TXSpec::StrToTXSpec("ffffffffffffffffffffffffffffffffffffffffffffffffffffffffffffffff.0");
 	EXPECT_EQ(0, tx.second);
@@ -1,7 +1,11 @@
+#include <random>
 #include <cstring>
 #include <climits>
 #include <gtest/gtest.h>
+#include <nlohmann/json.hpp>
+#include <libcatena/jsoncheck.h>
 #include <libcatena/utility.h>
+#include <libcatena/wire.h>
 
 static const struct {
 	unsigned long hbo;
@@ -39,6 +43,66 @@ TEST(CatenaUtility, nbo_to_ulong){
 	}
 }
 
+// Dispatch a runtime width to the compile-time codec
+static unsigned long LoadNBO(const unsigned char* data, size_t bytes){
+	switch(bytes){
+		case 1: return Catena::LoadNBO<1>(data);
+		case 2: return Catena::LoadNBO<2>(data);
+		case 3: return Catena::LoadNBO<3>(data);
+		case 4: return Catena::LoadNBO<4>(data);
+		case 8: return Catena::LoadNBO<8>(data);
+	}
+	throw std::invalid_argument("unsupported width");
+}
+
+static unsigned char* StoreNBO(unsigned long hbo, unsigned char* data, size_t bytes){
+	switch(bytes){
+		case 1: return Catena::StoreNBO<1>(hbo, data);
+		case 2: return Catena::StoreNBO<2>(hbo, data);
+		case 3: return Catena::StoreNBO<3>(hbo, data);
+		case 4: return Catena::StoreNBO<4>(hbo, data);
+		case 8: return Catena::StoreNBO<8>(hbo, data);
+	}
+	throw std::invalid_argument("unsupported width");
+}
+
+TEST(CatenaUtility, LoadStoreNBO){
+	for(auto t = tests ; t->bytes ; ++t){
+		unsigned char conv[sizeof(t->conv)];
+		memset(conv, 0xff, sizeof(conv));
+		EXPECT_EQ(conv + t->bytes, StoreNBO(t->hbo, conv, t->bytes));
+		EXPECT_EQ(0, memcmp(conv, t->conv, t->bytes));
+		EXPECT_EQ(t->hbo, LoadNBO(t->conv, t->bytes));
+	}
+	const unsigned char odd[] = "\x01\x02\x03\x04\x05\x06\x07";
+	EXPECT_EQ(0x0102030405ul, Catena::LoadNBO<5>(odd));
+	EXPECT_EQ(0x01020304050607ul, Catena::LoadNBO<7>(odd));
+}
+
+// Reads past the end throw the reader's exception type, without consuming
+TEST(CatenaUtility, WireReaderBounds){
+	const unsigned char buf[] = "\x00\x02\xff";
+	Catena::WireReader<Catena::ConvertInputException> r(buf, 3);
+	EXPECT_THROW(r.Int<4>(), Catena::ConvertInputException);
+	EXPECT_THROW(r.Peek<2>(2), Catena::ConvertInputException);
+	EXPECT_EQ(2, r.Int<2>());
+	EXPECT_THROW(r.Bytes(2), Catena::ConvertInputException);
+	EXPECT_EQ(buf + 2, r.Bytes(1));
+	EXPECT_EQ(0, r.Left());
+	EXPECT_THROW(r.Hash(), Catena::ConvertInputException);
+}
+
+TEST(CatenaUtility, WireWriterBounds){
+	unsigned char buf[4];
+	Catena::WireWriter w(buf, sizeof(buf));
+	EXPECT_THROW(w.Int<1>(256), std::out_of_range);
+	w.Int<2>(0xffff);
+	EXPECT_THROW(w.Int<4>(0), std::out_of_range);
+	w.Int<2>(1);
+	EXPECT_EQ(0, w.Left());
+	EXPECT_EQ(0, memcmp(buf, "\xff\xff\x00\x01", sizeof(buf)));
+}
+
 // Try to read a directory and device as a binary file (expect an exception)
 TEST(CatenaUtility, ReadBinaryFileIrregulars){
 	size_t len;
@@ -151,3 +215,53 @@ TEST(CatenaUtility, IgnoreSignal){
 	Catena::IgnoreSignal(SIGPIPE);
 	EXPECT_EQ(0, raise(SIGPIPE)); // ought not die
 }
+
+static bool NlohmannRejects(const std::string& s){
+	try{
+		auto j = nlohmann::json::parse(s);
+		(void)j;
+	}catch(const nlohmann::json::exception&){
+		return true;
+	}
+	return false;
+}
+
+// InvalidJSON() must agree with nlohmann::json::parse(), which it stands in
+// for when validating status payloads
+TEST(CatenaUtility, JSONCheck){
+	const char* cases[] = {
+		"{}", "[]", "0", "-0", "1.5e10", "-12.5E-3", "true", "false", "null",
+		"\"\"", " \t\r\n{ \"a\" : [1, 2, {\"b\": null}] } ",
+		"\"\\u00e9\\ud83d\\ude00\\n\\/\"", "\"\xc3\xa9\xf0\x9f\x98\x80\"",
+		"\xef\xbb\xbf{}", "123456789012345678901234567890", "1e308", "1e309",
+		"", " ", "{", "}", "[1,]", "{\"a\":1,}", "{\"a\"}", "{1:2}", "01", "1.",
+		".5", "-", "1e", "+1", "tru", "nul", "[1 2]", "{} {}", "\"\\ud800\"",
+		"\"\\udc00\"", "\"\\ud800\\u0041\"", "\"\\x\"", "\"\t\"",
+		"\"\xc0\xaf\"", "\"\xed\xa0\x80\"", "\"\xf4\x90\x80\x80\"",
+		"\"\xe2\x82\"", "\xef\xbb{}", "[\"unterminated]", "NaN", "[-]",
+	};
+	for(auto c : cases){
+		std::string s(c);
+		EXPECT_EQ(NlohmannRejects(s), Catena::InvalidJSON(s.data(), s.size())) << s;
+	}
+	std::string deep = std::string(2000, '[') + std::string(2000, ']');
+	EXPECT_FALSE(Catena::InvalidJSON(deep.data(), deep.size()));
+	deep.pop_back();
+	EXPECT_TRUE(Catena::InvalidJSON(deep.data(), deep.size()));
+	// mutations of a valid document
+	const std::string base = "{\"name\": \"caf\xc3\xa9 \\u00e9\", \"n\": [1, -2.5e3, true, null], \"o\": {}}";
+	std::mt19937 rng(0);
+	const char alphabet[] = "{}[]\",:\\/ -+.eE0123456789aeflnrstu\x80\xbf\xc3\xef";
+	for(int i = 0 ; i < 20000 ; ++i){
+		auto s = base;
+		for(auto n = rng() % 3 + 1 ; n ; --n){
+			auto pos = rng() % (s.size() + 1);
+			switch(rng() % 3){
+			case 0: s.insert(pos, 1, alphabet[rng() % (sizeof(alphabet) - 1)]); break;
+			case 1: if(pos < s.size()){ s.erase(pos, 1); } break;
+			case 2: if(pos < s.size()){ s[pos] = alphabet[rng() % (sizeof(alphabet) - 1)]; } break;
+			}
+		}
+		ASSERT_EQ(NlohmannRejects(s), Catena::InvalidJSON(s.data(), s.size())) << s;
+	}
+}